@@ -8,20 +8,20 @@ namespace sequant {
 
 TensorCanonicalizer::~TensorCanonicalizer() = default;
 
-container::map<std::wstring, std::shared_ptr<TensorCanonicalizer>> &TensorCanonicalizer::instance_map_accessor() {
-  static container::map<std::wstring, std::shared_ptr<TensorCanonicalizer>> map_;
-  return map_;
-}
+struct TensorCanonicalizer::Registry {
+  container::map<std::wstring, std::shared_ptr<TensorCanonicalizer>> instances;
+  container::vector<std::wstring> cardinal_tensor_labels;
+};
 
-container::vector<std::wstring>
-&TensorCanonicalizer::cardinal_tensor_labels_accessor() {
-  static container::vector<std::wstring> ctlabels_;
-  return ctlabels_;
+SnapshotRegistry<TensorCanonicalizer::Registry> &
+TensorCanonicalizer::registry() {
+  static SnapshotRegistry<Registry> registry_;
+  return registry_;
 }
 
 std::shared_ptr<TensorCanonicalizer> TensorCanonicalizer::instance(
     std::wstring_view label) {
-  auto &map = instance_map_accessor();
+  const auto &map = registry().snapshot().instances;
   // look for label-specific canonicalizer
   auto it = map.find(std::wstring{label});
   if (it != map.end()) {
@@ -36,10 +36,22 @@ std::shared_ptr<TensorCanonicalizer> TensorCanonicalizer::instance(
 }
 
 void TensorCanonicalizer::register_instance(std::shared_ptr<TensorCanonicalizer> can, std::wstring_view label) {
-  auto &map = instance_map_accessor();
-  map[std::wstring{label}] = can;
+  registry().update([&](Registry &registry) {
+    registry.instances[std::wstring{label}] = can;
+  });
+}
+
+const container::vector<std::wstring>
+    &TensorCanonicalizer::cardinal_tensor_labels() {
+  return registry().snapshot().cardinal_tensor_labels;
 }
 
+void TensorCanonicalizer::set_cardinal_tensor_labels(
+    const container::vector<std::wstring> &labels) {
+  registry().update([&](Registry &registry) {
+    registry.cardinal_tensor_labels = labels;
+  });
+}
 
 ExprPtr DefaultTensorCanonicalizer::apply(AbstractTensor &t) {
   // tag all indices as ext->true/ind->false
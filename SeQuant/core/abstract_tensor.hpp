@@ -12,6 +12,7 @@
 #include "algorithm.hpp"
 #include "expr.hpp"
 #include "index.hpp"
+#include "snapshot.hpp"
 
 namespace sequant {
 
@@ -174,15 +175,13 @@ class TensorCanonicalizer {
       std::wstring_view label = L"");
 
   /// @return a list of Tensor labels with lexicographic preference (in order)
-  static const auto &cardinal_tensor_labels() {
-    return cardinal_tensor_labels_accessor();
-  }
+  /// @note the returned reference remains valid after
+  ///       set_cardinal_tensor_labels() , but refers to the old list
+  static const container::vector<std::wstring> &cardinal_tensor_labels();
   /// @param cardinal_tensor_labels a list of Tensor labels with lexicographic
   /// preference (in order)
   static void set_cardinal_tensor_labels(
-      const container::vector<std::wstring> &labels) {
-    cardinal_tensor_labels_accessor() = labels;
-  }
+      const container::vector<std::wstring> &labels);
 
   /// @return a side effect of canonicalization (e.g. phase), or nullptr if none
   /// @internal what should be returned if canonicalization requires
@@ -200,9 +199,11 @@ class TensorCanonicalizer {
   }
 
  private:
-  static container::map<std::wstring, std::shared_ptr<TensorCanonicalizer>>
-  &instance_map_accessor();
-  static container::vector<std::wstring> &cardinal_tensor_labels_accessor();
+  /// the registered canonicalizers and cardinal tensor labels, defined in
+  /// abstract_tensor.cpp ; lookups do not lock, hence canonicalization can
+  /// proceed concurrently on many threads
+  struct Registry;
+  static SnapshotRegistry<Registry> &registry();
 };
 
 class DefaultTensorCanonicalizer : public TensorCanonicalizer {
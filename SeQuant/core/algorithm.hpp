@@ -5,6 +5,13 @@
 #ifndef SEQUANT_ALGORITHM_HPP
 #define SEQUANT_ALGORITHM_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "runtime.hpp"
+
 namespace sequant {
 
 /// @brief bubble sort that uses swap exclusively
@@ -58,6 +65,51 @@ void bubble_sort(ForwardIter begin, Sentinel end, Compare comp) {
   } while (swapped);
 }
 
+/// @brief stable sort that sorts chunks of the range, and then merges pairs
+/// of adjacent sorted chunks, in parallel
+
+/// The result is identical to that of std::stable_sort, regardless of the
+/// number of threads.
+/// @param begin the beginning of the range
+/// @param end the end of the range
+/// @param comp the comparator; must be safe to invoke concurrently
+/// @param min_chunk_size ranges shorter than twice this are sorted serially
+/// @sa num_threads()
+template <typename RandomIter, typename Compare>
+void parallel_stable_sort(RandomIter begin, RandomIter end, Compare comp,
+                          std::size_t min_chunk_size = 1024) {
+  const auto size = static_cast<std::size_t>(end - begin);
+  const auto nchunks = std::min(static_cast<std::size_t>(num_threads()),
+                                size / std::max<std::size_t>(min_chunk_size, 1));
+  if (nchunks < 2) {
+    std::stable_sort(begin, end, comp);
+    return;
+  }
+
+  // chunk c spans [bounds[c], bounds[c+1])
+  std::vector<RandomIter> bounds(nchunks + 1);
+  for (std::size_t c = 0; c <= nchunks; ++c)
+    bounds[c] = begin + size * c / nchunks;
+
+  parallel_for_each(
+      [&](std::size_t c) { std::stable_sort(bounds[c], bounds[c + 1], comp); },
+      nchunks);
+  // merge runs of width chunks pairwise until a single run remains
+  for (std::size_t width = 1; width < nchunks; width *= 2) {
+    const auto nmerges = (nchunks + 2 * width - 1) / (2 * width);
+    parallel_for_each(
+        [&](std::size_t m) {
+          const auto first = 2 * width * m;
+          const auto middle = first + width;
+          const auto last = std::min(first + 2 * width, nchunks);
+          if (middle < last)
+            std::inplace_merge(bounds[first], bounds[middle], bounds[last],
+                               comp);
+        },
+        nmerges);
+  }
+}
+
 }  // namespace sequant
 
 #endif  // SEQUANT_ALGORITHM_HPP
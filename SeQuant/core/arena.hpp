@@ -0,0 +1,155 @@
+#ifndef SEQUANT_ARENA_HPP
+#define SEQUANT_ARENA_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace sequant {
+
+/// @brief Arena for the nodes of expression trees.
+///
+/// While an ExprArena::Scope is open on a thread, the Expr objects created on
+/// that thread by ex() and make_expr() (together with their shared_ptr
+/// control blocks, which are co-located with the objects) are bump-allocated
+/// from the arena's memory blocks, rather than individually from the heap.
+/// Deallocating a node only decrements the number of live nodes; the memory
+/// blocks are released all at once when the arena has been destroyed and its
+/// last node has been deallocated. Hence the nodes can safely outlive the
+/// scope and the arena (e.g. the result of a derivation can be returned from
+/// the scope), but any live node keeps all blocks of its arena alive.
+/// @note the arena is meant to be used by one thread at a time (the thread
+///       that opened the scope); nodes created by the tasks of parallel loops
+///       on other threads are allocated from the heap, unless the tasks open
+///       their own scopes. The nodes can be deallocated on any thread.
+class ExprArena {
+  class Storage;
+
+ public:
+  /// the default size of the memory blocks, in bytes
+  static constexpr std::size_t default_block_size = 1 << 20;
+
+  /// @param block_size the size of the memory blocks, in bytes; larger
+  ///        allocations get blocks of their own
+  explicit ExprArena(std::size_t block_size = default_block_size)
+      : storage_(new Storage(block_size)) {}
+
+  ExprArena(const ExprArena &) = delete;
+  ExprArena &operator=(const ExprArena &) = delete;
+
+  /// the memory is released when the last node allocated from this arena is
+  /// deallocated
+  ~ExprArena() { storage_->release(); }
+
+  /// @return the total size of the memory blocks, in bytes
+  std::size_t nbytes() const { return storage_->nbytes; }
+
+  /// Standard-conforming allocator that allocates from an ExprArena
+  /// @tparam T the value type
+  template <typename T>
+  class Allocator {
+   public:
+    using value_type = T;
+
+    explicit Allocator(Storage *storage) noexcept : storage_(storage) {}
+    template <typename U>
+    Allocator(const Allocator<U> &other) noexcept : storage_(other.storage_) {}
+
+    T *allocate(std::size_t n) {
+      return static_cast<T *>(storage_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *, std::size_t) noexcept { storage_->release(); }
+
+    template <typename U>
+    bool operator==(const Allocator<U> &other) const noexcept {
+      return storage_ == other.storage_;
+    }
+    template <typename U>
+    bool operator!=(const Allocator<U> &other) const noexcept {
+      return storage_ != other.storage_;
+    }
+
+   private:
+    template <typename U>
+    friend class Allocator;
+    Storage *storage_;
+  };
+
+  /// @tparam T the value type
+  /// @return an allocator that allocates from this arena
+  template <typename T>
+  Allocator<T> allocator() const noexcept {
+    return Allocator<T>(storage_);
+  }
+
+  /// Makes an ExprArena the current arena of this thread for the lifetime of
+  /// this object. Scopes can be nested, the innermost scope takes precedence.
+  class Scope {
+   public:
+    explicit Scope(ExprArena &arena) : previous_(current_accessor()) {
+      current_accessor() = &arena;
+    }
+    ~Scope() { current_accessor() = previous_; }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    ExprArena *previous_;
+  };
+
+  /// @return the current arena of this thread, or nullptr if there is none
+  static ExprArena *current() { return current_accessor(); }
+
+ private:
+  /// the memory blocks and the number of references to them (the arena
+  /// itself and every allocation)
+  class Storage {
+   public:
+    explicit Storage(std::size_t block_size) : block_size_(block_size) {}
+
+    void *allocate(std::size_t nbytes, std::size_t alignment) {
+      void *ptr = next_;
+      auto space = static_cast<std::size_t>(end_ - next_);
+      if (!std::align(alignment, nbytes, ptr, space)) {
+        const auto size = std::max(block_size_, nbytes + alignment);
+        blocks_.emplace_back(new char[size]);
+        this->nbytes += size;
+        ptr = blocks_.back().get();
+        space = size;
+        end_ = blocks_.back().get() + size;
+        std::align(alignment, nbytes, ptr, space);
+      }
+      next_ = static_cast<char *>(ptr) + nbytes;
+      refcount_.fetch_add(1, std::memory_order_relaxed);
+      return ptr;
+    }
+
+    /// releases a reference; the last reference deletes this object
+    void release() noexcept {
+      if (refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    std::size_t nbytes = 0;
+
+   private:
+    std::size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *next_ = nullptr;
+    char *end_ = nullptr;
+    std::atomic<std::size_t> refcount_ = 1;
+  };
+
+  Storage *storage_;
+
+  static ExprArena *&current_accessor() {
+    static thread_local ExprArena *arena = nullptr;
+    return arena;
+  }
+};
+
+}  // namespace sequant
+
+#endif  // SEQUANT_ARENA_HPP
@@ -3,12 +3,66 @@
 //
 
 #include "expr.hpp"
+#include "algorithm.hpp"
+#include "runtime.hpp"
 #include "tensor_network.hpp"
 #include "tensor.hpp"
 #include "utility.hpp"
 
+#include <array>
+
 namespace sequant {
 
+namespace {
+
+/// @return the hash value of the Product that @p expr is a like term of, i.e.
+/// of @p expr itself, if it is a Product, else of the Product whose only factor
+/// is @p expr
+std::size_t like_term_hash(const ExprPtr &expr) {
+  if (std::dynamic_pointer_cast<Product>(expr)) return expr->hash_value();
+  std::size_t result = 0;
+  hash::combine_hash(result, expr->hash_value());
+  return result;
+}
+
+/// @return true if @p expr1 and @p expr2 are like terms; a non-Product is
+/// treated as a Product whose only factor is the expression itself
+bool like_terms(const ExprPtr &expr1, const ExprPtr &expr2) {
+  const auto product1 = std::dynamic_pointer_cast<Product>(expr1);
+  const auto product2 = std::dynamic_pointer_cast<Product>(expr2);
+  if (product1 && product2)
+    return product1->type_id() == product2->type_id() &&
+           product1->is_like(*product2);
+  else if (product1)
+    return product1->is<Product>() && product1->factors().size() == 1 &&
+           *product1->factor(0) == *expr2;
+  else if (product2)
+    return like_terms(expr2, expr1);
+  else
+    return *expr1 == *expr2;
+}
+
+/// @return @p expr if it is a Product, else the Product whose only factor is
+/// @p expr
+std::shared_ptr<Product> as_product(const ExprPtr &expr) {
+  if (auto product = std::dynamic_pointer_cast<Product>(expr)) return product;
+  return make_expr<Product>(1, ExprPtrList{expr});
+}
+
+/// @return the structural hash of @p expr, if it is a Product or a tensor
+/// (treated as a Product whose only factor is the tensor), else std::nullopt
+/// @sa Product::structural_hash()
+std::optional<Expr::hash_type> structural_hash(const ExprPtr &expr) {
+  if (expr->is<Product>()) return expr->as<Product>().structural_hash();
+  if (std::dynamic_pointer_cast<AbstractTensor>(expr)) {
+    std::array<ExprPtr, 1> factors{expr};
+    return TensorNetwork(factors).structural_hash();
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
 std::logic_error
 Expr::not_implemented(const char* fn) const {
   std::ostringstream oss;
@@ -70,7 +124,19 @@ bool Product::is_commutative() const {
   return result;
 }
 
+std::optional<Expr::hash_type> Product::structural_hash() const {
+  const bool all_tensors =
+      ranges::all_of(factors_, [](const ExprPtr &factor) {
+        return std::dynamic_pointer_cast<AbstractTensor>(factor) != nullptr;
+      });
+  if (!all_tensors) return std::nullopt;
+  return TensorNetwork(factors_).structural_hash();
+}
+
 ExprPtr Product::canonicalize_impl(bool rapid) {
+  // factors are mutated in place, hence must not be shared
+  for (auto &factor : factors_) detach(factor);
+
   // recursively canonicalize subfactors ...
   ranges::for_each(factors_, [this](auto &factor) {
     auto bp = factor->canonicalize();
@@ -232,24 +298,70 @@ ExprPtr Sum::canonicalize_impl(bool multipass) {
 
   if (Logger::get_instance().canonicalize) std::wcout << "Sum::canonicalize_impl: input = " << to_latex_align(shared_from_this()) << std::endl;
 
+  // summands whose structural hashes are unique have no like terms, hence
+  // are set aside after the first pass, and rejoin the rest for the final sort
+  const bool screen = multipass && screen_unique_summands();
+  container::svector<std::optional<hash_type>> structural_hashes;
+  decltype(summands_) unique_summands;
+
   const auto npasses = multipass ? 3 : 1;
   for (auto pass = 0; pass != npasses; ++pass) {
     // recursively canonicalize summands ...
     const auto nsubexpr = ranges::size(*this);
-    for (std::size_t i = 0; i != nsubexpr; ++i) {
+    if (screen && pass == 0) structural_hashes.resize(nsubexpr);
+    auto canonicalize_summand = [this, pass, screen,
+                                 &structural_hashes](std::size_t i) {
+      if (screen && pass == 0)
+        structural_hashes[i] = structural_hash(summands_[i]);
+      detach(summands_[i]);
       auto bp = (pass % 2 == 0) ? summands_[i]->rapid_canonicalize() : summands_[i]->canonicalize();
       if (bp) {
         assert(bp->template is<Constant>());
         summands_[i] = ex<Product>(std::static_pointer_cast<Constant>(bp)->value(), ExprPtrList{summands_[i]});
       }
     };
+    // ... concurrently, unless logging; summands are independent, hence the
+    // result does not depend on the number of threads. The tasks only mutate
+    // the nodes they own (shared nodes are copied on write, see detach()), and
+    // do not compute the hash values, since that would mutate shared nodes
+    if (num_threads() > 1 && nsubexpr > 1 &&
+        !Logger::get_instance().canonicalize) {
+      parallel_for_each(canonicalize_summand, nsubexpr);
+    } else {
+      for (std::size_t i = 0; i != nsubexpr; ++i) canonicalize_summand(i);
+    }
 
     if (Logger::get_instance().canonicalize) std::wcout << "Sum::canonicalize_impl (pass=" << pass << "): after canonicalizing summands = " << to_latex_align(shared_from_this()) << std::endl;
 
-    // ... then resort according to size, then hash values
+    if (screen && pass == 0) {
+      container::map<hash_type, std::size_t> counts;
+      for (const auto &h : structural_hashes)
+        if (h) ++counts[*h];
+      auto summands = std::move(summands_);
+      summands_.clear();
+      summands_.reserve(summands.size());
+      for (std::size_t i = 0; i != nsubexpr; ++i) {
+        const auto &h = structural_hashes[i];
+        (h && counts[*h] == 1 ? unique_summands : summands_)
+            .push_back(std::move(summands[i]));
+      }
+    }
+
+    // ... then reduce like terms (i.e., terms whose factors are identical) ...
+    combine_like_terms();
+    if (pass + 1 == npasses) {
+      for (auto &&summand : unique_summands)
+        summands_.push_back(std::move(summand));
+    }
+
+    if (Logger::get_instance().canonicalize) std::wcout << "Sum::canonicalize_impl (pass=" << pass << "): after reducing summands = " << to_latex_align(shared_from_this()) << std::endl;
+
+    // ... then resort according to size, then hash values; the hash values
+    // are computed first, so that the (possibly parallel) sort only reads them
+    for (auto &&summand : summands_) summand->hash_value();
     using std::begin;
     using std::end;
-    std::stable_sort(begin(summands_), end(summands_), [](const auto &first, const auto &second) {
+    parallel_stable_sort(begin(summands_), end(summands_), [](const auto &first, const auto &second) {
       const auto first_size = ranges::size(*first);
       const auto second_size = ranges::size(*second);
 
@@ -258,51 +370,58 @@ ExprPtr Sum::canonicalize_impl(bool multipass) {
 
     if (Logger::get_instance().canonicalize) std::wcout << "Sum::canonicalize_impl (pass=" << pass << "): after hash-sorting summands = " << to_latex_align(shared_from_this()) << std::endl;
 
-    // ... then reduce terms whose hash values are identical
-    auto first_it = begin(summands_);
-    auto hash_comparer = [](const auto &first, const auto &second) {
-      return first->hash_value() == second->hash_value();
-    };
-    while ((first_it = std::adjacent_find(first_it, end(summands_), hash_comparer)) != end(summands_)) {
-      assert((*first_it)->hash_value() == (*(first_it + 1))->hash_value());
-      // find first element whose hash is not equal to (*first_it)->hash_value()
-      auto plast_it = std::find_if_not(first_it + 1, end(summands_), [first_it](const auto &elem) {
-        return (*first_it)->hash_value() == elem->hash_value();
-      });
-      assert(plast_it - first_it > 1);
-      auto reduce_range = [first_it, this](auto &begin, auto &end) {
-
-        // Converting tensor into a product; TODO: Use separate add_identical function for Tensor
-        if ((*first_it)->template is<Tensor>()){
-          assert((*first_it)->template is<Tensor>());
-          Product tensor_as_Product{};
-          tensor_as_Product.append(1.0,(*first_it)->as<Tensor>());
-          (*first_it) = std::make_shared<Product>(tensor_as_Product);
-        }
-
-        assert((*first_it)->template is<Product>());
-        for (auto it = begin; it != end; ++it) {
-          if (it != first_it) {
-            if ((*it)->template is<Tensor>()){
-              assert((*it)->template is<Tensor>());
-              Product tensor_as_Product{};
-              tensor_as_Product.append(1.0,(*it)->template as<Tensor>());
-              (*it) = std::make_shared<Product>(tensor_as_Product);
-            }
-            assert((*it)->template is<Product>());
-            std::static_pointer_cast<Product>(*first_it)->add_identical(std::static_pointer_cast<Product>(*it));
-          }
-        }
-        this->summands_.erase(first_it + 1, end);
-      };
-      reduce_range(first_it, plast_it);
-    }
+  }
 
-    if (Logger::get_instance().canonicalize) std::wcout << "Sum::canonicalize_impl (pass=" << pass << "): after reducing summands = " << to_latex_align(shared_from_this()) << std::endl;
+  // positions of the summands have changed
+  like_terms_index_.clear();
+  nindexed_ = 0;
 
+  return {};  // side effects are absorbed into summands
+}
+
+void Sum::append_like_term(ExprPtr summand) {
+  assert(!summand->is<Sum>() && !summand->is<Constant>());
+  // index the summands that have not been indexed yet
+  like_terms_index_.reserve(summands_.size() + 1);
+  for (; nindexed_ != summands_.size(); ++nindexed_) {
+    const auto &indexed = summands_[nindexed_];
+    if (!indexed->is<Constant>())
+      like_terms_index_.insert(like_term_hash(indexed), nindexed_);
   }
 
-  return {};  // side effects are absorbed into summands
+  const auto hash = like_term_hash(summand);
+  const auto pos =
+      like_terms_index_.find_if(hash, [this, &summand](std::size_t p) {
+        return like_terms(summands_[p], summand);
+      });
+  if (pos != HashIndex::npos) {
+    // the existing term may be shared (e.g. by the caller that appended it),
+    // hence it is copied on write
+    if (summands_[pos]->is<Product>()) detach(summands_[pos]);
+    auto term = as_product(summands_[pos]);
+    term->add_identical(as_product(summand));
+    summands_[pos] = std::move(term);
+  } else {
+    like_terms_index_.insert(hash, summands_.size());
+    summands_.push_back(std::move(summand));
+    ++nindexed_;
+  }
+}
+
+void Sum::combine_like_terms() {
+  auto summands = std::move(summands_);
+  summands_.clear();
+  summands_.reserve(summands.size());
+  constant_summand_idx_.reset();
+  like_terms_index_.clear();
+  nindexed_ = 0;
+  for (auto &summand : summands) {
+    if (summand->is<Constant>())
+      append(std::move(summand));
+    else
+      append_like_term(std::move(summand));
+  }
+  reset_hash_value();
 }
 
 
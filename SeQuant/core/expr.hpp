@@ -5,6 +5,7 @@
 #ifndef SEQUANT_EXPR_HPP
 #define SEQUANT_EXPR_HPP
 
+#include <algorithm>
 #include <atomic>
 #include <complex>
 #include <iostream>
@@ -17,9 +18,11 @@
 #include <boost/core/demangle.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
+#include "arena.hpp"
 #include "container.hpp"
 #include "expr_fwd.hpp"
 #include "hash.hpp"
+#include "hash_index.hpp"
 #include "latex.hpp"
 #include "meta.hpp"
 #include "utility.hpp"
@@ -27,6 +30,57 @@
 
 namespace sequant {
 
+namespace detail {
+
+/// @brief a lazily computed (memoized) hash value, with the interface of
+/// std::optional<std::size_t>
+///
+/// The readers of an Expr shared by concurrent tasks may compute its hash
+/// value concurrently; they all store the same value, hence it is kept in
+/// atomics. Resetting the value (i.e. mutating the Expr) requires exclusive
+/// access, as usual.
+class memoized_hash {
+ public:
+  using value_type = std::size_t;
+
+  memoized_hash() = default;
+  memoized_hash(const memoized_hash &other) { *this = other; }
+  memoized_hash &operator=(const memoized_hash &other) {
+    if (other)
+      *this = *other;
+    else
+      reset();
+    return *this;
+  }
+
+  /// stores @p value
+  memoized_hash &operator=(value_type value) {
+    value_.store(value, std::memory_order_relaxed);
+    has_value_.store(true, std::memory_order_release);
+    return *this;
+  }
+
+  /// @return true if the value has been stored
+  explicit operator bool() const {
+    return has_value_.load(std::memory_order_acquire);
+  }
+
+  /// @return the stored value
+  /// @pre the value has been stored
+  value_type operator*() const {
+    assert(*this);
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  void reset() { has_value_.store(false, std::memory_order_relaxed); }
+
+ private:
+  std::atomic<value_type> value_ = 0;
+  std::atomic<bool> has_value_ = false;
+};
+
+}  // namespace detail
+
 /// @brief Base expression class
 
 /// Expr represents the interface needed to form expression trees. Classes that
@@ -81,6 +135,11 @@ class Expr : public std::enable_shared_from_this<Expr>, public ranges::view_faca
   /// @note must be overridden in the derived class
   virtual ExprPtr clone() const;
 
+  /// @return a copy of this object that shares the subexpressions with it;
+  /// the default is to use clone(), which is appropriate for atoms
+  /// @sa detach()
+  virtual ExprPtr shallow_clone() const { return clone(); }
+
   /// Canonicalizes @c this and returns the biproduct of canonicalization (e.g. phase)
   /// @return the biproduct of canonicalization, or @c nullptr if no biproduct generated
   virtual ExprPtr canonicalize() {
@@ -436,7 +495,7 @@ class Expr : public std::enable_shared_from_this<Expr>, public ranges::view_faca
     return cursor{};
   }
 
-  mutable std::optional<hash_type> hash_value_;  // not initialized by default
+  mutable detail::memoized_hash hash_value_;  // not initialized by default
   virtual hash_type memoizing_hash() const {
     static const hash_type default_hash_value = 0;
     if (hash_value_)
@@ -498,13 +557,27 @@ class Expr : public std::enable_shared_from_this<Expr>, public ranges::view_faca
   std::logic_error not_implemented(const char* fn) const;
 };  // class Expr
 
+/// make a std::shared_ptr to a new object of type T; the object is allocated
+/// from the current ExprArena of this thread, if any, else from the heap
+/// @tparam T a class derived from Expr
+/// @tparam Args a parameter pack type such that T(std::forward<Args>...) is well-formed
+/// @param args a parameter pack such that T(args...) is well-formed
+template <typename T, typename... Args>
+std::shared_ptr<T> make_expr(Args &&...args) {
+  if (auto *arena = ExprArena::current())
+    return std::allocate_shared<T>(arena->allocator<T>(),
+                                   std::forward<Args>(args)...);
+  return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
 /// make an ExprPtr to a new object of type T
 /// @tparam T a class derived from Expr
 /// @tparam Args a parameter pack type such that T(std::forward<Args>...) is well-formed
 /// @param args a parameter pack such that T(args...) is well-formed
+/// @sa make_expr()
 template<typename T, typename ... Args>
 ExprPtr ex(Args &&... args) {
-  return std::make_shared<T>(std::forward<Args>(args)...);
+  return make_expr<T>(std::forward<Args>(args)...);
 }
 
 // this is needed when using std::make_shared<X>({ExprPtr,ExprPtr}), i.e. must std::make_shared<X>(ExprPtrList{ExprPtr,ExprPtr})
@@ -842,6 +915,8 @@ class Product : public Expr {
                        ranges::end(cloned_factors));
   }
 
+  ExprPtr shallow_clone() const override { return ex<Product>(*this); }
+
   Product deep_copy() const {
     auto cloned_factors =
         factors() | ranges::views::transform([](const ExprPtr &ptr) {
@@ -866,6 +941,29 @@ class Product : public Expr {
     scalar_ += other->scalar_;
   }
 
+  /// @param other a Product
+  /// @return true if @c *this and @p other are like terms, i.e. they differ
+  /// only by the scalar
+  /// @note factors are compared as is, hence only canonicalized Product
+  /// objects are recognized as like terms reliably
+  bool is_like(const Product &other) const {
+    return this->hash_value() == other.hash_value() &&
+           factors().size() == other.factors().size() &&
+           std::equal(factors().begin(), factors().end(),
+                      other.factors().begin(),
+                      [](const ExprPtr &f1, const ExprPtr &f2) {
+                        return *f1 == *f2;
+                      });
+  }
+
+  /// @return the structural hash of the network of the factors (see
+  /// TensorNetwork::structural_hash()), or std::nullopt if some factors are
+  /// not tensors
+  /// @note the structural hash does not depend on the scalar, the order of
+  /// the factors, and the labels of the dummy indices, hence like terms have
+  /// equal structural hashes even if they have not been canonicalized
+  std::optional<hash_type> structural_hash() const;
+
  private:
   std::complex<double> scalar_ = {1.0, 0.0};
   container::svector<ExprPtr, 2> factors_{};
@@ -929,6 +1027,8 @@ class CProduct : public Product {
 
   bool is_commutative() const override { return true; }
 
+  ExprPtr shallow_clone() const override { return ex<CProduct>(*this); }
+
   /// @brief adjoint of a CProduct is a product of adjoints of its factors, with complex-conjugated scalar
   /// @note factors are not reversed since the factors commute
   virtual void adjoint() override;
@@ -947,6 +1047,8 @@ class NCProduct : public Product {
 
   bool is_commutative() const override { return false; }
 
+  ExprPtr shallow_clone() const override { return ex<NCProduct>(*this); }
+
   /// @brief adjoint of a NCProduct is a reserved product of adjoints of its factors, with complex-conjugated scalar
   virtual void adjoint() override;
 
@@ -1015,6 +1117,8 @@ class Sum : public Expr {
             constant_summand_idx_ = summands_.size() - 1;
           }
         }
+      } else if (accumulate_like_terms_) {
+        append_like_term(std::move(summand));
       } else {
         summands_.push_back(std::move(summand));
       }
@@ -1025,6 +1129,52 @@ class Sum : public Expr {
     return *this;
   }
 
+  /// Turns on/off the accumulating mode. In the accumulating mode append()
+  /// combines each summand with its like term (i.e. one that differs only by
+  /// the scalar, see Product::is_like()), if any, hence no redundant terms
+  /// are stored. Like terms are found via a hash table of the summands, hence
+  /// appending is expected O(1).
+  /// @param a if true, turns on the accumulating mode
+  /// @note like terms are combined by adding the scalar of the appended
+  /// summand to the scalar of the existing term, which is converted to a
+  /// Product if needed; summands whose hash values change after they have been
+  /// appended (e.g. by in-place canonicalization) may not be recognized
+  /// until canonicalize() is called
+  /// @note prepend() does not combine like terms
+  /// @return reference to @c *this
+  Sum &accumulate_like_terms(bool a = true) {
+    accumulate_like_terms_ = a;
+    if (!a) {
+      like_terms_index_.clear();
+      nindexed_ = 0;
+    }
+    return *this;
+  }
+
+  /// @return true if in the accumulating mode
+  /// @sa accumulate_like_terms()
+  bool accumulates_like_terms() const { return accumulate_like_terms_; }
+
+  /// Turns on/off screening of the summands by their structural hashes (see
+  /// Product::structural_hash()) in canonicalize(). A summand whose structural
+  /// hash is unique in the Sum has no like terms, hence its (expensive)
+  /// complete canonicalization is skipped and it is only canonicalized by
+  /// rapid_canonicalize(). Its dummy indices may then be labeled differently
+  /// than by complete canonicalization, hence the screening is off by
+  /// default.
+  /// @param s if true, turns on the screening
+  /// @warning must not be called while canonicalize() is in progress
+  static void set_screen_unique_summands(bool s) {
+    screen_unique_summands_accessor() = s;
+  }
+
+  /// @return true if canonicalize() screens the summands by their structural
+  /// hashes
+  /// @sa set_screen_unique_summands()
+  static bool screen_unique_summands() {
+    return screen_unique_summands_accessor();
+  }
+
   /// prepend a summand to the sum
   /// @param summand the summand
   Sum &prepend(ExprPtr summand) {
@@ -1040,12 +1190,18 @@ class Sum : public Expr {
           if (!summand_constant->is_zero()) {
             summands_.insert(summands_.begin(), std::move(summand));
             constant_summand_idx_ = 0;
+            // positions of the indexed summands changed
+            like_terms_index_.clear();
+            nindexed_ = 0;
           }
         }
       } else {
         summands_.insert(summands_.begin(), std::move(summand));
         if (constant_summand_idx_)  // if have a constant, update its position
           ++*constant_summand_idx_;
+        // positions of the indexed summands changed
+        like_terms_index_.clear();
+        nindexed_ = 0;
       }
       reset_hash_value();
     } else {  // this recursively flattens Sum summands
@@ -1130,6 +1286,8 @@ class Sum : public Expr {
                    ranges::end(cloned_summands));
   }
 
+  ExprPtr shallow_clone() const override { return ex<Sum>(*this); }
+
   /// @brief adjoint of a Sum is a sum of adjoints of its factors
   virtual void adjoint() override;
 
@@ -1152,6 +1310,23 @@ class Sum : public Expr {
   std::optional<size_t>
       constant_summand_idx_{};  // points to the constant summand, if any; used
                                 // to sum up constants in append/prepend
+  bool accumulate_like_terms_ = false;
+  // maps like-term hash values to the positions of summands_[0,nindexed_)
+  HashIndex like_terms_index_;
+  std::size_t nindexed_ = 0;
+
+  /// appends a (non-Sum, non-Constant) summand, combining it with its like
+  /// term, if any
+  void append_like_term(ExprPtr summand);
+
+  /// combines like terms among the summands, keeping the first of each group
+  /// of like terms in place
+  void combine_like_terms();
+
+  static bool &screen_unique_summands_accessor() {
+    static bool screen = false;
+    return screen;
+  }
 
   cursor begin_cursor() override {
     return summands_.empty() ? Expr::begin_cursor() : cursor{&summands_[0]};
@@ -1286,6 +1461,60 @@ std::decay_t<Sequence> clone(Sequence &&exprseq) {
   return std::decay_t<Sequence>(ranges::begin(cloned_seq), ranges::end(cloned_seq));
 }
 
+/// @brief prepares an expression for in-place mutation (copy-on-write)
+///
+/// Expressions may share subexpressions (e.g. the Products produced by
+/// expand() share their unexpanded factors), hence a shared subexpression must
+/// not be mutated in place. If @p expr is shared, i.e. is owned also by
+/// another ExprPtr, it is replaced by its shallow copy (see
+/// Expr::shallow_clone()); the subexpressions of the copy are still shared,
+/// hence they must be detached in turn before they are mutated.
+/// @param[in,out] expr an expression
+/// @return reference to @c *expr , which is not shared on return
+inline Expr &detach(ExprPtr &expr) {
+  assert(expr);
+  if (expr.use_count() > 1)
+    expr = expr->shallow_clone();
+  else  // synchronize with the releases by the former owners, if any
+    std::atomic_thread_fence(std::memory_order_acquire);
+  return *expr;
+}
+
+namespace detail {
+
+/// appends {node, owner} for @p expr and each of its subexpressions to @p nodes
+inline void collect_nodes(
+    const ExprPtr &expr, std::size_t owner,
+    container::vector<std::pair<const Expr *, std::size_t>> &nodes) {
+  nodes.emplace_back(expr.get(), owner);
+  for (auto &&subexpr : *expr) collect_nodes(subexpr, owner, nodes);
+}
+
+/// replaces each expression in @p exprs that shares a node with a preceding
+/// expression by its clone, so that the expressions can be mutated
+/// concurrently
+/// @tparam Exprs a random-access range of ExprPtr (e.g. a sequence container,
+///         or an Expr, whose subexpressions are replaced)
+/// @note shared atoms are unshared too, since even reading them may mutate
+///       their lazily-computed caches (e.g. hash values)
+template <typename Exprs>
+void unshare(Exprs &exprs) {
+  const std::size_t nexprs = ranges::size(exprs);
+  container::vector<std::pair<const Expr *, std::size_t>> nodes;
+  for (std::size_t i = 0; i != nexprs; ++i) collect_nodes(exprs[i], i, nodes);
+  std::sort(nodes.begin(), nodes.end());
+  container::set<std::size_t> sharing;  // expressions to be cloned
+  for (std::size_t n = 1; n < nodes.size(); ++n) {
+    // N.B. sorted by owner for the same node, hence the first owner is kept
+    if (nodes[n].first == nodes[n - 1].first &&
+        nodes[n].second != nodes[n - 1].second)
+      sharing.insert(nodes[n].second);
+  }
+  for (auto i : sharing) exprs[i] = exprs[i]->clone();
+}
+
+}  // namespace detail
+
 };  // namespace sequant
 
 #include "expr_operator.hpp"
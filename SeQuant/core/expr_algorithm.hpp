@@ -5,8 +5,44 @@
 #ifndef SEQUANT_EXPR_ALGORITHM_HPP
 #define SEQUANT_EXPR_ALGORITHM_HPP
 
+#include "runtime.hpp"
+
 namespace sequant {
 
+/// @brief saves the global settings of the runtime and of the expression
+/// algorithms (num_threads(), thread_affinity(), deterministic(), the Logger
+/// flags, and Sum::screen_unique_summands()) upon construction and restores
+/// them upon destruction, even if an exception was thrown in between
+/// @warning should only be used to change the settings temporarily (e.g. in
+/// unit testing); must not be destroyed while concurrent work is in progress
+class RuntimeSettingsScope {
+ public:
+  RuntimeSettingsScope()
+      : nthreads_(num_threads()),
+        affinity_(thread_affinity()),
+        deterministic_(deterministic()),
+        logger_(Logger::get_instance()),
+        screen_unique_summands_(Sum::screen_unique_summands()) {}
+  ~RuntimeSettingsScope() {
+    // the thread pool is recreated only if its settings changed
+    if (num_threads() != nthreads_) set_num_threads(nthreads_);
+    if (thread_affinity() != affinity_) set_thread_affinity(affinity_);
+    set_deterministic(deterministic_);
+    Logger::get_instance() = logger_;
+    Sum::set_screen_unique_summands(screen_unique_summands_);
+  }
+
+  RuntimeSettingsScope(const RuntimeSettingsScope &) = delete;
+  RuntimeSettingsScope &operator=(const RuntimeSettingsScope &) = delete;
+
+ private:
+  int nthreads_;
+  ThreadAffinity affinity_;
+  bool deterministic_;
+  Logger logger_;
+  bool screen_unique_summands_;
+};
+
 /// Recursively canonicalizes an Expr and replaces it as needed
 /// @param[in,out] expr expression to be canonicalized; will be replaced if canonicalization is impure
 inline void canonicalize(ExprPtr& expr) {
@@ -16,8 +52,184 @@ inline void canonicalize(ExprPtr& expr) {
   }
 }
 
+/// @brief a lazy view of the expansion of a Product of Sums
+///
+/// The elements are the terms of the expansion of a Product with respect to
+/// its Sum factors, produced one at a time on dereference: each term is the
+/// Product of the non-Sum factors and of one summand of each Sum factor, in
+/// the order of the factors. The terms are ordered lexicographically by the
+/// ordinals of their summands, with the summand of the last Sum factor
+/// varying fastest; this is the order of the terms produced by expand().
+/// Thus the terms can be consumed (e.g. by WickTheorem, canonicalization,
+/// or evaluation) without materializing the whole expansion.
+/// @note the terms share the subexpressions with the Product (see detach())
+/// @note the summands are not expanded further
+class expand_range : public ranges::view_facade<expand_range> {
+ public:
+  using base_type = ranges::view_facade<expand_range>;
+
+  expand_range() = default;
+
+  /// @param product a Product
+  explicit expand_range(ExprPtr product) : product_(std::move(product)) {
+    assert(std::dynamic_pointer_cast<Product>(product_));
+    const auto &factors = product_->as<Product>().factors();
+    for (std::size_t i = 0; i != factors.size(); ++i) {
+      if (factors[i]->is<Sum>()) sum_positions_.push_back(i);
+    }
+  }
+
+  expand_range(const expand_range&) = default;
+  expand_range(expand_range&&) = default;
+  expand_range& operator=(const expand_range&) = default;
+  expand_range& operator=(expand_range&&) = default;
+
+  /// @return the Product
+  ExprPtr product() const { return product_; }
+
+  /// @return true if the Product has Sum factors
+  bool has_sums() const { return !sum_positions_.empty(); }
+
+  /// @return the number of terms, i.e. the product of the numbers of summands
+  /// of the Sum factors
+  std::size_t size() const {
+    std::size_t result = product_ ? 1 : 0;
+    for (auto pos : sum_positions_) result *= sum(pos).summands().size();
+    return result;
+  }
+
+  /// @param ordinal the ordinal of a term, in @c [0,size())
+  /// @return the term
+  ExprPtr operator[](std::size_t ordinal) const {
+    assert(ordinal < size());
+    container::svector<std::size_t> summand_ordinals(sum_positions_.size());
+    for (auto s = sum_positions_.size(); s != 0; --s) {
+      const auto nsummands = sum(sum_positions_[s - 1]).summands().size();
+      summand_ordinals[s - 1] = ordinal % nsummands;
+      ordinal /= nsummands;
+    }
+    return make_term(summand_ordinals);
+  }
+
+ private:
+  ExprPtr product_;
+  // positions of the Sum factors in the Product
+  container::svector<std::size_t> sum_positions_;
+
+  const Sum &sum(std::size_t pos) const {
+    return product_->as<Product>().factor(pos)->as<Sum>();
+  }
+
+  /// @param summand_ordinals the ordinal of the summand of each Sum factor
+  /// @return the term
+  ExprPtr make_term(
+      const container::svector<std::size_t> &summand_ordinals) const {
+    const auto &product = product_->as<Product>();
+    container::svector<ExprPtr> factors(ranges::begin(product.factors()),
+                                        ranges::end(product.factors()));
+    for (std::size_t s = 0; s != summand_ordinals.size(); ++s) {
+      const auto pos = sum_positions_[s];
+      factors[pos] = sum(pos).summand(summand_ordinals[s]);
+    }
+    using std::begin;
+    using std::end;
+    return ex<Product>(product.scalar(), begin(factors), end(factors));
+  }
+
+  friend ranges::range_access;
+
+  /// the cursor type
+  struct cursor {
+   private:
+    const expand_range* rng_ = nullptr;
+    // the ordinal of the current summand of each Sum factor
+    container::svector<std::size_t> summand_ordinals_;
+    bool done_ = true;
+
+   public:
+    cursor() = default;
+    explicit cursor(const expand_range& rng)
+        : rng_(&rng),
+          summand_ordinals_(rng.sum_positions_.size(), 0),
+          done_(rng.size() == 0) {}
+
+    ExprPtr read() const {
+      assert(!done_);
+      return rng_->make_term(summand_ordinals_);
+    }
+
+    bool equal(const cursor& that) const {
+      return done_ == that.done_ &&
+             (done_ || summand_ordinals_ == that.summand_ordinals_);
+    }
+
+    void next() {
+      assert(!done_);
+      // increment the multi-index, the last ordinal varies fastest
+      for (auto s = summand_ordinals_.size(); s != 0; --s) {
+        const auto nsummands =
+            rng_->sum(rng_->sum_positions_[s - 1]).summands().size();
+        if (++summand_ordinals_[s - 1] != nsummands) return;
+        summand_ordinals_[s - 1] = 0;
+      }
+      done_ = true;
+    }
+  };
+  cursor begin_cursor() const { return cursor{*this}; }
+  cursor end_cursor() const { return cursor{}; }
+};
+
 namespace detail {
+
+/// applies @p visitor to each node of @p expr , children first, like
+/// @code expr->visit(visitor); visitor(expr); @endcode
+/// except that the composite nodes are detached (see detach()) before their
+/// children are visited, hence the shared nodes are not mutated
+/// @param[in,out] expr an expression
+/// @param visitor a callable of type void(ExprPtr&)
+template <typename Visitor>
+void visit_detached_nodes(ExprPtr& expr, Visitor& visitor) {
+  if (!expr->is_atom()) {
+    detach(expr);
+    for (auto& subexpr : expr->expr()) visit_detached_nodes(subexpr, visitor);
+  }
+  visitor(expr);
+}
+
+/// applies @p visitor to each node of @p expr , children first, like
+/// @code expr->visit(visitor); visitor(expr); @endcode
+/// @param[in,out] expr an expression
+/// @param visitor a callable of type void(ExprPtr&); it is copied for each
+///        concurrent task
+/// @param parallel if true and @p expr is a Sum, its summands are visited
+///        concurrently; the nodes shared by the summands are copied on write
+///        (see visit_detached_nodes()), and only read otherwise (their hash
+///        values are memoized atomically)
+template <typename Visitor>
+void visit_nodes(ExprPtr& expr, Visitor& visitor, bool parallel) {
+  const std::size_t nsummands = expr->is<Sum>() ? ranges::size(*expr) : 0;
+  if (parallel && num_threads() > 1 && nsummands > 1) {
+    detach(expr);
+    parallel_for_each(
+        [&expr, &visitor](std::size_t i) {
+          auto task_visitor = visitor;
+          visit_detached_nodes((*expr)[i], task_visitor);
+        },
+        nsummands);
+  } else
+    expr->visit(visitor);
+  visitor(expr);
+}
+
 struct expand_visitor {
+  /// if true, the summands of Sums and the terms of large Products of Sums
+  /// are expanded concurrently
+  bool parallel = false;
+
+  /// Products of Sums with at least 2x this many terms are expanded
+  /// concurrently, each task producing this many terms (or more)
+  static constexpr std::size_t parallel_chunk_size = 256;
+
   void operator()(ExprPtr& expr) {
     if (Logger::get_instance().expand) std::wcout << "expand_visitor received " << to_latex(expr) << std::endl;
     // apply expand() iteratively until done
@@ -28,34 +240,43 @@ struct expand_visitor {
     // simplification and canonicalization are to be done by other visitors
   }
 
-  /// expands the first Sum in a Product
-  /// @param[in,out] expr (shared_ptr to ) a Product whose first Sum gets expanded; on return @c expr contains the result
+  /// expands the Sums in a Product
+  /// @param[in,out] expr (shared_ptr to ) a Product whose Sums get expanded; on return @c expr contains the result
+  /// @note the terms share the factors other than the expanded Sums (they are
+  /// copied on write, see detach())
   bool expand_product(ExprPtr& expr) {
-    auto& expr_ref = *expr;
-    std::shared_ptr<Sum> result;
-    const auto nsubexpr = ranges::size(*expr);
-    for(std::size_t i=0; i != nsubexpr; ++i) {
-      if (expr_ref[i]->is<Sum>()) {
-        // make template for expr cloning to avoid cloning the Sum we are about to expand
-        auto scalar = std::static_pointer_cast<Product>(expr)->scalar();
-        auto exprseq_clone_template = container::svector<ExprPtr>(ranges::begin(*expr), ranges::end(*expr));
-        exprseq_clone_template[i].reset();
-        // allocate the result, if not done yet
-        if (!result)
-          result = std::make_shared<Sum>();
-        ExprPtr subexpr_to_expand = expr_ref[i];
-        for(auto& subsubexpr: *subexpr_to_expand) {
-          auto exprseq_clone = clone(exprseq_clone_template); // clone the product factors without the expanded sum
-          exprseq_clone[i] = subsubexpr;  // scavenging summands here
-          using std::begin;
-          using std::end;
-          result->append(ex<Product>(scalar, begin(exprseq_clone), end(exprseq_clone)));
-        }
-        expr = std::static_pointer_cast<Expr>(result); // expanded one Sum, return
-        return true;
-      }
+    expand_range terms(expr);
+    if (!terms.has_sums())
+      return false;
+    auto result = make_expr<Sum>();
+    const auto nterms = terms.size();
+    if (parallel && num_threads() > 1 && nterms >= 2 * parallel_chunk_size) {
+      // split the terms into contiguous ranges, each task produces the terms
+      // of its range in its own buffer; the buffers are gathered in order,
+      // hence the result does not depend on the number of threads
+      const std::size_t max_ntasks = 4 * num_threads();
+      const auto chunk_size = std::max(
+          parallel_chunk_size, (nterms + max_ntasks - 1) / max_ntasks);
+      const auto ntasks = (nterms + chunk_size - 1) / chunk_size;
+      std::vector<container::svector<ExprPtr>> buffers(ntasks);
+      parallel_for_each(
+          [&](std::size_t task) {
+            const auto first = task * chunk_size;
+            const auto last = std::min(nterms, first + chunk_size);
+            buffers[task].reserve(last - first);
+            for (auto t = first; t != last; ++t)
+              buffers[task].push_back(terms[t]);
+          },
+          ntasks);
+      for (auto& buffer : buffers)
+        for (auto& term : buffer)
+          result->append(std::move(term));
+    } else {
+      for (auto&& term : terms)
+        result->append(term);
     }
-    return false;
+    expr = std::static_pointer_cast<Expr>(result);
+    return true;
   }
 
   /// expands a Sum
@@ -70,7 +291,7 @@ struct expand_visitor {
         const auto this_term_expanded = expand_product(expr_ref[i]);
         // if this is the first term that was expanded, create a result and copy all preceeding subexpressions into it
         if (!result && this_term_expanded) {
-          result = std::make_shared<Sum>();
+          result = make_expr<Sum>();
           for(std::size_t j=0; j != i; ++j)
             result->append(expr_ref[j]);
         }
@@ -83,7 +304,7 @@ struct expand_visitor {
       else if (expr_ref[i]->is<Sum>()) {
         // create a result, if not yet created, by copying all preceeding subexpressions into it
         if (!result) {
-          result = std::make_shared<Sum>();
+          result = make_expr<Sum>();
           for(std::size_t j=0; j != i; ++j)
             result->append(expr_ref[j]);
         }
@@ -125,10 +346,15 @@ struct expand_visitor {
 };  // namespace detail
 
 /// Recursively expands products of sums
-inline void expand(ExprPtr& expr) {
-  detail::expand_visitor expander{};
-  expr->visit(expander);
-  expander(expr);
+/// @param[in,out] expr expression to be expanded
+/// @param parallel if true, the summands of a Sum, and the terms of large
+///        products of sums, are expanded concurrently if num_threads() is
+///        greater than 1 (unless logging); this pays off only for large
+///        expressions; the result does not depend on the number of threads
+inline void expand(ExprPtr& expr, bool parallel = false) {
+  parallel = parallel && !Logger::get_instance().expand;
+  detail::expand_visitor expander{parallel};
+  detail::visit_nodes(expr, expander, parallel);
 }
 
 /// @brief a view of the leaves/atoms of an Expr tree
@@ -385,11 +611,14 @@ struct rapid_simplify_visitor {
 /// Simplifies an Expr by applying cheap transformations (e.g. eliminating
 /// trivial math, flattening sums and products, etc.)
 /// @param[in,out] expr expression to be simplified
+/// @param parallel if true, the summands of a Sum are simplified concurrently
+///        if num_threads() is greater than 1 (unless logging); this pays off
+///        only for large expressions
 /// @sa simplify()
-inline void rapid_simplify(ExprPtr& expr) {
+inline void rapid_simplify(ExprPtr& expr, bool parallel = false) {
   detail::rapid_simplify_visitor simplifier{};
-  expr->visit(simplifier);
-  simplifier(expr);
+  detail::visit_nodes(expr, simplifier,
+                      parallel && !Logger::get_instance().simplify);
 }
 
 /// Simplifies an Expr by a combination of expansion, canonicalization, and
@@ -14,12 +14,12 @@ inline ExprPtr operator*(const ExprPtr &left, const ExprPtr &right) {
     return ex<Product>(ExprPtrList{left, right});
   } else if (left_is_product) {
     auto left_product = std::static_pointer_cast<Product>(left);
-    auto result = std::make_shared<Product>(*left_product);
+    auto result = make_expr<Product>(*left_product);
     result->append(1, right);
     return result;
   } else {  // right_is_product
     auto right_product = std::static_pointer_cast<Product>(right);
-    auto result = std::make_shared<Product>(*right_product);
+    auto result = make_expr<Product>(*right_product);
     result->prepend(1, left);
     return result;
   }
@@ -54,12 +54,12 @@ inline ExprPtr operator+(const ExprPtr &left, const ExprPtr &right) {
     return ex<Sum>(ExprPtrList{left, right});
   } else if (left_is_sum) {
     auto left_sum = std::static_pointer_cast<Sum>(left);
-    auto result = std::make_shared<Sum>(*left_sum);
+    auto result = make_expr<Sum>(*left_sum);
     result->append(right);
     return result;
   } else {  // right_is_sum
     auto right_sum = std::static_pointer_cast<Sum>(right);
-    auto result = std::make_shared<Sum>(*right_sum);
+    auto result = make_expr<Sum>(*right_sum);
     result->prepend(left);
     return result;
   }
@@ -75,7 +75,7 @@ inline ExprPtr operator-(const ExprPtr &left, const ExprPtr &right) {
                                : ex<Product>(-1.0, ExprPtrList{right}))});
   } else if (left_is_sum) {
     auto left_sum = std::static_pointer_cast<Sum>(left);
-    auto result = std::make_shared<Sum>(*left_sum);
+    auto result = make_expr<Sum>(*left_sum);
     if (right->is<Constant>())
       result->append(ex<Constant>(-right->as<Constant>().value()));
     else
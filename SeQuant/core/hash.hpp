@@ -103,6 +103,22 @@ inline void combine(std::size_t& seed, T const& v) {
 //  assert(seed == seed_ref);
 }
 
+/// same as combine(seed, v) , given the precomputed hash value of @c v
+/// @param v_hash the hash value of @c v , i.e. @c value(v)
+inline void combine_hash(std::size_t& seed, std::size_t v_hash) {
+  if constexpr (sizeof(std::size_t) == sizeof(boost::uint32_t)) {
+    return boost::hash_detail::hash_combine_impl(
+        reinterpret_cast<boost::uint32_t&>(seed),
+        static_cast<boost::uint32_t>(v_hash));
+  } else if constexpr (sizeof(std::size_t) == sizeof(boost::uint64_t)) {
+    return boost::hash_detail::hash_combine_impl(
+        reinterpret_cast<boost::uint64_t&>(seed),
+        static_cast<boost::uint64_t>(v_hash));
+  } else {
+    seed ^= v_hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+}
+
 template <class It>
 inline std::size_t range(It first, It last) {
 //  const std::size_t seed_ref = boost::hash_range(first, last);
@@ -0,0 +1,110 @@
+#ifndef SEQUANT_HASH_INDEX_HPP
+#define SEQUANT_HASH_INDEX_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace sequant {
+
+/// @brief Open-addressing hash table that maps hash values to positions (e.g.
+/// of the elements of a sequence).
+///
+/// Collisions are resolved by linear probing, and the table is kept at most
+/// half full, hence insertions and lookups take expected constant time.
+/// Several entries can have the same hash value; the entries with a given hash
+/// value are examined by find_if(). Entries can only be removed all at once.
+class HashIndex {
+ public:
+  /// the value returned by find_if() if there is no matching entry
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  /// @return the number of entries
+  std::size_t size() const { return size_; }
+
+  /// @return true if there are no entries
+  bool empty() const { return size_ == 0; }
+
+  /// removes all entries and releases the memory
+  void clear() {
+    slots_ = {};
+    size_ = 0;
+    shift_ = 64;
+  }
+
+  /// prepares the table to hold @p n entries without rehashing
+  void reserve(std::size_t n) {
+    if (2 * n > slots_.size()) rehash(2 * n);
+  }
+
+  /// adds an entry
+  /// @param hash the hash value
+  /// @param pos the position
+  void insert(std::size_t hash, std::size_t pos) {
+    assert(pos != npos);
+    reserve(size_ + 1);
+    place(hash, pos);
+    ++size_;
+  }
+
+  /// @tparam Pred a function type for which @c Pred(std::size_t) is valid and
+  ///         returns a value convertible to @c bool
+  /// @param hash the hash value
+  /// @param pred the predicate to be evaluated for the positions of the
+  ///        entries with hash value @p hash
+  /// @return the position of the first entry with hash value @p hash for which
+  ///         @p pred returns true, or npos if there is none
+  template <typename Pred>
+  std::size_t find_if(std::size_t hash, Pred &&pred) const {
+    if (slots_.empty()) return npos;
+    const auto mask = slots_.size() - 1;
+    for (auto s = home(hash); slots_[s].pos != npos; s = (s + 1) & mask) {
+      if (slots_[s].hash == hash && pred(slots_[s].pos)) return slots_[s].pos;
+    }
+    return npos;
+  }
+
+ private:
+  struct Slot {
+    std::size_t hash = 0;
+    std::size_t pos = npos;  //!< npos if the slot is empty
+  };
+  std::vector<Slot> slots_;  //!< the number of slots is 0 or a power of 2
+  std::size_t size_ = 0;
+  unsigned int shift_ = 64;  //!< 64 - log2(number of slots)
+
+  /// @return the first slot to probe for @p hash
+  std::size_t home(std::size_t hash) const {
+    // Fibonacci hashing uses all bits of the hash value
+    return static_cast<std::size_t>(
+        (static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> shift_);
+  }
+
+  void place(std::size_t hash, std::size_t pos) {
+    const auto mask = slots_.size() - 1;
+    auto s = home(hash);
+    while (slots_[s].pos != npos) s = (s + 1) & mask;
+    slots_[s] = Slot{hash, pos};
+  }
+
+  /// reallocates the table with at least @p nslots slots
+  void rehash(std::size_t nslots) {
+    std::size_t new_size = 8;
+    unsigned int new_shift = 61;
+    while (new_size < nslots) {
+      new_size *= 2;
+      --new_shift;
+    }
+    std::vector<Slot> old_slots(new_size);
+    old_slots.swap(slots_);
+    shift_ = new_shift;
+    for (const auto &slot : old_slots)
+      if (slot.pos != npos) place(slot.hash, slot.pos);
+  }
+};
+
+}  // namespace sequant
+
+#endif  // SEQUANT_HASH_INDEX_HPP
@@ -7,9 +7,11 @@
 
 #include <atomic>
 #include <functional>
+#include <map>
 #include <mutex>
 #include <optional>
 #include <set>
+#include <shared_mutex>
 #include <string>
 
 #include <range/v3/all.hpp>
@@ -17,11 +19,12 @@
 #include "attr.hpp"
 #include "container.hpp"
 #include "hash.hpp"
+#include "interned_string.hpp"
 #include "space.hpp"
 #include "tag.hpp"
 #include "hash.hpp"
 
-// change to 1 to make thread-safe
+// IndexFactory is always thread-safe, this is kept for backward compatibility
 #define SEQUANT_INDEX_THREADSAFE 1
 
 namespace sequant {
@@ -111,10 +114,10 @@ class Index : public Taggable {
         bool symmetric_proto_indices = true)
       : symmetric_proto_indices_(symmetric_proto_indices) {
     if constexpr (!std::is_same_v<std::decay_t<I1>, Index>) {
-      label_ = index;
-      space_ = IndexSpace::instance(label_);
+      label_ = InternedString(index);
+      space_ = IndexSpace::instance(label_.view());
     } else {
-      label_ = index.label();
+      label_ = index.label_;
       space_ = index.space();
     }
     if constexpr (!std::is_same_v<std::decay_t<I2>, Index>) {
@@ -144,11 +147,11 @@ class Index : public Taggable {
       : proto_indices_(std::forward<IndexContainer>(proto_indices)),
         symmetric_proto_indices_(symmetric_proto_indices) {
     if constexpr (!std::is_same_v<std::decay_t<I1>, Index>) {
-      label_ = index;
+      label_ = InternedString(index);
       check_nontmp_label();
-      space_ = IndexSpace::instance(label_);
+      space_ = IndexSpace::instance(label_.view());
     } else {
-      label_ = index.label();
+      label_ = index.label_;
       space_ = index.space();
     }
     canonicalize_proto_indices();
@@ -178,8 +181,9 @@ class Index : public Taggable {
   /// @return a unique temporary index in space @c space
   static Index make_tmp_index(const IndexSpace &space) {
     Index result;
-    result.label_ = IndexSpace::base_key(space) + L'_' +
-                    std::to_wstring(Index::next_tmp_index());
+    result.label_ = InternedString(IndexSpace::base_key(space) + L'_' +
+                                       std::to_wstring(Index::next_tmp_index()),
+                                   InternedString::transient);
     result.space_ = space;
     return result;
   }
@@ -204,8 +208,9 @@ class Index : public Taggable {
                               IndexContainer &&proto_indices,
                               bool symmetric_proto_indices = true) {
     Index result;
-    result.label_ = IndexSpace::base_key(space) + L'_' +
-                    std::to_wstring(Index::next_tmp_index());
+    result.label_ = InternedString(IndexSpace::base_key(space) + L'_' +
+                                       std::to_wstring(Index::next_tmp_index()),
+                                   InternedString::transient);
     result.space_ = space;
     result.proto_indices_ = std::forward<IndexContainer>(proto_indices);
     result.symmetric_proto_indices_ = symmetric_proto_indices;
@@ -223,7 +228,8 @@ class Index : public Taggable {
   static Index make_label_index(const IndexSpace &space,
                                 const std::wstring &subscript_label) {
     Index result;
-    result.label_ = IndexSpace::base_key(space) + L'_' + subscript_label;
+    result.label_ =
+        InternedString(IndexSpace::base_key(space) + L'_' + subscript_label);
     result.space_ = space;
     return result;
   }
@@ -231,18 +237,13 @@ class Index : public Taggable {
   /// @return the label
   /// @warning this does not include the proto index labels, use
   /// Index::full_label() instead
-  std::wstring_view label() const { return label_; }
+  std::wstring_view label() const { return label_.view(); }
   /// @return the full label
   /// @warning this includes the proto index labels (if any), use
   /// Index::label() instead if only want the label
   std::wstring_view full_label() const {
     if (!has_proto_indices()) return label();
-    if (full_label_) return *full_label_;
-    std::wstring result = label_;
-    ranges::for_each(proto_indices_, [&result](const Index &idx) {
-      result += idx.full_label();
-    });
-    full_label_ = result;
+    assert(full_label_);
     return *full_label_;
   }
   /// @return the IndexSpace object
@@ -330,6 +331,24 @@ class Index : public Taggable {
   /// testing)
   static void reset_tmp_index() { tmp_index_accessor() = min_tmp_index() - 1; }
 
+  /// @brief resets the temporary index counter (see reset_tmp_index()) upon
+  /// construction and restores its previous value upon destruction
+  /// @warning should only to be used when reproducibility matters (e.g. unit
+  /// testing)
+  class TmpIndexResetScope {
+   public:
+    TmpIndexResetScope() : saved_(tmp_index_accessor().load()) {
+      reset_tmp_index();
+    }
+    ~TmpIndexResetScope() { tmp_index_accessor() = saved_; }
+
+    TmpIndexResetScope(const TmpIndexResetScope &) = delete;
+    TmpIndexResetScope &operator=(const TmpIndexResetScope &) = delete;
+
+   private:
+    std::size_t saved_;
+  };
+
   /// @brief index replacement
   /// replaces this object with its image in the Index map.
   /// If this object was not found in the map, tries replacing its subindices.
@@ -385,9 +404,6 @@ class Index : public Taggable {
         }
       }
     }
-    if (mutated) {
-      full_label_.reset();
-    }
     return mutated;
   }
 
@@ -429,7 +445,7 @@ class Index : public Taggable {
   };
 
  private:
-  std::wstring label_{};
+  InternedString label_{};  // equality of interned labels is pointer comparison
   IndexSpace space_{};
   container::vector<Index>
       proto_indices_{};  // an unordered set of unique indices on which this
@@ -438,9 +454,10 @@ class Index : public Taggable {
   // proto_indices_ will be ordered
   bool symmetric_proto_indices_ = true;
 
-  mutable std::optional<std::wstring> full_label_;
+  /// label_ followed by the full labels of proto_indices_, if any
+  std::optional<std::wstring> full_label_;
 
-  /// sorts proto_indices_ if symmetric_proto_indices_
+  /// sorts proto_indices_ if symmetric_proto_indices_, and updates full_label_
   inline void canonicalize_proto_indices();
 
   /// @warning disabled if NDEBUG is defined
@@ -449,7 +466,7 @@ class Index : public Taggable {
 
   /// throws std::invalid_argument if label_ is in reserved
   void check_nontmp_label() {
-    const auto index = label_index(label_);
+    const auto index = label_index(label_.view());
     if (index && index > min_tmp_index()) {
       throw std::invalid_argument(
           "Index ctor: label index must be less than the value returned by "
@@ -471,18 +488,25 @@ class Index : public Taggable {
   }
 
   friend class IndexFactory;
-
-  // this ctor is only used by make_tmp_index and IndexFactory and bypasses
-  // check for nontmp index
-  Index(std::wstring_view label, const IndexSpace *space) noexcept
-      : label_(label), space_(*space), proto_indices_() {}
+  friend class TmpIndexNamespace;
+  friend bool operator==(const Index &i1, const Index &i2);
+  friend bool operator<(const Index &i1, const Index &i2);
+  friend std::size_t hash_value(const Index &idx);
+
+  // this ctor is only used by make_tmp_index, IndexFactory, and
+  // TmpIndexNamespace and bypasses
+  // check for nontmp index; the generated labels are not interned
+  Index(std::wstring_view label, const IndexSpace *space)
+      : label_(label, InternedString::transient),
+        space_(*space),
+        proto_indices_() {}
 };
 
 /// @return true if @c index1 is identical to @c index2 , i.e. they belong to
 /// the same space, they have the same label, and the same proto-indices (if
 /// any)
 inline bool operator==(const Index &i1, const Index &i2) {
-  return i1.space() == i2.space() && i1.label() == i2.label() &&
+  return i1.label_ == i2.label_ && i1.space() == i2.space() &&
          i1.proto_indices() == i2.proto_indices();
 }
 
@@ -501,10 +525,10 @@ inline bool operator<(const Index &i1, const Index &i2) {
   const bool have_tags = i1.tag().has_value() && i2.tag().has_value();
   if (!have_tags || i1.tag() == i2.tag()) {
     if (i1.space() == i2.space()) {
-      if (i1.label() == i2.label()) {
+      if (i1.label_ == i2.label_) {
         return i1.proto_indices() < i2.proto_indices();
       } else {
-        return i1.label() < i2.label();
+        return i1.label_ < i2.label_;
       }
     } else {
       return i1.space() < i2.space();
@@ -544,6 +568,14 @@ void Index::check_for_duplicate_proto_indices() {
 void Index::canonicalize_proto_indices() {
   if (symmetric_proto_indices_)
     std::stable_sort(begin(proto_indices_), end(proto_indices_));
+  // computed eagerly, rather than on demand, so that full_label() does not
+  // mutate Index objects shared by concurrent tasks
+  full_label_.reset();
+  if (!proto_indices_.empty()) {
+    std::wstring result(label_.view());
+    for (const auto &idx : proto_indices_) result += idx.full_label();
+    full_label_ = std::move(result);
+  }
 }
 
 class IndexSwapper {
@@ -571,6 +603,7 @@ inline void swap(Index &first, Index &second) {
 }
 
 /// Generates temporary indices
+/// @note make() is reentrant
 class IndexFactory {
  public:
   IndexFactory() = default;
@@ -595,18 +628,8 @@ class IndexFactory {
     Index result;
     bool valid = false;
     do {
-      auto counter_it = counters_.begin();
-      {  // if don't have a counter for this space
-#if SEQUANT_INDEX_THREADSAFE
-        std::scoped_lock lock(mutex_);
-#endif
-        if ((counter_it = counters_.find(space)) == counters_.end()) {
-          counters_[space] = min_index_ - 1;
-          counter_it = counters_.find(space);
-        }
-      }
       result = Index(IndexSpace::base_key(space) + L'_' +
-                         std::to_wstring(++(counter_it->second)),
+                         std::to_wstring(++counter(space)),
                      &space);
       valid = validator_ ? validator_(result) : true;
     } while (!valid);
@@ -625,18 +648,8 @@ class IndexFactory {
     Index result;
     bool valid = false;
     do {
-      auto counter_it = counters_.begin();
-      {  // if don't have a counter for this space
-#if SEQUANT_INDEX_THREADSAFE
-        std::scoped_lock lock(mutex_);
-#endif
-        if ((counter_it = counters_.find(space)) == counters_.end()) {
-          counters_[space] = min_index_ - 1;
-          counter_it = counters_.find(space);
-        }
-      }
       result = Index(Index(IndexSpace::base_key(space) + L'_' +
-                               std::to_wstring(++(counter_it->second)),
+                               std::to_wstring(++counter(space)),
                            &space),
                      idx.proto_indices());
       valid = validator_ ? validator_(result) : true;
@@ -647,27 +660,77 @@ class IndexFactory {
  private:
   std::size_t min_index_ = Index::min_tmp_index();
   std::function<bool(const Index &)> validator_ = {};
-#if SEQUANT_INDEX_THREADSAFE
-  std::mutex mutex_;
+  std::shared_mutex mutex_;  //!< only held exclusively to add a counter
   // boost::container::flat_map needs copyable value, which std::atomic is not,
-  // so must use std::map
+  // so must use std::map (whose elements are also never invalidated)
   std::map<IndexSpace, std::atomic<std::size_t>> counters_;
-#else
-  // until multithreaded skip atomic
-  container::map<IndexSpace, std::size_t> counters_;
-#endif
+
+  /// @return the tmp counter for @p space , created if needed
+  std::atomic<std::size_t> &counter(const IndexSpace &space) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      auto it = counters_.find(space);
+      if (it != counters_.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return counters_.try_emplace(space, min_index_ - 1).first->second;
+  }
+};
+
+/// Generates temporary indices whose labels do not depend on other threads.
+
+/// The labels are generated like those of Index::make_tmp_index() (i.e.
+/// @c IndexSpace::base_key(space) + '_' + temporary counter), but the
+/// counter is local: it starts after the base value (by default, the current
+/// value of the global tmp counter). Hence a computation that creates its
+/// temporary indices in its own namespace produces the same labels regardless
+/// of the temporary indices created concurrently by other threads. The global
+/// tmp counter is advanced past every label generated by a namespace, hence
+/// these do not clash with the temporary indices created later.
+/// @note namespaces with the same base generate the same labels, hence they
+///       should only be used by independent computations (e.g. that produce
+///       different terms of a Sum)
+class TmpIndexNamespace {
+ public:
+  /// creates a namespace whose base is the current value of the global tmp
+  /// counter
+  TmpIndexNamespace() : TmpIndexNamespace(Index::tmp_index_accessor().load()) {}
+
+  /// @param base the base value of the counter, the first generated index will
+  ///        be labeled with @c base+1
+  explicit TmpIndexNamespace(std::size_t base) : base_(base), last_(base) {}
+
+  /// @return the base value of the counter
+  std::size_t base() const { return base_; }
+
+  /// creates a temporary index in space @c space , unique in this namespace
+  /// @param space an IndexSpace object
+  /// @return a temporary index in space @c space
+  Index make(const IndexSpace &space) {
+    const auto ordinal = ++last_;
+    auto &counter = Index::tmp_index_accessor();
+    auto current = counter.load();
+    while (current < ordinal && !counter.compare_exchange_weak(current, ordinal)) {
+    }
+    return Index(IndexSpace::base_key(space) + L'_' + std::to_wstring(ordinal),
+                 &space);
+  }
+
+ private:
+  std::size_t base_;
+  std::size_t last_;
 };
 
 /// @brief hashing function
 
 /// @paramp[in] idx a const reference to an Index object
 /// @return the hash value of the object referred to by idx
-inline auto hash_value(const Index &idx) {
+inline std::size_t hash_value(const Index &idx) {
   const auto &proto_indices = idx.proto_indices();
   using std::begin;
   using std::end;
   auto val = hash::range(begin(proto_indices), end(proto_indices));
-  hash::combine(val, idx.label());
+  hash::combine_hash(val, idx.label_.hash());
   return val;
 }
 
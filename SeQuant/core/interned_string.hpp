@@ -0,0 +1,178 @@
+#ifndef SEQUANT_INTERNED_STRING_HPP
+#define SEQUANT_INTERNED_STRING_HPP
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "hash.hpp"
+
+namespace sequant {
+
+/// @brief Immutable wide string interned in a process-wide table.
+///
+/// Every distinct string is stored once, together with its hash value; an
+/// InternedString is a pointer to the stored string. Hence copying, equality
+/// comparison, and hashing do not touch the characters, and equal labels
+/// (e.g. of Index objects) share memory.
+///
+/// Generated strings that are unlikely to recur (e.g. the labels of temporary
+/// Index objects) can be constructed as transient strings instead: these are
+/// not entered in the table, but reference counted and released with their
+/// last copy. Comparing a transient string to another string compares the
+/// hash values first, then the characters.
+/// @note interned strings are never released
+/// @note construction is reentrant: the table is split into shards, each
+///       guarded by a shared mutex that is held exclusively only to insert new
+///       strings
+class InternedString {
+ public:
+  /// tag type selecting the constructor of transient strings
+  struct transient_t {};
+  /// selects the constructor of transient strings
+  static constexpr transient_t transient{};
+
+  /// constructs an empty string
+  InternedString() : record_(&empty_record()) {}
+
+  /// @param str a string
+  explicit InternedString(std::wstring_view str) : record_(&intern(str)) {}
+
+  /// constructs a transient (i.e. not interned) string
+  /// @param str a string
+  InternedString(std::wstring_view str, transient_t)
+      : record_(new Record(str, /* interned = */ false)) {}
+
+  InternedString(const InternedString &other) noexcept
+      : record_(other.record_) {
+    retain();
+  }
+  /// @note @p other is left unchanged
+  InternedString(InternedString &&other) noexcept : record_(other.record_) {
+    retain();
+  }
+  InternedString &operator=(const InternedString &other) noexcept {
+    if (record_ != other.record_) {
+      other.retain();
+      release();
+      record_ = other.record_;
+    }
+    return *this;
+  }
+  InternedString &operator=(InternedString &&other) noexcept {
+    std::swap(record_, other.record_);
+    return *this;
+  }
+  ~InternedString() { release(); }
+
+  /// @return true if this string is stored in the table, false if transient
+  bool interned() const noexcept { return record_->interned; }
+
+  /// @return the string
+  const std::wstring &str() const noexcept { return record_->str; }
+  /// @return the string
+  std::wstring_view view() const noexcept { return record_->str; }
+  operator std::wstring_view() const noexcept { return view(); }
+
+  /// @return @c hash::value(view()) (precomputed)
+  std::size_t hash() const noexcept { return record_->hash; }
+
+  friend bool operator==(const InternedString &s1,
+                         const InternedString &s2) noexcept {
+    if (s1.record_ == s2.record_) return true;
+    // distinct interned strings differ
+    if (s1.record_->interned && s2.record_->interned) return false;
+    return s1.hash() == s2.hash() && s1.view() == s2.view();
+  }
+  friend bool operator!=(const InternedString &s1,
+                         const InternedString &s2) noexcept {
+    return !(s1 == s2);
+  }
+  /// lexicographic comparison
+  friend bool operator<(const InternedString &s1,
+                        const InternedString &s2) noexcept {
+    return s1.record_ != s2.record_ && s1.view() < s2.view();
+  }
+
+  /// @return the number of interned strings
+  static std::size_t table_size() {
+    std::size_t result = 0;
+    for (auto &shard : shards()) {
+      std::shared_lock<std::shared_mutex> lock(shard.mtx);
+      result += shard.records.size();
+    }
+    return result;
+  }
+
+ private:
+  struct Record {
+    Record(std::wstring_view s, bool interned)
+        : str(s),
+          hash(sequant::hash::value(std::wstring_view(str))),
+          interned(interned) {}
+    const std::wstring str;
+    const std::size_t hash;
+    const bool interned;
+    /// the number of InternedString objects referring to a transient record
+    mutable std::atomic<std::size_t> nrefs = 1;
+  };
+
+  /// the keys refer to Record::str
+  struct Shard {
+    std::shared_mutex mtx;
+    std::unordered_map<std::wstring_view, std::unique_ptr<const Record>>
+        records;
+  };
+
+  static constexpr std::size_t nshards = 64;
+
+  static std::array<Shard, nshards> &shards() {
+    static std::array<Shard, nshards> shards_;
+    return shards_;
+  }
+
+  static const Record &intern(std::wstring_view str) {
+    auto &shard = shards()[std::hash<std::wstring_view>{}(str) % nshards];
+    {
+      std::shared_lock<std::shared_mutex> lock(shard.mtx);
+      auto it = shard.records.find(str);
+      if (it != shard.records.end()) return *it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(shard.mtx);
+    auto it = shard.records.find(str);
+    if (it != shard.records.end()) return *it->second;
+    auto record = std::make_unique<const Record>(str, /* interned = */ true);
+    const auto &result = *record;
+    shard.records.emplace(std::wstring_view(result.str), std::move(record));
+    return result;
+  }
+
+  /// @return the record of the empty string
+  static const Record &empty_record() {
+    static const Record &record = intern(std::wstring_view{});
+    return record;
+  }
+
+  void retain() const noexcept {
+    if (!record_->interned)
+      record_->nrefs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release() noexcept {
+    if (!record_->interned &&
+        record_->nrefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete record_;
+  }
+
+  const Record *record_;
+};
+
+}  // namespace sequant
+
+#endif  // SEQUANT_INTERNED_STRING_HPP
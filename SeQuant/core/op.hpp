@@ -336,7 +336,7 @@ class Operator : public container::svector<Op<S>>, public Expr {
   };
 
   ExprPtr clone() const override {
-    return std::make_shared<Operator>(*this);
+    return make_expr<Operator>(*this);
   }
 
  private:
@@ -634,7 +634,7 @@ class NormalOperator : public Operator<S>, public AbstractTensor {
   };
 
   ExprPtr clone() const override {
-    return std::make_shared<NormalOperator>(*this);
+    return make_expr<NormalOperator>(*this);
   }
 
   virtual void adjoint() override {
@@ -909,6 +909,10 @@ class NormalOperatorSequence : public container::svector<NormalOperator<S>>, pub
     return Expr::get_type_id<NormalOperatorSequence>();
   };
 
+  ExprPtr clone() const override {
+    return make_expr<NormalOperatorSequence>(*this);
+  }
+
  private:
   Vacuum vacuum_ = Vacuum::Invalid;
   /// ensures that all operators use same vacuum, and sets vacuum_
@@ -1043,7 +1047,7 @@ std::tuple<int, std::shared_ptr<NormalOperator<S>>> normalize(const NormalOperat
     }
   }
 
-  return std::make_tuple(phase, std::make_shared<NormalOperator<S>>(std::move(creators), std::move(annihilators), vacuum));
+  return std::make_tuple(phase, make_expr<NormalOperator<S>>(std::move(creators), std::move(annihilators), vacuum));
 }
 
 template <typename T>
@@ -5,14 +5,229 @@
 #ifndef SEQUANT_RUNTIME_HPP
 #define SEQUANT_RUNTIME_HPP
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <thread>
 #include <vector>
-#include <atomic>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace sequant {
 
+/// policies for binding the threads of ThreadPool to processors
+enum class ThreadAffinity {
+  none,    //!< threads are not bound to processors
+  compact  //!< worker thread @c i is bound to processor @c i (modulo the number of processors); only supported on Linux, ignored elsewhere
+};
+
+/// Pool of threads that executes the tasks of parallel_for_each() and
+/// parallel_do().
+///
+/// A parallel loop is submitted to the pool as a job, i.e. an entry of a
+/// single list of jobs shared by all threads. Idle threads claim the tasks of
+/// the most recently submitted job, one at a time, via an atomic counter, and
+/// the submitting thread executes the tasks of its job as well. While waiting
+/// for the tasks of its job that were claimed by other threads to complete,
+/// the submitting thread executes the tasks of the jobs nested in its job
+/// (i.e. submitted by its tasks, directly or indirectly; the most recently
+/// submitted first), and blocks if there are none. Hence parallel loops can
+/// be nested (e.g. a parallel loop in a task of a parallel loop) without
+/// deadlocks, the stack of a thread never grows beyond the nesting depth of
+/// the loops, and the number of threads executing tasks never exceeds the
+/// size of the pool.
+/// @note the pool used by parallel_for_each() and parallel_do() is returned
+///       by thread_pool()
+class ThreadPool {
+ public:
+  /// @param nthreads the number of threads that execute tasks, including the
+  ///        submitting thread (hence @c nthreads-1 worker threads are created)
+  /// @param affinity the policy for binding the worker threads to processors
+  explicit ThreadPool(int nthreads,
+                      ThreadAffinity affinity = ThreadAffinity::none)
+      : nthreads_(nthreads), affinity_(affinity) {
+    if (nthreads < 1)
+      throw std::invalid_argument("ThreadPool(nthreads): invalid nthreads");
+    workers_.reserve(nthreads - 1);
+    for (int thread_id = 1; thread_id != nthreads; ++thread_id)
+      workers_.emplace_back([this, thread_id]() { work(thread_id); });
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// waits for the worker threads to finish
+  /// @pre no jobs are in progress
+  ~ThreadPool() {
+    {
+      std::scoped_lock<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) worker.join();
+  }
+
+  /// @return the number of threads that execute tasks, including the
+  ///         submitting thread
+  int size() const { return nthreads_; }
+
+  /// @return the policy for binding the worker threads to processors
+  ThreadAffinity affinity() const { return affinity_; }
+
+  /// Executes @c lambda(task_id) for every @c task_id in @c [0,ntasks) ;
+  /// @c lambda(t1) will be commenced not after @c lambda(t2) if @c t1<t2 .
+  /// Returns when all tasks have completed.
+  /// @tparam Lambda a function type for which @c Lambda(size_t) is valid
+  /// @param lambda the function object to execute
+  /// @param ntasks the number of tasks
+  /// @throw the first exception thrown by a task (after all tasks have
+  ///        completed)
+  /// @note this is reentrant
+  template <typename Lambda>
+  void for_each(Lambda &&lambda, const size_t ntasks) {
+    if (ntasks == 0) return;
+    auto job = std::make_shared<Job>();
+    job->task = [&lambda](size_t task_id) { lambda(task_id); };
+    job->ntasks = ntasks;
+    job->parent = current_job_;
+    if (nthreads_ == 1 || ntasks == 1) {  // no need to involve other threads
+      while (run_task(*job)) {
+      }
+      if (job->exception) std::rethrow_exception(job->exception);
+      return;
+    }
+    {
+      std::scoped_lock<std::mutex> lock(mtx_);
+      jobs_.push_back(job);
+      // the submitters of the enclosing jobs can help with this job
+      for (auto *outer = job->parent; outer; outer = outer->parent)
+        outer->cv.notify_one();
+    }
+    cv_.notify_all();
+
+    // execute the tasks of this job ...
+    while (run_task(*job)) {
+    }
+    retire(job);
+    // ... then help with the nested jobs until the stolen tasks complete
+    while (job->ncompleted.load() != ntasks) {
+      std::shared_ptr<Job> nested_job;
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        job->cv.wait(lock, [&job, &nested_job, ntasks, this]() {
+          return job->ncompleted.load() == ntasks ||
+                 (nested_job = find_nested_job(*job));
+        });
+      }
+      if (nested_job && !run_task(*nested_job)) retire(nested_job);
+    }
+
+    if (job->exception) std::rethrow_exception(job->exception);
+  }
+
+ private:
+  /// a parallel loop
+  struct Job {
+    std::function<void(size_t)> task;
+    size_t ntasks = 0;
+    std::atomic<size_t> next_task = 0;   //!< the next unclaimed task
+    std::atomic<size_t> ncompleted = 0;  //!< the number of completed tasks
+    std::mutex exception_mtx;
+    std::exception_ptr exception;  //!< the first exception thrown by a task
+    /// the job whose task submitted this job, if any
+    const Job *parent = nullptr;
+    /// the submitting thread waits on this (guarded by ThreadPool::mtx_) for
+    /// the tasks to complete or for the nested jobs
+    mutable std::condition_variable cv;
+  };
+
+  const int nthreads_;
+  const ThreadAffinity affinity_;
+  std::vector<std::thread> workers_;
+  std::mutex mtx_;
+  std::condition_variable cv_;  //!< the worker threads wait on this
+  std::vector<std::shared_ptr<Job>> jobs_;  //!< jobs with unclaimed tasks
+  bool stop_ = false;
+  /// the job whose task is being executed by this thread, if any
+  inline static thread_local const Job *current_job_ = nullptr;
+
+  /// claims and executes the next task of @p job
+  /// @return false if @p job has no unclaimed tasks
+  bool run_task(Job &job) {
+    const auto task_id = job.next_task.fetch_add(1);
+    if (task_id >= job.ntasks) return false;
+    const auto *outer_job = current_job_;
+    current_job_ = &job;
+    try {
+      job.task(task_id);
+    } catch (...) {
+      std::scoped_lock<std::mutex> lock(job.exception_mtx);
+      if (!job.exception) job.exception = std::current_exception();
+    }
+    current_job_ = outer_job;
+    if (job.ncompleted.fetch_add(1) + 1 == job.ntasks) {
+      // wake up the submitting thread
+      std::scoped_lock<std::mutex> lock(mtx_);
+      job.cv.notify_one();
+    }
+    return true;
+  }
+
+  /// @return the most recently submitted job nested in @p job , or nullptr
+  ///         if there are none; mtx_ must be held
+  /// @note the enclosing jobs of the jobs in jobs_ are alive, since their
+  ///       submitters wait for the tasks that submitted the nested jobs
+  std::shared_ptr<Job> find_nested_job(const Job &job) const {
+    for (auto it = jobs_.rbegin(); it != jobs_.rend(); ++it) {
+      for (auto *outer = (*it)->parent; outer; outer = outer->parent)
+        if (outer == &job) return *it;
+    }
+    return nullptr;
+  }
+
+  /// removes @p job (whose tasks have all been claimed) from the job list
+  void retire(const std::shared_ptr<Job> &job) {
+    std::scoped_lock<std::mutex> lock(mtx_);
+    for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+      if (*it == job) {
+        jobs_.erase(it);
+        break;
+      }
+    }
+  }
+
+  void work(int thread_id) {
+#ifdef __linux__
+    if (affinity_ == ThreadAffinity::compact) {
+      const auto nprocs = std::thread::hardware_concurrency();
+      if (nprocs > 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(thread_id % nprocs, &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+      }
+    }
+#endif
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (stop_) return;
+        job = jobs_.back();
+      }
+      if (!run_task(*job)) retire(job);
+    }
+  }
+};
+
 namespace detail {
 inline int& nthreads_accessor() {
   static int nthreads = std::thread::hardware_concurrency() > 0
@@ -20,13 +235,50 @@ inline int& nthreads_accessor() {
                             : 1;
   return nthreads;
 }
+
+inline ThreadAffinity &thread_affinity_accessor() {
+  static ThreadAffinity affinity = ThreadAffinity::none;
+  return affinity;
+}
+
+inline bool &deterministic_accessor() {
+  static bool deterministic = false;
+  return deterministic;
+}
+
+inline std::mutex &thread_pool_mutex() {
+  static std::mutex mtx;
+  return mtx;
+}
+
+/// owns the pool; guarded by thread_pool_mutex()
+inline std::unique_ptr<ThreadPool> &thread_pool_accessor() {
+  static std::unique_ptr<ThreadPool> pool;
+  return pool;
+}
+
+/// publishes the pool owned by thread_pool_accessor(), read without locking
+inline std::atomic<ThreadPool *> &thread_pool_ptr_accessor() {
+  static std::atomic<ThreadPool *> pool = nullptr;
+  return pool;
+}
+
+/// destroys the pool, it will be recreated on demand; thread_pool_mutex()
+/// must be held
+inline void reset_thread_pool() {
+  thread_pool_ptr_accessor().store(nullptr, std::memory_order_release);
+  thread_pool_accessor().reset();
+}
 }  // namespace detail
 
 /// sets the number of threads to use for concurrent work
+/// @warning must not be called while concurrent work is in progress
 inline void set_num_threads(int nt) {
   if (nt < 1)
     throw std::invalid_argument("set_num_threads(nthreads): invalid nthreads");
+  std::scoped_lock<std::mutex> lock(detail::thread_pool_mutex());
   detail::nthreads_accessor() = nt;
+  detail::reset_thread_pool();
 }
 
 /// @return the number of threads to use for concurrent work
@@ -36,54 +288,78 @@ inline int num_threads() {
   return detail::nthreads_accessor();
 }
 
-/// Fires off @c nthreads instances of lambda in parallel, each in its own thread (thus @c nthreads-1 std::thread objects are created),
-/// where @c nthreads is the value returned by get_num_threads() .
+/// sets the policy for binding the threads used for concurrent work to
+/// processors
+/// @warning must not be called while concurrent work is in progress
+inline void set_thread_affinity(ThreadAffinity affinity) {
+  std::scoped_lock<std::mutex> lock(detail::thread_pool_mutex());
+  detail::thread_affinity_accessor() = affinity;
+  detail::reset_thread_pool();
+}
+
+/// @return the policy for binding the threads used for concurrent work to
+/// processors
+/// @sa set_thread_affinity()
+inline ThreadAffinity thread_affinity() {
+  return detail::thread_affinity_accessor();
+}
+
+/// Controls whether the results of concurrent computations are independent of
+/// the number of threads and of the scheduling of tasks. In the deterministic
+/// mode the tasks create temporary indices in their own namespaces (see
+/// TmpIndexNamespace) and their results are merged in the order of tasks
+/// (rather than in the order of completion), hence the same input produces
+/// the same output (term order and labels) in every run. By default the
+/// deterministic mode is off.
+/// @param d if true, turns on the deterministic mode
+/// @warning must not be called while concurrent work is in progress
+inline void set_deterministic(bool d) { detail::deterministic_accessor() = d; }
+
+/// @return true if the deterministic mode is on
+/// @sa set_deterministic()
+inline bool deterministic() { return detail::deterministic_accessor(); }
+
+/// @return the process-wide ThreadPool of num_threads() threads, created on
+/// first use
+inline ThreadPool &thread_pool() {
+  auto &pool_ptr = detail::thread_pool_ptr_accessor();
+  if (auto *pool = pool_ptr.load(std::memory_order_acquire)) return *pool;
+  std::scoped_lock<std::mutex> lock(detail::thread_pool_mutex());
+  auto &pool = detail::thread_pool_accessor();
+  if (!pool) {
+    pool = std::make_unique<ThreadPool>(num_threads(), thread_affinity());
+    pool_ptr.store(pool.get(), std::memory_order_release);
+  }
+  return *pool;
+}
+
+/// Executes @c nthreads instances of lambda using thread_pool(), where
+/// @c nthreads is the value returned by num_threads() .
 /// @tparam Lambda a function type for which @c Lambda(int) is valid
 /// @param lambda the function object to execute, each will be invoked as @c lambda(thread_id) where @c thread_id is an integer in
 ///        @c [0,nthreads) .
-/// @sa get_num_threads()
+/// @note the instances are not guaranteed to execute concurrently (e.g. if
+///       called from a task of another parallel loop), hence they must not
+///       wait for each other
+/// @sa num_threads()
 template <typename Lambda>
 void parallel_do(Lambda&& lambda) {
-  std::vector<std::thread> threads;
-  const auto nthreads = num_threads();
-  for (int thread_id = 0; thread_id != nthreads; ++thread_id) {
-    if (thread_id != nthreads - 1)
-      threads.push_back(std::thread(std::forward<Lambda>(lambda), thread_id));
-    else
-      std::forward<Lambda>(lambda)(thread_id);
-  }  // threads_id
-  for (int thread_id = 0; thread_id < nthreads - 1; ++thread_id)
-    threads[thread_id].join();
+  thread_pool().for_each(
+      [&lambda](size_t thread_id) { lambda(static_cast<int>(thread_id)); },
+      num_threads());
 }
 
 /// Fires off @c ntasks instances of lambda in parallel, with at most @c nthreads instances executing concurrently,
-/// where @c nthreads is the value returned by get_num_threads() .
+/// where @c nthreads is the value returned by num_threads() .
 /// @tparam Lambda a function type for which @c Lambda(int) is valid
 /// @param lambda the function object to execute, each will be invoked as @c lambda(task_id) where @c task_id is an integer in
 ///        @c [0,ntasks) . @c lambda(t1) will be commenced not after @c lambda(t2) if @c t1<t2 .
-/// @node The load is balanced dynamically.
-/// @sa get_num_threads()
+/// @note The load is balanced dynamically. The tasks are executed by
+///       thread_pool(), hence calls can be nested.
+/// @sa num_threads()
 template <typename Lambda>
 void parallel_for_each(Lambda&& lambda, const size_t ntasks) {
-  std::atomic<size_t> work = 0;
-  auto task = [&work, &lambda, ntasks](int thread_id) {
-    size_t task_id = work.fetch_add(1);
-    while(task_id < ntasks) {
-      std::forward<Lambda>(lambda)(task_id);
-      task_id = work.fetch_add(1);
-    }
-  };
-
-  const auto nthreads = num_threads();
-  std::vector<std::thread> threads;
-  for (int thread_id = 0; thread_id != nthreads; ++thread_id) {
-    if (thread_id != nthreads - 1)
-      threads.push_back(std::thread(task, thread_id));
-    else
-      task(thread_id);
-  }  // threads_id
-  for (int thread_id = 0; thread_id < nthreads - 1; ++thread_id)
-    threads[thread_id].join();
+  thread_pool().for_each(std::forward<Lambda>(lambda), ntasks);
 }
 
 }
@@ -0,0 +1,70 @@
+#ifndef SEQUANT_SNAPSHOT_HPP
+#define SEQUANT_SNAPSHOT_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sequant {
+
+/// @brief Read-mostly registry published as immutable snapshots.
+///
+/// Readers access the current snapshot via a single atomic load, without
+/// locking. Writers are serialized by a mutex: each update copies the current
+/// snapshot, modifies the copy, and publishes it atomically. Superseded
+/// snapshots are retained for the lifetime of the registry, hence references
+/// obtained from any snapshot remain valid even if the registry is updated
+/// concurrently. This is suitable for registries that are updated rarely (e.g.
+/// at startup) but read often and from many threads.
+/// @tparam T the (copyable and default-constructible) registry type
+template <typename T>
+class SnapshotRegistry {
+ public:
+  SnapshotRegistry() : current_(publish(std::make_unique<const T>())) {}
+
+  SnapshotRegistry(const SnapshotRegistry &) = delete;
+  SnapshotRegistry &operator=(const SnapshotRegistry &) = delete;
+
+  /// @return the current snapshot
+  /// @note this is reentrant and lock-free
+  const T &snapshot() const { return *current_.load(std::memory_order_acquire); }
+
+  /// updates the registry
+  /// @tparam Updater a function type for which @c Updater(T&) is valid
+  /// @param updater the function that modifies a copy of the current snapshot;
+  ///        if it throws, the registry is not modified
+  /// @note this is reentrant
+  template <typename Updater>
+  void update(Updater &&updater) {
+    std::scoped_lock<std::mutex> lock(mtx_);
+    auto next = std::make_unique<T>(*current_.load(std::memory_order_relaxed));
+    updater(*next);
+    current_.store(publish(std::move(next)), std::memory_order_release);
+  }
+
+  /// makes a previous snapshot current again, i.e. reverts the updates made
+  /// since it was current
+  /// @param snapshot a snapshot of this registry, obtained from snapshot()
+  /// @note this is reentrant
+  void restore(const T &snapshot) {
+    std::scoped_lock<std::mutex> lock(mtx_);
+    current_.store(&snapshot, std::memory_order_release);
+  }
+
+ private:
+  std::mutex mtx_;  //!< serializes writers
+  std::vector<std::unique_ptr<const T>> snapshots_;  //!< all snapshots
+  std::atomic<const T *> current_;
+
+  /// retains @p snapshot
+  /// @return pointer to @p snapshot
+  const T *publish(std::unique_ptr<const T> snapshot) {
+    snapshots_.emplace_back(std::move(snapshot));
+    return snapshots_.back().get();
+  }
+};
+
+}  // namespace sequant
+
+#endif  // SEQUANT_SNAPSHOT_HPP
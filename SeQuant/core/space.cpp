@@ -4,12 +4,70 @@
 
 #include "space.hpp"
 
-sequant::container::map<sequant::IndexSpace::Attr, std::wstring> sequant::IndexSpace::keys_{};
-sequant::container::map<sequant::IndexSpace::Attr, sequant::IndexSpace> sequant::IndexSpace::instances_{};
+#include <sstream>
+
 sequant::IndexSpace sequant::IndexSpace::null_instance_{sequant::IndexSpace::Attr::null()};
 
 namespace sequant {
 
+struct IndexSpace::Registry {
+  container::map<Attr, std::wstring> keys;
+  container::map<Attr, IndexSpace> instances;
+};
+
+SnapshotRegistry<IndexSpace::Registry> &IndexSpace::registry() {
+  static SnapshotRegistry<Registry> registry_;
+  return registry_;
+}
+
+const IndexSpace *IndexSpace::find_instance(Attr attr) {
+  const auto &instances = registry().snapshot().instances;
+  auto it = instances.find(attr);
+  return it != instances.end() ? &it->second : nullptr;
+}
+
+const std::wstring *IndexSpace::find_key(Attr attr) {
+  const auto &keys = registry().snapshot().keys;
+  auto it = keys.find(attr);
+  return it != keys.end() ? &it->second : nullptr;
+}
+
+IndexSpace::Attr IndexSpace::to_attr(std::wstring_view key) {
+  for (const auto &attr_key : registry().snapshot().keys) {
+    if (attr_key.second == key)
+      return attr_key.first;
+  }
+  throw bad_key();
+}
+
+void IndexSpace::register_instance(const std::wstring_view key, Type type,
+                                   QuantumNumbers qn,
+                                   bool throw_if_already_registered) {
+  const auto attr = Attr(type, qn);
+  assert(attr.is_valid());
+  const auto irreducible_key = to_wstring(reduce_key(key));
+  registry().update([&](Registry &registry) {
+    if (registry.instances.find(attr) != registry.instances.end() &&
+        throw_if_already_registered)
+      throw bad_key();
+    registry.keys[attr] = irreducible_key;
+    registry.instances.emplace(std::make_pair(attr, IndexSpace(attr)));
+  });
+}
+
+std::wstring IndexSpace::registry_fingerprint() {
+  std::wostringstream oss;
+  for (const auto &[attr, key] : registry().snapshot().keys)
+    oss << key << L':' << attr.type().to_int32() << L',' << attr.qns().to_int32()
+        << L';';
+  return oss.str();
+}
+
+IndexSpace::RegistryScope::RegistryScope()
+    : saved_(&registry().snapshot()) {}
+
+IndexSpace::RegistryScope::~RegistryScope() { registry().restore(*saved_); }
+
 IndexSpace::Type IndexSpace::frozen_occupied = Type{0b000001};
 IndexSpace::Type IndexSpace::inactive_occupied = Type{0b000010};
 IndexSpace::Type IndexSpace::active_occupied = Type{0b000100};
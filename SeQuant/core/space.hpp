@@ -10,6 +10,7 @@
 
 #include "attr.hpp"
 #include "container.hpp"
+#include "snapshot.hpp"
 
 namespace sequant {
 
@@ -167,9 +168,9 @@ class IndexSpace {
     assert(attr.is_valid());
     if (attr == Attr::null())
       return null_instance();
-    if (!instance_exists(attr))
-      throw bad_attr();
-    return instances_.find(attr)->second;
+    if (auto *space = find_instance(attr))
+      return *space;
+    throw bad_attr();
   }
 
   /// @brief returns the instance of an IndexSpace object
@@ -181,9 +182,9 @@ class IndexSpace {
     assert(attr.is_valid());
     if (attr == Attr::null())
       return null_instance();
-    if (!instance_exists(attr))
-      throw bad_attr();
-    return instances_.find(attr)->second;
+    if (auto *space = find_instance(attr))
+      return *space;
+    throw bad_attr();
   }
 
   /// @brief returns the instance of an IndexSpace object
@@ -194,30 +195,53 @@ class IndexSpace {
       return null_instance();
     const auto attr = to_attr(reduce_key(key));
     assert(attr.is_valid());
-    if (!instance_exists(attr))
-      throw bad_key();
-    return instances_.find(attr)->second;
+    if (auto *space = find_instance(attr))
+      return *space;
+    throw bad_key();
   }
 
   /// @brief returns the instance of an IndexSpace object
   /// @param key string key describing a particular space
+  /// @note this is reentrant; lookups of the registered instances do not
+  ///       lock, and references to the registered instances returned by
+  ///       instance() remain valid
   static void register_instance(const std::wstring_view key,
                                 Type type,
                                 QuantumNumbers qn = nullqns,
-                                bool throw_if_already_registered = true) {
-    const auto attr = Attr(type, qn);
-    assert(attr.is_valid());
-    if (instance_exists(attr) && throw_if_already_registered)
-      throw bad_key();
-    const auto irreducible_key = reduce_key(key);
-    keys_[attr] = to_wstring(irreducible_key);
-    instances_.emplace(std::make_pair(attr, IndexSpace(attr)));
-  }
+                                bool throw_if_already_registered = true);
+
+ private:
+  /// the registered keys and instances, defined in space.cpp
+  struct Registry;
+
+ public:
+  /// @brief Reverts the registry of instances upon destruction, i.e. the
+  /// instances registered during the lifetime of this object are removed.
+  /// References to the removed instances remain valid.
+  /// @warning should only be used when the registered instances do not
+  /// outlive the scope (e.g. in unit testing)
+  class RegistryScope {
+   public:
+    RegistryScope();
+    ~RegistryScope();
+
+    RegistryScope(const RegistryScope &) = delete;
+    RegistryScope &operator=(const RegistryScope &) = delete;
+
+   private:
+    const Registry *saved_;
+  };
 
   static bool instance_exists(std::wstring_view key) noexcept {
     return instance_exists(to_attr(reduce_key(key)));
   }
 
+  /// @return the description of the registered instances (their keys and
+  /// attributes); data that refers to IndexSpace objects by their attributes
+  /// (e.g. the backing store of WickCache) is only valid for the registry
+  /// with the same fingerprint
+  static std::wstring registry_fingerprint();
+
   Attr attr() const noexcept {
     assert(attr_.is_valid());
     return attr_;
@@ -243,9 +267,9 @@ class IndexSpace {
     assert(attr.is_valid());
     if (attr == Attr::null())
       return L"";
-    if (!instance_exists(attr))
-      throw bad_attr();
-    return keys_.find(attr)->second;
+    if (auto *key = find_key(attr))
+      return *key;
+    throw bad_attr();
   }
 
   /// Default ctor creates an invalid space
@@ -286,29 +310,29 @@ class IndexSpace {
     assert(attr_.is_valid());
   }
 
-  static container::map<Attr, std::wstring> keys_;
-  static container::map<Attr, IndexSpace> instances_;
+  static SnapshotRegistry<Registry> &registry();
   static IndexSpace null_instance_;
 
+  /// @return pointer to the registered instance with attribute @p attr , or
+  ///         nullptr if not registered
+  static const IndexSpace *find_instance(Attr attr);
+  /// @return pointer to the key of the registered instance with attribute
+  ///         @p attr , or nullptr if not registered
+  static const std::wstring *find_key(Attr attr);
+
   static std::wstring_view reduce_key(std::wstring_view key) {
     const auto underscore_position = key.find(L'_');
     return key.substr(0, underscore_position);
   }
 
-  static Attr to_attr(std::wstring_view key) {
-    for (const auto &attr_key: keys_) {
-      if (attr_key.second == key)
-        return attr_key.first;
-    }
-    throw bad_key();
-  }
+  static Attr to_attr(std::wstring_view key);
 
   static std::wstring to_wstring(std::wstring_view key) {
     return std::wstring(key.begin(), key.end());
   }
 
   static bool instance_exists(Attr attr) {
-    return instances_.find(attr) != instances_.end();
+    return find_instance(attr) != nullptr;
   }
 
 };
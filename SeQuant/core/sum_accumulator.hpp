@@ -0,0 +1,111 @@
+#ifndef SEQUANT_SUM_ACCUMULATOR_HPP
+#define SEQUANT_SUM_ACCUMULATOR_HPP
+
+#include <cassert>
+#include <complex>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "expr.hpp"
+
+namespace sequant {
+
+/// Accumulates summands of a Sum, combining like terms as they are inserted.
+///
+/// Two Product objects are like terms if they differ only by the scalar
+/// prefactor; Constant summands are combined into a single Constant; other
+/// summands are kept as is. The terms are distributed among shards (by hash
+/// value), each guarded by its own mutex, hence insert() can be called
+/// concurrently with little contention.
+/// @note like terms are detected by comparing factors as is, hence
+///       only canonicalized Product objects are combined reliably
+/// @note the inserted summands are not mutated: a term that is still shared
+///       (e.g. held by the caller) is copied before a like term is combined
+///       into it (see detach())
+class SumAccumulator {
+ public:
+  /// @param nshards the number of shards; should be larger than the number of
+  ///        threads calling insert() concurrently
+  explicit SumAccumulator(size_t nshards = 64) : shards_(nshards) {
+    assert(nshards > 0);
+  }
+
+  SumAccumulator(const SumAccumulator &) = delete;
+  SumAccumulator &operator=(const SumAccumulator &) = delete;
+
+  /// inserts a summand, combining it with a like term, if any
+  /// @param summand the summand; if it is a Sum, its summands are inserted
+  /// @note this is reentrant
+  void insert(ExprPtr summand) {
+    assert(summand);
+    if (summand->is<Sum>()) {
+      for (auto &subsummand : *summand) insert(subsummand);
+    } else if (summand->is<Constant>()) {
+      std::scoped_lock<std::mutex> lock(constant_mtx_);
+      constant_ += summand->as<Constant>().value();
+    } else {
+      const auto hash = summand->hash_value();
+      auto &shard = shards_[hash % shards_.size()];
+      std::scoped_lock<std::mutex> lock(shard.mtx);
+      if (summand->is<Product>()) {
+        auto [it, it_end] = shard.term_idx.equal_range(hash);
+        for (; it != it_end; ++it) {
+          auto &term = shard.terms[it->second];
+          if (term->is<Product>() &&
+              term->as<Product>().is_like(summand->as<Product>())) {
+            detach(term);
+            std::static_pointer_cast<Product>(term)->add_identical(
+                std::static_pointer_cast<Product>(summand));
+            return;
+          }
+        }
+      }
+      shard.term_idx.emplace(hash, shard.terms.size());
+      shard.terms.push_back(std::move(summand));
+    }
+  }
+
+  /// @return the number of (distinct) terms accumulated so far
+  /// @note not reentrant
+  std::size_t size() const {
+    std::size_t result = constant_ == std::complex<double>{0, 0} ? 0 : 1;
+    for (auto &shard : shards_) result += shard.terms.size();
+    return result;
+  }
+
+  /// @return the accumulated result: zero Constant if no nonzero terms were
+  ///         accumulated, the term itself if only 1 nonzero term was
+  ///         accumulated, otherwise the Sum of nonzero terms
+  /// @note not reentrant
+  ExprPtr sum() const {
+    auto result = make_expr<Sum>();
+    result->append(ex<Constant>(constant_));
+    for (auto &shard : shards_) {
+      for (auto &term : shard.terms) {
+        if (term->is<Product>() &&
+            term->as<Product>().scalar() == std::complex<double>{0, 0})
+          continue;
+        result->append(term);
+      }
+    }
+    if (result->empty()) return ex<Constant>(0);
+    if (result->summands().size() == 1) return result->summands()[0];
+    return result;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mtx;
+    std::vector<ExprPtr> terms;
+    std::unordered_multimap<Expr::hash_type, std::size_t> term_idx;
+  };
+  std::vector<Shard> shards_;
+
+  std::mutex constant_mtx_;
+  std::complex<double> constant_ = {0, 0};
+};
+
+}  // namespace sequant
+
+#endif  // SEQUANT_SUM_ACCUMULATOR_HPP
@@ -19,7 +19,7 @@ Tensor::adjoint() {
 }
 
 ExprPtr Tensor::canonicalize() {
-  const auto &canonicalizer = TensorCanonicalizer::instance(label_);
+  const auto &canonicalizer = TensorCanonicalizer::instance(label_.view());
   return canonicalizer->apply(*this);
 }
 
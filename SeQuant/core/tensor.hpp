@@ -99,7 +99,7 @@ class Tensor : public Expr, public AbstractTensor {
                std::forward<IndexContainer>(ket_indices),
                reserved_tag{},
                s, bks, ps) {
-    assert_nonreserved_label(label_);
+    assert_nonreserved_label(label_.view());
   }
 
   /// @tparam I1 any type convertible to Index)
@@ -119,10 +119,10 @@ class Tensor : public Expr, public AbstractTensor {
          ParticleSymmetry ps = ParticleSymmetry::symm)
       : Tensor(label, make_indices(bra_indices), make_indices(ket_indices),
                reserved_tag{}, s, bks, ps) {
-    assert_nonreserved_label(label_);
+    assert_nonreserved_label(label_.view());
   }
 
-  std::wstring_view label() const { return label_; }
+  std::wstring_view label() const { return label_.view(); }
   const auto &bra() const { return bra_; }
   const auto &ket() const { return ket_; }
   /// @return joined view of the bra and ket index ranges
@@ -237,13 +237,13 @@ class Tensor : public Expr, public AbstractTensor {
   }
 
  private:
-  std::wstring label_{};
+  InternedString label_{};
   index_container_type bra_{};
   index_container_type ket_{};
   Symmetry symmetry_ = Symmetry::invalid;
   BraKetSymmetry braket_symmetry_ = BraKetSymmetry::invalid;
   ParticleSymmetry particle_symmetry_ = ParticleSymmetry::invalid;
-  mutable std::optional<hash_type>
+  mutable detail::memoized_hash
       bra_hash_value_;  // memoized byproduct of memoizing_hash()
 
   void validate_symmetries() {
@@ -258,7 +258,7 @@ class Tensor : public Expr, public AbstractTensor {
     auto val = hash::range(begin(bra()), end(bra()));
     bra_hash_value_ = val;
     hash::range(val, begin(ket()), end(ket()));
-    hash::combine(val, label_);
+    hash::combine(val, label_.str());
     hash::combine(val, symmetry_);
     hash_value_ = val;
     return *hash_value_;
@@ -270,7 +270,7 @@ class Tensor : public Expr, public AbstractTensor {
 
   bool static_equal(const Expr &that) const override {
     const auto &that_cast = static_cast<const Tensor &>(that);
-    if (this->label() == that_cast.label() &&
+    if (this->label_ == that_cast.label_ &&
         this->symmetry() == that_cast.symmetry() &&
         this->bra_rank() == that_cast.bra_rank() &&
         this->ket_rank() == that_cast.ket_rank()) {
@@ -287,7 +287,7 @@ class Tensor : public Expr, public AbstractTensor {
   bool static_less_than(const Expr &that) const override {
     const auto &that_cast = static_cast<const Tensor &>(that);
     if (this == &that) return false;
-    if (this->label() == that_cast.label()) {
+    if (this->label_ == that_cast.label_) {
       if (this->bra_rank() == that_cast.bra_rank()) {
         if (this->ket_rank() == that_cast.ket_rank()) {
           //          v1: compare hashes only
@@ -336,7 +336,7 @@ class Tensor : public Expr, public AbstractTensor {
   }
   std::size_t _color() const override final { return 0; }
   bool _is_cnumber() const override final { return true; }
-  std::wstring _label() const override final { return label_; }
+  std::wstring _label() const override final { return label_.str(); }
   std::wstring _to_latex() const override final { return to_latex(); }
   bool _transform_indices(const container::map<Index, Index> &index_map) override final {
     return transform_indices(index_map);
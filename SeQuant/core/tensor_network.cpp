@@ -6,13 +6,42 @@
 #include "bliss.hpp"
 #include "utility.hpp"
 
+#include <boost/iterator/counting_iterator.hpp>
+
+#include <algorithm>
+#include <limits>
+
 namespace sequant {
 
+struct TensorNetwork::GraphBuffers {
+  using protoindex_bundle_t =
+      std::decay_t<decltype(std::declval<const Index &>().proto_indices())>;
+
+  /// for each Edge, the ordinal of its Index among the named indices, or -1
+  container::vector<int> named_ordinals;
+  /// the number of named indices
+  std::size_t num_named_indices = 0;
+  // vertex attributes
+  std::vector<std::wstring> vertex_labels;
+  std::vector<std::size_t> vertex_color;
+  std::vector<VertexType> vertex_type;
+  // the first (core) vertex of each tensor
+  container::vector<std::size_t> tensor_vertex_offset;
+  // unique symmetric protoindex bundles
+  container::set<protoindex_bundle_t> symmetric_protoindex_bundles;
+  // edge ordinals, sorted
+  container::vector<std::size_t> edge_ordinals;
+};
+
+TensorNetwork::GraphBuffers &TensorNetwork::thread_local_graph_buffers() {
+  static thread_local GraphBuffers buffers;
+  return buffers;
+}
+
 ExprPtr TensorNetwork::canonicalize(
     const container::vector<std::wstring> &cardinal_tensor_labels, bool fast,
     const named_indices_t *named_indices_ptr) {
   ExprPtr canon_biproduct = ex<Constant>(1);
-  container::svector<Edge> idx_terminals_sorted;  // to avoid memory allocs
 
   if (Logger::get_instance().canonicalize) {
     std::wcout << "TensorNetwork::canonicalize(" << (fast ? "fast" : "slow")
@@ -83,16 +112,19 @@ ExprPtr TensorNetwork::canonicalize(
   const auto &named_indices =
       named_indices_ptr == nullptr ? this->ext_indices() : *named_indices_ptr;
 
+  // the named indices are only looked up once, afterwards the indices are
+  // referred to by their ordinals in edges_
+  auto &buffers = thread_local_graph_buffers();
+  init_named_ordinals(named_indices, buffers);
+  const auto &named_ordinals = buffers.named_ordinals;
+
   // helpers to filter named ("external" in traditional use case) / anonymous
   // ("internal" in traditional use case)
-  auto is_named_index = [&](const Index &idx) {
-    return named_indices.find(idx) != named_indices.end();
-  };
   auto is_anonymous_index = [&](const Index &idx) {
     return named_indices.find(idx) == named_indices.end();
   };
-  auto namedness = [&](const Index &idx) {
-    return is_named_index(idx) ? 1 : 0;
+  auto is_anonymous_edge = [&named_ordinals](std::size_t edge_ordinal) {
+    return named_ordinals[edge_ordinal] < 0;
   };
 
   // fast and slow canonizations produce index replacements for anonymous
@@ -134,9 +166,12 @@ ExprPtr TensorNetwork::canonicalize(
       return pvector;
     };
 
-    // make the graph
-    auto [graph, vlabels, vcolors, vtypes] = make_bliss_graph(&named_indices);
-    //    graph->write_dot(std::wcout, vlabels);
+    // make the graph; vertex labels are only needed to print it
+    const bool make_labels = Logger::get_instance().canonicalize_dot;
+    auto graph = make_bliss_graph(buffers, make_labels);
+    const auto &vlabels = buffers.vertex_labels;
+    const auto &vcolors = buffers.vertex_color;
+    const auto &vtypes = buffers.vertex_type;
 
     // canonize the graph
     bliss::Stats stats;
@@ -159,14 +194,12 @@ ExprPtr TensorNetwork::canonicalize(
           color2idx;  // maps color to the ordinals of the corresponding
       // indices in edges_ + their canonical ordinals
       // collect colors and anonymous indices sorted by colors
-      size_t idx_cnt = 0;
-      for (auto &&ttpair : edges_) {
+      for (size_t idx_cnt = 0; idx_cnt != edges_.size(); ++idx_cnt) {
         auto color = vcolors[idx_cnt];
         if (colors.find(color) == colors.end()) colors.insert(color);
-        if (is_anonymous_index(ttpair.idx())) {
+        if (is_anonymous_edge(idx_cnt)) {
           color2idx.emplace(color, std::make_pair(idx_cnt, cl[idx_cnt]));
         }
-        ++idx_cnt;
       }
       // for each color sort anonymous indices by canonical order
       container::svector<std::pair<size_t, size_t>>
@@ -192,13 +225,12 @@ ExprPtr TensorNetwork::canonicalize(
           // make a replacement list by generating new indices in canonical
           // order
           for (auto &&p : idx_can) {
-            const auto &idx = (edges_.begin() + p.first)->idx();
+            const auto &idx = edges_[p.first].idx();
             idxrepl.emplace(std::make_pair(idx, idxfac.make(idx)));
           }
         } else if (sz == 1) {  // no need for resorting of colors with 1 index
                                // only, but still need to replace the index
-          const auto edge_it = edges_.begin() + beg->second.first;
-          const auto &idx = edge_it->idx();
+          const auto &idx = edges_[beg->second.first].idx();
           idxrepl.emplace(std::make_pair(idx, idxfac.make(idx)));
         }
         // sz == 0 is possible since some colors in colors refer to tensors
@@ -293,29 +325,30 @@ ExprPtr TensorNetwork::canonicalize(
       // resort edges_ first by index's character (named<anonymous), then by
       // Edge (not by Index's full label) ... this automatically puts named
       // indices first
-      idx_terminals_sorted.resize(edges_.size());
+      auto &edge_ordinals = buffers.edge_ordinals;
+      edge_ordinals.resize(edges_.size());
       std::partial_sort_copy(
-          begin(edges_), end(edges_), begin(idx_terminals_sorted),
-          end(idx_terminals_sorted),
-          [&namedness](const Edge &edge1, const Edge &edge2) {
-            const auto n1 =
-                namedness(edge1.idx());  // 1 -> named, 0 -> anonymous
-            const auto n2 = namedness(edge2.idx());
-            if (n1 == n2)
-              return edge1 < edge2;
+          boost::counting_iterator<std::size_t>(0),
+          boost::counting_iterator<std::size_t>(edges_.size()),
+          begin(edge_ordinals), end(edge_ordinals),
+          [this, &is_anonymous_edge](std::size_t e1, std::size_t e2) {
+            const auto a1 = is_anonymous_edge(e1);
+            const auto a2 = is_anonymous_edge(e2);
+            if (a1 == a2)
+              return edges_[e1] < edges_[e2];
             else
-              return n1 > n2;
+              return a2;  // named edges first
           });
 
       // make index replacement list for anonymous indices only
-      const auto num_named_indices = named_indices.size();
+      const auto num_named_indices =
+          ranges::count_if(named_ordinals, [](int o) { return o >= 0; });
       std::for_each(
-          begin(idx_terminals_sorted) + num_named_indices,
-          end(idx_terminals_sorted),
-          [&idxrepl, &idxfac, &is_anonymous_index](const auto &terminals) {
-            const auto &idx = terminals.idx();
-            assert(is_anonymous_index(
-                idx));  // should only encounter anonymous indices here
+          begin(edge_ordinals) + num_named_indices, end(edge_ordinals),
+          [this, &idxrepl, &idxfac, &is_anonymous_edge](std::size_t e) {
+            const auto &idx = edges_[e].idx();
+            assert(is_anonymous_edge(
+                e));  // should only encounter anonymous indices here
             idxrepl.emplace(std::make_pair(idx, idxfac.make(idx)));
           });
     }
@@ -364,8 +397,10 @@ ExprPtr TensorNetwork::canonicalize(
       if (bp) *canon_biproduct *= *bp;
     }
   }
+  // indices were transformed, hence the edges are stale
   edges_.clear();
   ext_indices_.clear();
+  have_edges_ = false;
 
   assert(canon_biproduct->is<Constant>());
   return (canon_biproduct->as<Constant>().value() == 1.) ? nullptr
@@ -387,14 +422,45 @@ TensorNetwork::make_bliss_graph(
   const auto &named_indices =
       named_indices_ptr == nullptr ? this->ext_indices() : *named_indices_ptr;
 
+  GraphBuffers buffers;
+  init_named_ordinals(named_indices, buffers);
+  auto graph = make_bliss_graph(buffers, /* make_labels = */ true);
+
+  return {graph, std::move(buffers.vertex_labels),
+          std::move(buffers.vertex_color), std::move(buffers.vertex_type)};
+}
+
+void TensorNetwork::init_named_ordinals(const named_indices_t &named_indices,
+                                        GraphBuffers &buffers) const {
+  auto &named_ordinals = buffers.named_ordinals;
+  named_ordinals.resize(edges_.size());
+  buffers.num_named_indices = named_indices.size();
+  size_t idx_cnt = 0;
+  for (const Edge &ttpair : edges_) {
+    const auto named_index_it = named_indices.find(ttpair.idx());
+    named_ordinals[idx_cnt] =
+        named_index_it == named_indices.end()
+            ? -1
+            : static_cast<int>(named_index_it - named_indices.begin());
+    ++idx_cnt;
+  }
+}
+
+std::shared_ptr<bliss::Graph> TensorNetwork::make_bliss_graph(
+    GraphBuffers &buffers, bool make_labels) const {
+  assert(buffers.named_ordinals.size() == edges_.size());
+  const auto &named_ordinals = buffers.named_ordinals;
+  const auto num_named_indices = buffers.num_named_indices;
+
   // results
-  std::shared_ptr<bliss::Graph> graph;
-  std::vector<std::wstring> vertex_labels(
-      edges_.size());  // the size will be updated
-  std::vector<std::size_t> vertex_color(edges_.size(),
-                                        0);  // the size will be updated
-  std::vector<VertexType> vertex_type(
-      edges_.size());  // the size will be updated
+  auto &vertex_labels = buffers.vertex_labels;
+  auto &vertex_color = buffers.vertex_color;
+  auto &vertex_type = buffers.vertex_type;
+  // the sizes will be updated
+  vertex_labels.clear();
+  if (make_labels) vertex_labels.resize(edges_.size());
+  vertex_color.assign(edges_.size(), 0);
+  vertex_type.resize(edges_.size());
 
   // N.B. Colors [0, 2 max rank + named_indices.size()) are reserved:
   // 0 - the bra vertex (for particle 0, if bra is nonsymm, or for the entire
@@ -409,8 +475,8 @@ TensorNetwork::make_bliss_graph(
   // ...
   // N.B. For braket-symmetric tensors the ket vertices use the same indices as
   // the bra vertices
-  auto nonreserved_color = [&named_indices](size_t color) -> bool {
-    return color >= 2 * max_rank + named_indices.size();
+  auto nonreserved_color = [num_named_indices](size_t color) -> bool {
+    return color >= 2 * max_rank + num_named_indices;
   };
 
   // compute # of vertices
@@ -420,25 +486,22 @@ TensorNetwork::make_bliss_graph(
   // first count vertex indices ... the only complication are symmetric
   // protoindex bundles this will keep track of unique symmetric protoindex
   // bundles
-  using protoindex_bundle_t =
-      std::decay_t<decltype(std::declval<const Index &>().proto_indices())>;
-  container::set<protoindex_bundle_t> symmetric_protoindex_bundles;
+  auto &symmetric_protoindex_bundles = buffers.symmetric_protoindex_bundles;
+  symmetric_protoindex_bundles.clear();
   const size_t spbundle_vertex_offset =
       edges_.size();  // where spbundle vertices will start
   ranges::for_each(edges_, [&](const Edge &ttpair) {
     const Index &idx = ttpair.idx();
     ++nv;  // each index is a vertex
-    vertex_labels.at(index_cnt) = idx.to_latex();
+    if (make_labels) vertex_labels.at(index_cnt) = idx.to_latex();
     vertex_type.at(index_cnt) = VertexType::Index;
     // assign color: named indices use reserved colors
-    const auto named_index_it = named_indices.find(idx);
-    if (named_index_it ==
-        named_indices.end()) {  // anonymous index? use Index::color
+    const auto named_index_rank = named_ordinals[index_cnt];
+    if (named_index_rank < 0) {  // anonymous index? use Index::color
       const auto idx_color = idx.color();
       assert(nonreserved_color(idx_color));
       vertex_color.at(index_cnt) = idx_color;
     } else {
-      const auto named_index_rank = named_index_it - named_indices.begin();
       vertex_color.at(index_cnt) = 2 * max_rank + named_index_rank;
     }
     // each symmetric proto index bundle will have a vertex
@@ -451,12 +514,14 @@ TensorNetwork::make_bliss_graph(
         auto graph = symmetric_protoindex_bundles.insert(idx.proto_indices());
         assert(graph.second);
         ++nv;
-        std::wstring spbundle_label = L"{";
-        for (auto &&pi : idx.proto_indices()) {
-          spbundle_label += pi.to_latex();
+        if (make_labels) {
+          std::wstring spbundle_label = L"{";
+          for (auto &&pi : idx.proto_indices()) {
+            spbundle_label += pi.to_latex();
+          }
+          spbundle_label += L"}";
+          vertex_labels.push_back(spbundle_label);
         }
-        spbundle_label += L"}";
-        vertex_labels.push_back(spbundle_label);
         vertex_type.push_back(VertexType::SPBundle);
         const auto idx_proto_indices_color = idx.proto_indices_color();
         assert(nonreserved_color(idx_proto_indices_color));
@@ -470,13 +535,14 @@ TensorNetwork::make_bliss_graph(
   size_t tensor_cnt = 0;
   // this will map to tensor index to the first (core) vertex in its
   // representation
-  container::svector<size_t> tensor_vertex_offset(tensors_.size());
+  auto &tensor_vertex_offset = buffers.tensor_vertex_offset;
+  tensor_vertex_offset.resize(tensors_.size());
   ranges::for_each(tensors_, [&](const auto &t) {
     tensor_vertex_offset.at(tensor_cnt) = nv;
     // each tensor has a core vertex (to be colored by its label)
     ++nv;
     const auto tlabel = label(*t);
-    vertex_labels.emplace_back(tlabel);
+    if (make_labels) vertex_labels.emplace_back(tlabel);
     vertex_type.emplace_back(VertexType::TensorCore);
     const auto t_color = hash::value(tlabel);
     static_assert(sizeof(t_color) == sizeof(unsigned long int));
@@ -489,20 +555,22 @@ TensorNetwork::make_bliss_graph(
     auto &tref = *t;
     if (symmetry(tref) != Symmetry::nonsymm) {
       nv += 3;
-      vertex_labels.push_back(
-          std::wstring(L"bra") + to_wstring(bra_rank(tref)) +
-          ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
+      if (make_labels) {
+        vertex_labels.push_back(
+            std::wstring(L"bra") + to_wstring(bra_rank(tref)) +
+            ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
+        vertex_labels.push_back(
+            std::wstring(L"ket") + to_wstring(ket_rank(tref)) +
+            ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
+        vertex_labels.push_back(
+            std::wstring(L"bk") +
+            ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
+      }
       vertex_type.push_back(VertexType::TensorBra);
       vertex_color.push_back(0);
-      vertex_labels.push_back(
-          std::wstring(L"ket") + to_wstring(ket_rank(tref)) +
-          ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
       vertex_type.push_back(VertexType::TensorKet);
       vertex_color.push_back(
           braket_symmetry(tref) == BraKetSymmetry::symm ? 0 : max_rank);
-      vertex_labels.push_back(
-          std::wstring(L"bk") +
-          ((symmetry(tref) == Symmetry::antisymm) ? L"a" : L"s"));
       vertex_type.push_back(VertexType::TensorBraKet);
       vertex_color.push_back(t_color);
     }
@@ -513,19 +581,21 @@ TensorNetwork::make_bliss_graph(
       assert(rank <= max_rank);
       for (size_t p = 0; p != rank; ++p) {
         nv += 3;
-        auto pstr = to_wstring(p + 1);
-        vertex_labels.push_back(std::wstring(L"bra") + pstr);
+        if (make_labels) {
+          auto pstr = to_wstring(p + 1);
+          vertex_labels.push_back(std::wstring(L"bra") + pstr);
+          vertex_labels.push_back(std::wstring(L"ket") + pstr);
+          vertex_labels.push_back(std::wstring(L"bk") + pstr);
+        }
         vertex_type.push_back(VertexType::TensorBra);
         const bool t_is_particle_symmetric =
             particle_symmetry(tref) == ParticleSymmetry::nonsymm;
         const auto bra_color = t_is_particle_symmetric ? p : 0;
         vertex_color.push_back(bra_color);
-        vertex_labels.push_back(std::wstring(L"ket") + pstr);
         vertex_type.push_back(VertexType::TensorKet);
         vertex_color.push_back(braket_symmetry(tref) == BraKetSymmetry::symm
                                    ? bra_color
                                    : bra_color + max_rank);
-        vertex_labels.push_back(std::wstring(L"bk") + pstr);
         vertex_type.push_back(VertexType::TensorBraKet);
         vertex_color.push_back(t_color);
       }
@@ -534,7 +604,7 @@ TensorNetwork::make_bliss_graph(
   });
 
   // allocate graph
-  graph = std::make_shared<bliss::Graph>(nv);
+  auto graph = std::make_shared<bliss::Graph>(nv);
 
   // add edges
   // - each index's degree <= 2 + # of protoindex terminals
@@ -576,9 +646,9 @@ TensorNetwork::make_bliss_graph(
   ranges::for_each(symmetric_protoindex_bundles, [&graph, this, &spbundle_cnt](
                                                      const auto &bundle) {
     for (auto &&proto_index : bundle) {
-      assert(edges_.find(proto_index.full_label()) != edges_.end());
-      const auto proto_index_vertex =
-          edges_.find(proto_index.full_label()) - edges_.begin();
+      const auto proto_index_edge_it = find_edge(proto_index.full_label());
+      assert(proto_index_edge_it != edges_.end());
+      const auto proto_index_vertex = proto_index_edge_it - edges_.begin();
       graph->add_edge(spbundle_cnt, proto_index_vertex);
     }
     ++spbundle_cnt;
@@ -619,45 +689,223 @@ TensorNetwork::make_bliss_graph(
     ++v_cnt;
   }
 
-  return {graph, vertex_labels, vertex_color, vertex_type};
+  return graph;
 }
 
-void TensorNetwork::init_edges() const {
-  if (have_edges_) return;
+std::size_t TensorNetwork::structural_hash(
+    const named_indices_t *named_indices_ptr) const {
+  init_edges();
+  const auto &named_indices =
+      named_indices_ptr == nullptr ? ext_indices_ : *named_indices_ptr;
 
-  auto idx_insert = [this](const Index &idx, int tensor_idx, int pos) {
-    if (Logger::get_instance().tensor_network) {
-      std::wcout << "TensorNetwork::init_edges: idx=" << to_latex(idx)
-                 << " attached to tensor " << std::abs(tensor_idx) << "'s "
-                 << ((tensor_idx > 0) ? "bra" : "ket") << " at position " << pos
-                 << std::endl;
+  constexpr auto npos = std::numeric_limits<std::size_t>::max();
+  const auto nedges = edges_.size();
+  const auto ntensors = tensors_.size();
+
+  // edge ids in the bra and ket slots of each tensor; the slots of
+  // anti/symmetric tensors are in no particular order
+  struct Slots {
+    container::svector<std::size_t, 4> bra;
+    container::svector<std::size_t, 4> ket;
+  };
+  container::svector<Slots, 8> slots(ntensors);
+  for (std::size_t e = 0; e != nedges; ++e) {
+    const auto &edge = edges_[e];
+    auto attach = [&](int terminal, int pos) {
+      if (terminal == 0) return;
+      const auto t = std::abs(terminal) - 1;
+      auto &side = terminal > 0 ? slots[t].bra : slots[t].ket;
+      if (symmetry(*tensors_[t]) == Symmetry::nonsymm) {
+        if (side.size() <= static_cast<std::size_t>(pos))
+          side.resize(pos + 1, npos);
+        side[pos] = e;
+      } else
+        side.push_back(e);
+    };
+    attach(edge.first(), edge.first_position());
+    attach(edge.second(), edge.second_position());
+  }
+
+  // initial colors
+  container::svector<std::size_t, 32> idx_color(nedges);
+  for (std::size_t e = 0; e != nedges; ++e) {
+    const auto &idx = edges_[e].idx();
+    if (named_indices.find(idx) != named_indices.end()) {
+      idx_color[e] = hash::value(idx.full_label());
+      hash::combine(idx_color[e], true);
+    } else {
+      idx_color[e] = idx.color();
+      hash::combine(idx_color[e], false);
     }
-    decltype(edges_) &indices = this->edges_;
-    auto it = indices.find(idx.full_label());
-    if (it == indices.end()) {
-      indices.emplace(Edge(tensor_idx, &idx, pos));
+  }
+  container::svector<std::size_t, 8> tensor_color(ntensors);
+  for (std::size_t t = 0; t != ntensors; ++t) {
+    const auto &tensor = *tensors_[t];
+    auto &color = tensor_color[t];
+    color = hash::value(label(tensor));
+    hash::combine(color, static_cast<int>(symmetry(tensor)));
+    hash::combine(color, static_cast<int>(braket_symmetry(tensor)));
+    hash::combine(color, static_cast<int>(particle_symmetry(tensor)));
+    hash::combine(color, bra_rank(tensor));
+    hash::combine(color, ket_rank(tensor));
+  }
+
+  auto slot_color = [&](std::size_t e) {
+    return e == npos ? std::size_t(0) : idx_color[e];
+  };
+  // hashes the colors of the indices in slots (first,second) of tensor t,
+  // invariant w.r.t. the permutations of slots allowed by its symmetry
+  container::svector<std::size_t, 8> side_colors;
+  container::svector<std::pair<std::size_t, std::size_t>, 8> column_colors;
+  auto slots_hash = [&](std::size_t t, const auto &first, const auto &second) {
+    const auto &tensor = *tensors_[t];
+    std::size_t result = 0;
+    if (symmetry(tensor) != Symmetry::nonsymm) {
+      for (const auto *side : {&first, &second}) {
+        side_colors.clear();
+        for (auto e : *side) side_colors.push_back(slot_color(e));
+        std::sort(side_colors.begin(), side_colors.end());
+        hash::combine(result, hash::range(side_colors.begin(), side_colors.end()));
+      }
     } else {
-      const_cast<Edge &>(*it).connect_to(tensor_idx, pos);
+      const auto ncolumns = std::max(first.size(), second.size());
+      column_colors.clear();
+      for (std::size_t p = 0; p != ncolumns; ++p)
+        column_colors.emplace_back(
+            p < first.size() ? slot_color(first[p]) : 0,
+            p < second.size() ? slot_color(second[p]) : 0);
+      if (particle_symmetry(tensor) == ParticleSymmetry::symm)
+        std::sort(column_colors.begin(), column_colors.end());
+      for (const auto &[c1, c2] : column_colors) {
+        hash::combine(result, c1);
+        hash::combine(result, c2);
+      }
     }
+    return result;
+  };
+  // the color of slot of tensor t occupied by an index
+  auto attachment_color = [&](int terminal, int pos) {
+    const auto t = std::abs(terminal) - 1;
+    const auto &tensor = *tensors_[t];
+    auto result = tensor_color[t];
+    hash::combine(result, braket_symmetry(tensor) == BraKetSymmetry::symm
+                              ? 0
+                              : (terminal > 0 ? 1 : 2));
+    hash::combine(result, particle_symmetry(tensor) == ParticleSymmetry::symm
+                              ? 0
+                              : pos);
+    return result;
+  };
+
+  // refine the colors; the number of rounds suffices to propagate colors
+  // across chains of all tensors
+  container::svector<std::size_t, 32> idx_color_next(nedges);
+  container::svector<std::size_t, 8> tensor_color_next(ntensors);
+  container::svector<std::size_t, 2> attachment_colors;
+  for (std::size_t round = 0; round != ntensors; ++round) {
+    for (std::size_t t = 0; t != ntensors; ++t) {
+      auto h = slots_hash(t, slots[t].bra, slots[t].ket);
+      if (braket_symmetry(*tensors_[t]) == BraKetSymmetry::symm) {
+        // bra and ket can be swapped
+        auto h_swapped = slots_hash(t, slots[t].ket, slots[t].bra);
+        if (h_swapped < h) std::swap(h, h_swapped);
+        hash::combine(h, h_swapped);
+      }
+      tensor_color_next[t] = tensor_color[t];
+      hash::combine(tensor_color_next[t], h);
+    }
+    for (std::size_t e = 0; e != nedges; ++e) {
+      const auto &edge = edges_[e];
+      attachment_colors.clear();
+      if (edge.first() != 0)
+        attachment_colors.push_back(
+            attachment_color(edge.first(), edge.first_position()));
+      if (edge.second() != 0)
+        attachment_colors.push_back(
+            attachment_color(edge.second(), edge.second_position()));
+      std::sort(attachment_colors.begin(), attachment_colors.end());
+      idx_color_next[e] = idx_color[e];
+      for (auto c : attachment_colors) hash::combine(idx_color_next[e], c);
+    }
+    std::swap(tensor_color, tensor_color_next);
+    std::swap(idx_color, idx_color_next);
+  }
+
+  // the multisets of colors do not depend on the order of tensors and indices
+  std::sort(tensor_color.begin(), tensor_color.end());
+  std::sort(idx_color.begin(), idx_color.end());
+  auto result = hash::range(tensor_color.begin(), tensor_color.end());
+  hash::range(result, idx_color.begin(), idx_color.end());
+  return result;
+}
+
+container::vector<TensorNetwork::Edge>::const_iterator TensorNetwork::find_edge(
+    std::wstring_view full_label) const {
+  init_edges();
+  auto it = std::lower_bound(edges_.begin(), edges_.end(), full_label,
+                             [](const Edge &edge, std::wstring_view label) {
+                               return edge.idx().full_label() < label;
+                             });
+  return (it != edges_.end() && it->idx().full_label() == full_label)
+             ? it
+             : edges_.end();
+}
+
+void TensorNetwork::init_edges() const {
+  if (have_edges_) return;
+
+  // collect the terminals, then sort them by the full label of their Index;
+  // the terminals of each Index become adjacent and are merged into its Edge
+  struct Terminal {
+    const Index *idx;
+    int tensor_idx;
+    int pos;
   };
+  container::svector<Terminal, 32> terminals;
 
   int t_idx = 1;
   for (auto &&t : tensors_) {
     const auto t_is_nonsymm = symmetry(*t) == Symmetry::nonsymm;
-    size_t cnt = 0;
+    int cnt = 0;
     for (const Index &idx : bra(*t)) {
-      idx_insert(idx, t_idx, t_is_nonsymm ? cnt : 0);
+      terminals.push_back({&idx, t_idx, t_is_nonsymm ? cnt : 0});
       ++cnt;
     }
     cnt = 0;
     for (const Index &idx : ket(*t)) {
-      idx_insert(idx, -t_idx, t_is_nonsymm ? cnt : 0);
+      terminals.push_back({&idx, -t_idx, t_is_nonsymm ? cnt : 0});
       ++cnt;
     }
     ++t_idx;
   }
 
+  // N.B. stable sort preserves the order in which each Index's terminals are
+  // attached
+  std::stable_sort(terminals.begin(), terminals.end(),
+                   [](const Terminal &first, const Terminal &second) {
+                     return first.idx->full_label() < second.idx->full_label();
+                   });
+
+  edges_.clear();
+  edges_.reserve(terminals.size());
+  for (const auto &terminal : terminals) {
+    const Index &idx = *terminal.idx;
+    if (Logger::get_instance().tensor_network) {
+      std::wcout << "TensorNetwork::init_edges: idx=" << to_latex(idx)
+                 << " attached to tensor " << std::abs(terminal.tensor_idx)
+                 << "'s " << ((terminal.tensor_idx > 0) ? "bra" : "ket")
+                 << " at position " << terminal.pos << std::endl;
+    }
+    if (edges_.empty() ||
+        edges_.back().idx().full_label() != idx.full_label()) {
+      edges_.emplace_back(terminal.tensor_idx, &idx, terminal.pos);
+    } else {
+      edges_.back().connect_to(terminal.tensor_idx, terminal.pos);
+    }
+  }
+
   // extract external indices
+  ext_indices_.clear();
   for (const auto &terminals : edges_) {
     assert(terminals.size() != 0);
     if (terminals.size() == 1) {  // external?
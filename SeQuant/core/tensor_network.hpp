@@ -163,6 +163,25 @@ class TensorNetwork {
       const named_indices_t* named_indices = nullptr
       );
 
+  /// @brief computes a cheap hash of the structure of the network
+  ///
+  /// The hash is obtained by color refinement (1-dimensional Weisfeiler-Lehman
+  /// algorithm) of the graph of tensors and indices: the colors of named
+  /// indices are seeded by their labels, those of anonymous indices by their
+  /// spaces only, and those of tensors by their labels, ranks, and symmetries.
+  /// Tensors are then recolored by the colors of the indices in their slots
+  /// (up to the permutations of slots allowed by the tensor symmetries), and
+  /// indices by the colors of the slots they occupy.
+  /// Hence the hash does not depend on the order of tensors and on the labels
+  /// of anonymous indices: networks that become identical upon canonicalize()
+  /// have equal structural hashes (the converse does not hold in general).
+  /// @param named_indices specifies the indices that cannot be renamed, i.e.
+  /// their labels are meaningful; default is nullptr, which results in external
+  /// indices treated as named indices
+  /// @return the structural hash
+  std::size_t structural_hash(
+      const named_indices_t* named_indices = nullptr) const;
+
   /// Factorizes tensor network
   /// @return sequence of binary products; each element encodes the tensors to be
   ///         multiplied (values >0 refer to the tensors in tensors(),
@@ -176,23 +195,10 @@ class TensorNetwork {
   // source tensors and indices
   container::svector<AbstractTensorPtr> tensors_;
 
-  struct FullLabelCompare {
-    using is_transparent = void;
-    bool operator()(const Edge &first,
-                    const Edge &second) const {
-      return first.idx().full_label() < second.idx().full_label();
-    }
-    bool operator()(const Edge &first,
-                    const std::wstring_view &second) const {
-      return first.idx().full_label() < second;
-    }
-    bool operator()(const std::wstring_view &first,
-                    const Edge &second) const {
-      return first < second.idx().full_label();
-    }
-  };
-  // Index -> Edge, sorted by full label
-  mutable container::set<Edge, FullLabelCompare> edges_;
+  // Index -> Edge, sorted by full label; the ordinal of an Edge in this
+  // sequence serves as the integer id of its Index (it is also the id of the
+  // Index's vertex in the graph produced by make_bliss_graph())
+  mutable container::vector<Edge> edges_;
   // set to true by init_edges();
   mutable bool have_edges_ = false;
   // ext indices do not connect tensors
@@ -207,6 +213,32 @@ class TensorNetwork {
   /// initializes edges_ and ext_indices_
   void init_edges() const;
 
+  /// scratch buffers used to build the Bliss graph
+  struct GraphBuffers;
+
+  /// @return the scratch buffers of this thread, reused by every
+  /// canonicalize() call made on it
+  static GraphBuffers &thread_local_graph_buffers();
+
+  /// computes, for each Edge in edges_, the ordinal of its Index in
+  /// @p named_indices (or -1 if it is anonymous)
+  /// @param[in] named_indices the set of named indices
+  /// @param[out] buffers the buffers whose @c named_ordinals will hold the
+  ///             result
+  void init_named_ordinals(const named_indices_t &named_indices,
+                           GraphBuffers &buffers) const;
+
+  /// builds the Bliss graph (see the public make_bliss_graph()) using
+  /// integer ids of the indices only
+  /// @param[in,out] buffers scratch buffers, with @c named_ordinals computed
+  ///                by init_named_ordinals(); on output holds the vertex
+  ///                colors, types, and (if @p make_labels is true) labels
+  /// @param[in] make_labels whether to generate vertex labels (these are only
+  ///            needed to print the graph)
+  /// @return the graph
+  std::shared_ptr<bliss::Graph> make_bliss_graph(GraphBuffers &buffers,
+                                                 bool make_labels) const;
+
  public:
   /// accessor for the Edge object sequence
   /// @return const reference to the sequence container of Edge objects, sorted by their Index's full label
@@ -216,6 +248,14 @@ class TensorNetwork {
     return edges_;
   }
 
+  /// locates the Edge of an Index; its ordinal in edges() is the integer id of
+  /// the Index
+  /// @param full_label the full label of an Index
+  /// @return iterator pointing to the Edge of the Index with full label
+  /// @p full_label , or to the end of edges() if there is none
+  container::vector<Edge>::const_iterator find_edge(
+      std::wstring_view full_label) const;
+
   /// @brief Returns a range of external indices, i.e. those indices that do not connect tensors
 
   /// @note The external indices are sorted by *label* (not full label) of the corresponding value (Index)
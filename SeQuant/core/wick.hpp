@@ -5,17 +5,74 @@
 #ifndef SEQUANT_WICK_HPP
 #define SEQUANT_WICK_HPP
 
+#include <array>
 #include <bitset>
-#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 
+#include "bliss.hpp"
 #include "op.hpp"
 #include "ranges.hpp"
 #include "runtime.hpp"
+#include "sum_accumulator.hpp"
 #include "tensor.hpp"
+#include "wick_cache.hpp"
 
 namespace sequant {
 
+namespace detail {
+
+/// bitmask of Op objects, used by the compact Wick kernel
+using opmask_type = std::uint64_t;
+/// the number of bits in opmask_type
+constexpr std::size_t opmask_nbits = 64;
+
+/// @return mask with bit @p i set
+inline opmask_type opmask_bit(std::size_t i) {
+  assert(i < opmask_nbits);
+  return opmask_type(1) << i;
+}
+
+/// @return the number of bits set in @p mask
+inline std::size_t popcount(opmask_type mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(mask);
+#else
+  return std::bitset<opmask_nbits>(mask).count();
+#endif
+}
+
+/// @return the position of the lowest bit set in @p mask
+/// @pre `mask != 0`
+inline std::size_t lowest_bit(opmask_type mask) {
+  assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(mask);
+#else
+  std::size_t result = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    ++result;
+  }
+  return result;
+#endif
+}
+
+}  // namespace detail
+
 /// Applies Wick's theorem to a sequence of normal-ordered operators.
 ///
 /// @tparam S particle statistics
@@ -43,8 +100,9 @@ class WickTheorem {
 
  public:
 
+  /// @note sequences of more than max_input_size NormalOperator objects are
+  ///       rejected by compute()
   explicit WickTheorem(const NormalOperatorSequence<S> &input) : input_(input) {
-    assert(input.size() <= max_input_size);
     assert(input.empty() || input.vacuum() != Vacuum::Invalid);
     assert(input.empty() || input.vacuum() != Vacuum::Invalid);
   }
@@ -71,8 +129,21 @@ class WickTheorem {
   }
   /// Controls whether next call to compute() will assume spin-free or
   /// spin-orbital normal-ordered operators By default compute() assumes
-  /// spin-orbital operators.
-  /// @param sf if true, will complete full contractions only.
+  /// spin-orbital operators. In the spin-free mode every NormalOperator
+  /// represents the sum over spin of the spin-orbital operator (i.e., the
+  /// unitary group generator \f$ E^{p_1 p_2 \dots}_{q_1 q_2 \dots} \f$,
+  /// with creator \f$ p_k \f$ and annihilator \f$ q_k \f$ acting on the
+  /// same particle), Index objects refer to spatial orbitals, and the vacuum
+  /// is closed-shell. Each full contraction is then scaled by \f$ 2^{n_l} \f$
+  /// , where \f$ n_l \f$ is the number of loops formed by the contractions
+  /// and the particle lines. Hence closed-shell expressions are generated
+  /// directly, without spin-tracing the spin-orbital expressions.
+  /// @param sf if true, will assume spin-free operators
+  /// @note spin-free mode is only supported for full contractions of
+  ///       sequences of at most 64 Op objects
+  /// @note in spin-free mode the Op objects in the same NormalOperator are
+  ///       not topologically equivalent, hence use_topology() only accounts
+  ///       for topologically equivalent NormalOperator objects
   WickTheorem &spinfree(bool sf) {
     spinfree_ = sf;
     return *this;
@@ -98,6 +169,70 @@ class WickTheorem {
     return *this;
   }
 
+  /// Controls whether full contractions are computed by enumerating the
+  /// topologically distinct (Hugenholtz) diagrams directly rather than
+  /// contractions one by one. Each diagram produces a single term scaled by
+  /// the number of contractions it represents, hence for long sequences of
+  /// high-rank operators the number of generated terms (and the cost) is
+  /// reduced dramatically. By default contractions are enumerated.
+  /// @param ed if true, will enumerate diagrams
+  /// @return reference to @c *this , for daisy-chaining
+  /// @note diagrams are only enumerated if use_topology() is also enabled and
+  ///       the input contains at most 64 Op objects
+  /// @note when diagrams are enumerated compute(true) returns the number of
+  ///       diagrams, i.e. the number of terms produced by compute()
+  /// @warning currently is only supported if full contractions are requested;
+  ///          compute() throws std::invalid_argument otherwise
+  WickTheorem &enumerate_diagrams(bool ed) {
+    enumerate_diagrams_ = ed;
+    return *this;
+  }
+
+  /// Controls whether the contractions of a single NormalOperatorSequence
+  /// are distributed among threads. If true, every top-level contraction
+  /// (i.e. the first pair of contracted Op objects) seeds an independent task
+  /// that is executed by parallel_for_each(); the tasks are balanced
+  /// dynamically. This is useful when the cost is dominated by a few
+  /// large products. By default the contractions of each product are
+  /// computed by a single thread.
+  /// @param pc if true, will distribute contractions of each product among
+  /// threads
+  /// @return reference to @c *this , for daisy-chaining
+  /// @note the tasks share thread_pool() with the tasks that process the
+  /// summands of a Sum given as input, hence enabling this does not
+  /// oversubscribe the threads
+  WickTheorem &parallelize_contractions(bool pc) {
+    parallelize_contractions_ = pc;
+    return *this;
+  }
+
+  /// Controls whether like terms produced by the summands of a Sum given as
+  /// input are combined as soon as they are produced (via SumAccumulator),
+  /// rather than collected and combined by the subsequent simplification.
+  /// This reduces the memory footprint when the summands produce many like
+  /// terms. By default like terms are not combined.
+  /// @param alt if true, will combine like terms as they are produced
+  /// @return reference to @c *this , for daisy-chaining
+  WickTheorem &accumulate_like_terms(bool alt) {
+    accumulate_like_terms_ = alt;
+    return *this;
+  }
+
+  /// Controls whether the results for NormalOperatorSequence objects are
+  /// memoized in WickCache. Since WickCache is keyed by the label-independent
+  /// description of the problem, the result is reused for any sequence that
+  /// differs only by index labels (and has same constraints), in this or
+  /// (if WickCache has a backing store) subsequent runs.
+  /// By default the cache is not used.
+  /// @param uc if true, will use WickCache
+  /// @return reference to @c *this , for daisy-chaining
+  /// @note operator sequences with indices that have proto indices are not
+  ///       cached
+  WickTheorem &use_cache(bool uc) {
+    use_cache_ = uc;
+    return *this;
+  }
+
   /// Specifies the external indices; by default assume all indices are summed
   /// over
   /// @param ext_inds external (nonsummed) indices
@@ -216,33 +351,172 @@ class WickTheorem {
 
   /// Computes and returns the result
   /// @param count_only if true, will return the total number of terms, as a Constant.
+  ///        If diagrams are enumerated (see enumerate_diagrams() ) this is the
+  ///        number of diagrams, each of which represents one or more
+  ///        contractions, not the number of contractions.
   /// @return the result of applying Wick's theorem; either a Constant, a Product, or a Sum
+  /// @throw std::invalid_argument if enumerate_diagrams(true) was requested
+  ///        together with partial contractions
   ExprPtr compute(const bool count_only = false);
 
+  /// the type of callables that receive the terms of the result, see
+  /// compute_streaming()
+  using term_sink_type = std::function<void(ExprPtr)>;
+
+  /// Computes the result and passes its terms to @p sink one at a time, as
+  /// soon as they are produced, rather than returning the result as a whole.
+  /// If the input is a Product, every term is simplified (i.e. reduced and
+  /// canonicalized) before it is passed to @p sink. Like terms are not
+  /// combined (this can be done by @p sink , e.g. with SumAccumulator),
+  /// hence the memory footprint is determined by @p sink rather than by the
+  /// number of contractions.
+  /// @param sink the callable that receives the (nonzero) terms; invocations
+  ///        of @p sink are serialized, hence it need not be reentrant
+  /// @note WickCache is not used by this function
+  /// @note the order in which the terms are passed to @p sink depends on the
+  ///       scheduling of tasks, even in the deterministic mode (see
+  ///       set_deterministic() ), but the terms themselves do not
+  void compute_streaming(const term_sink_type &sink);
+
   /// Collects compute statistics
+  ///
+  /// The counts of contractions attempted at each recursion level and of the
+  /// contractions pruned by each criterion are only collected if
+  /// Logger::wick_stats is set (checked when compute() starts), since
+  /// they are updated in the innermost loops of the kernels.
+  /// @note statistics of compute() calls on the summands of a Sum (that are
+  ///       processed concurrently) are accumulated
   class Stats {
    public:
-    Stats() : num_attempted_contractions(0), num_useful_contractions(0) {}
-    Stats(const Stats& other) noexcept {
-      num_attempted_contractions.store(other.num_attempted_contractions.load());
-      num_useful_contractions.store(other.num_useful_contractions.load());
-    }
+    /// contractions at recursion levels greater or equal to this are
+    /// accumulated in the last element of
+    /// num_attempted_contractions_per_level
+    static constexpr std::size_t max_nlevels = detail::opmask_nbits / 2;
+
+    Stats() { reset(); }
+    Stats(const Stats& other) noexcept { *this = other; }
     Stats& operator=(const Stats& other) noexcept {
-      num_attempted_contractions.store(other.num_attempted_contractions.load());
-      num_useful_contractions.store(other.num_useful_contractions.load());
+      for_each_counter(other, [](auto &counter, const auto &other_counter) {
+        counter.store(other_counter.load());
+      });
+      peak_result_size.store(other.peak_result_size.load());
       return *this;
     }
 
-    void reset() { num_attempted_contractions = 0; num_useful_contractions = 0; }
+    void reset() {
+      for_each_counter(*this,
+                       [](auto &counter, const auto &) { counter = 0; });
+      peak_result_size = 0;
+    }
 
     Stats& operator+=(const Stats& other) {
-      num_attempted_contractions += other.num_attempted_contractions;
-      num_useful_contractions += other.num_useful_contractions;
+      for_each_counter(other, [](auto &counter, const auto &other_counter) {
+        counter += other_counter.load();
+      });
+      update_peak_result_size(other.peak_result_size.load());
       return *this;
     }
 
+    /// updates peak_result_size with @p size , if it is larger
+    void update_peak_result_size(std::size_t size) {
+      auto peak = peak_result_size.load();
+      while (size > peak &&
+             !peak_result_size.compare_exchange_weak(peak, size)) {
+      }
+    }
+
+    /// invokes @p f and adds the elapsed time to timer @p time_ns
+    template <typename Callable>
+    static void time(std::atomic<std::uint64_t> &time_ns, Callable &&f) {
+      const auto start = std::chrono::steady_clock::now();
+      std::forward<Callable>(f)();
+      time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    }
+
+    /// @return the statistics as a JSON object; times are in seconds
+    std::string to_json() const {
+      std::ostringstream oss;
+      oss << "{\"num_attempted_contractions\": "
+          << num_attempted_contractions.load()
+          << ", \"num_useful_contractions\": "
+          << num_useful_contractions.load()
+          << ", \"num_attempted_contractions_per_level\": [";
+      // skip the trailing zeroes
+      auto nlevels = max_nlevels;
+      while (nlevels > 0 &&
+             num_attempted_contractions_per_level[nlevels - 1].load() == 0)
+        --nlevels;
+      for (std::size_t l = 0; l != nlevels; ++l)
+        oss << (l ? ", " : "")
+            << num_attempted_contractions_per_level[l].load();
+      oss << "], \"num_pruned_can_contract\": "
+          << num_pruned_can_contract.load()
+          << ", \"num_pruned_topology\": " << num_pruned_topology.load()
+          << ", \"num_pruned_connectivity\": "
+          << num_pruned_connectivity.load()
+          << ", \"num_pruned_screening\": " << num_pruned_screening.load()
+          << ", \"peak_result_size\": " << peak_result_size.load();
+      auto seconds = [](const std::atomic<std::uint64_t> &time_ns) {
+        return static_cast<double>(time_ns.load()) * 1e-9;
+      };
+      oss << ", \"time_normalize\": " << seconds(time_normalize_ns)
+          << ", \"time_reduce\": " << seconds(time_reduce_ns)
+          << ", \"time_canonicalize\": " << seconds(time_canonicalize_ns)
+          << ", \"time_rapid_simplify\": " << seconds(time_rapid_simplify_ns)
+          << "}";
+      return oss.str();
+    }
+
     std::atomic<size_t> num_attempted_contractions;
     std::atomic<size_t> num_useful_contractions;
+    /// the number of contractions attempted at each recursion level
+    std::array<std::atomic<size_t>, max_nlevels>
+        num_attempted_contractions_per_level;
+    /// the number of Op pairs skipped because they cannot be contracted
+    std::atomic<size_t> num_pruned_can_contract;
+    /// the number of contractions skipped because they are topologically
+    /// equivalent to other contractions
+    std::atomic<size_t> num_pruned_topology;
+    /// the number of contractions skipped because they violate the
+    /// connectivity constraints
+    std::atomic<size_t> num_pruned_connectivity;
+    /// the number of (partial) contractions whose remaining Op objects
+    /// cannot be contracted fully, see can_contract_fully()
+    std::atomic<size_t> num_pruned_screening;
+    /// the largest number of terms held at once in the result buffer for a
+    /// single sequence of NormalOperator objects (terms streamed to a sink are
+    /// not held)
+    std::atomic<size_t> peak_result_size;
+    /// time spent in normalize(), in nanoseconds
+    std::atomic<std::uint64_t> time_normalize_ns;
+    /// time spent reducing the results, in nanoseconds
+    std::atomic<std::uint64_t> time_reduce_ns;
+    /// time spent canonicalizing the results, in nanoseconds
+    std::atomic<std::uint64_t> time_canonicalize_ns;
+    /// time spent in rapid_simplify(), in nanoseconds
+    std::atomic<std::uint64_t> time_rapid_simplify_ns;
+
+   private:
+    /// applies @p op to every pair {counter of this, counter of @p other},
+    /// except peak_result_size
+    template <typename Callable>
+    void for_each_counter(const Stats &other, Callable &&op) {
+      op(num_attempted_contractions, other.num_attempted_contractions);
+      op(num_useful_contractions, other.num_useful_contractions);
+      for (std::size_t l = 0; l != max_nlevels; ++l)
+        op(num_attempted_contractions_per_level[l],
+           other.num_attempted_contractions_per_level[l]);
+      op(num_pruned_can_contract, other.num_pruned_can_contract);
+      op(num_pruned_topology, other.num_pruned_topology);
+      op(num_pruned_connectivity, other.num_pruned_connectivity);
+      op(num_pruned_screening, other.num_pruned_screening);
+      op(time_normalize_ns, other.time_normalize_ns);
+      op(time_reduce_ns, other.time_reduce_ns);
+      op(time_canonicalize_ns, other.time_canonicalize_ns);
+      op(time_rapid_simplify_ns, other.time_rapid_simplify_ns);
+    }
   };
 
   /// Statistics accessor
@@ -256,9 +530,15 @@ class WickTheorem {
   /// Statistics reset
   void reset_stats() { stats_.reset(); }
 
+  /// removes the topological partitions memoized (for every Product
+  /// structure) by all instances of WickTheorem<S>
+  static void reset_topology_cache() { topology_cache().clear(); }
+
  private:
-  static constexpr size_t max_input_size =
-      32;  // max # of operators in the input sequence
+  /// max # of NormalOperator objects in the input sequence; the connectivity
+  /// of NormalOperator objects is tracked by bitsets of this size, which
+  /// occupy a single word
+  static constexpr size_t max_input_size = detail::opmask_nbits;
 
   // if nonnull, apply wick to the whole expression recursively, else input_ is
   // set this is mutated by compute
@@ -268,7 +548,31 @@ class WickTheorem {
   bool full_contractions_ = true;
   bool spinfree_ = false;
   bool use_topology_ = false;
+  bool enumerate_diagrams_ = false;
+  bool parallelize_contractions_ = false;
+  bool accumulate_like_terms_ = false;
+  bool use_cache_ = false;
   mutable Stats stats_;
+  /// in the deterministic mode (see deterministic()), the base of the
+  /// temporary index namespaces of the current computation; inherited by the
+  /// subtasks
+  std::optional<std::size_t> tmp_index_base_;
+
+  /// in the deterministic mode, fixes the base of the temporary index
+  /// namespaces for the duration of a top-level computation
+  class TmpIndexBaseScope {
+   public:
+    explicit TmpIndexBaseScope(WickTheorem &wick)
+        : wick_(deterministic() && !wick.tmp_index_base_ ? &wick : nullptr) {
+      if (wick_) wick_->tmp_index_base_ = TmpIndexNamespace().base();
+    }
+    ~TmpIndexBaseScope() {
+      if (wick_) wick_->tmp_index_base_.reset();
+    }
+
+   private:
+    WickTheorem *wick_;
+  };
 
   container::set<Index> external_indices_;
   // for each operator specifies the reverse bitmask of target connections
@@ -300,23 +604,177 @@ class WickTheorem {
       return current_size;
   }
 
-  /// Evaluates wick_ theorem for a single NormalOperatorSequence
-  /// @return the result of applying Wick's theorem
-  ExprPtr compute_nopseq(const bool count_only) const {
-    if (spinfree_)
+  /// implements compute_streaming()
+  /// @param sink the callable that receives the terms; unlike that of
+  ///        compute_streaming() it is invoked concurrently by the tasks, hence
+  ///        it must be reentrant (compute_streaming() passes a sink that
+  ///        serializes the invocations of the user's sink)
+  void compute_streaming_impl(const term_sink_type &sink);
+
+  /// topological partitions of a Product, see compute_topology_partitions()
+  struct TopologyPartitions {
+    /// partitions of topologically equivalent NormalOperator objects, in the
+    /// format accepted by set_op_partitions()
+    container::vector<container::vector<size_t>> nop_partitions;
+    /// {ordinal of NormalOperator, bra/ket} of the first NormalOperator whose
+    /// bra or ket includes topologically nonequivalent Index objects, if any
+    std::optional<std::pair<size_t, BraKetPos>> nonequivalent_braket;
+  };
+
+  /// uses the automorphisms of the graph of the Product expr_input_ to
+  /// determine its topologically equivalent NormalOperator and Index objects
+  TopologyPartitions compute_topology_partitions() const;
+
+  /// @return the key describing the structure of @p product , i.e. the key
+  /// is invariant to relabeling of its Index objects, or nullopt if
+  /// @p product cannot be described by a key
+  static std::optional<std::wstring> make_topology_cache_key(
+      const Product &product);
+
+  /// memo cache of TopologyPartitions for each Product structure
+  /// @note all member functions are reentrant
+  class TopologyCache {
+   public:
+    /// the maximum number of entries; inserting into a full cache removes
+    /// all entries first
+    static constexpr std::size_t max_size = 1 << 14;
+
+    std::optional<TopologyPartitions> find(const std::wstring &key) const {
+      std::shared_lock<std::shared_mutex> lock(mtx_);
+      auto it = map_.find(key);
+      if (it != map_.end()) return it->second;
+      return std::nullopt;
+    }
+    void insert(const std::wstring &key, const TopologyPartitions &value) {
+      std::unique_lock<std::shared_mutex> lock(mtx_);
+      if (map_.size() >= max_size) map_.clear();
+      map_.emplace(key, value);
+    }
+    /// @return the number of entries
+    std::size_t size() const {
+      std::shared_lock<std::shared_mutex> lock(mtx_);
+      return map_.size();
+    }
+    /// removes all entries
+    void clear() {
+      std::unique_lock<std::shared_mutex> lock(mtx_);
+      map_.clear();
+    }
+
+   private:
+    mutable std::shared_mutex mtx_;
+    std::unordered_map<std::wstring, TopologyPartitions> map_;
+  };
+
+  /// @return the TopologyCache shared by all instances of WickTheorem<S>
+  static TopologyCache &topology_cache() {
+    static TopologyCache cache;
+    return cache;
+  }
+
+  /// extracts input_ from the Product expr_input_, after screening it and
+  /// (if use_topology_ is true) determining its topological partitions
+  /// @return the prefactor of the NormalOperator objects in expr_input_, or
+  /// nullptr if the Product has been screened out
+  ExprPtr init_input_from_product();
+
+  /// validates input_ and completes the initialization of the state that
+  /// depends on it
+  void init_nopseq() const {
+    if (input_.size() > max_input_size)
+      throw std::invalid_argument(
+          "WickTheorem::compute: input sequence includes more than " +
+          std::to_string(max_input_size) + " NormalOperator objects");
+    if (spinfree_ && !full_contractions_)
+      throw std::logic_error(
+          "WickTheorem::compute: spinfree=true only supported for full "
+          "contractions");
+    if (spinfree_ && input_.opsize() > detail::opmask_nbits)
       throw std::logic_error(
-          "WickTheorem::compute: spinfree=true not yet supported");
+          "WickTheorem::compute: spinfree=true only supported for sequences "
+          "of at most 64 Op objects");
+    if (enumerate_diagrams_ && !full_contractions_)
+      throw std::invalid_argument(
+          "WickTheorem::compute: enumerate_diagrams=true only supported for "
+          "full contractions");
     // process cached op_connections_input_, if needed
     if (!op_connections_input_.empty())
       const_cast<WickTheorem<S> &>(*this).set_op_connections(
           op_connections_input_);
     // size op_topological_partition_ to match input_, if needed
     upsize_op_topological_partition(input_.size());
-    // now compute
+  }
+
+  /// Evaluates wick_ theorem for a single NormalOperatorSequence
+  /// @return the result of applying Wick's theorem
+  ExprPtr compute_nopseq(const bool count_only) const {
+    init_nopseq();
+    // now compute, unless the result is in the cache
+    if (use_cache_) {
+      if (auto key = make_cache_key(count_only)) {
+        auto &cache = WickCache::instance();
+        auto make_codec = [&]() {
+          std::optional<TmpIndexNamespace> tmp_indices;
+          if (tmp_index_base_) tmp_indices.emplace(*tmp_index_base_);
+          return detail::WickCacheCodec<S>(key->second, std::move(tmp_indices));
+        };
+        auto codec = make_codec();
+        if (auto value = cache.find(key->first)) {
+          if (auto result = codec.decode(*value)) return result;
+          // a corrupt entry is a miss; start the temporary indices afresh
+          codec = make_codec();
+        }
+        auto result = compute_nontensor_wick(count_only);
+        if (auto value = codec.encode(result)) {
+          cache.insert(key->first, *value);
+          // in the deterministic mode return the decoded result, so that
+          // its temporary indices do not depend on whether it was cached
+          if (tmp_index_base_) return codec.decode(*value);
+        }
+        return result;
+      }
+    }
     auto result = compute_nontensor_wick(count_only);
     return std::move(result);
   }
 
+  /// @return the WickCache key for the current problem, and the list of Index
+  /// objects of input_ in the order of appearance (used to encode/decode the
+  /// result), or nullopt if the problem cannot be cached
+  std::optional<std::pair<std::wstring, container::svector<Index>>>
+  make_cache_key(const bool count_only) const {
+    std::wostringstream oss;
+    container::svector<Index> indices;
+    oss << L"fc" << full_contractions_ << L" sf" << spinfree_ << L" ut"
+        << use_topology_ << L" ed" << enumerate_diagrams_ << L" co"
+        << count_only << L" bks"
+        << static_cast<int>(get_default_context().braket_symmetry());
+    for (auto &&nop : input_) {
+      oss << L" N" << static_cast<int>(nop.vacuum()) << L":"
+          << nop.ncreators();
+      for (auto &&op : nop) {
+        const auto &idx = op.index();
+        if (idx.has_proto_indices()) return std::nullopt;
+        auto it = ranges::find(indices, idx);
+        const auto attr = idx.space().attr();
+        oss << L" " << (it - ranges::begin(indices)) << L"@"
+            << attr.type().to_int32() << L"," << attr.qns().to_int32();
+        if (it == ranges::end(indices)) indices.push_back(idx);
+      }
+    }
+    oss << L" |";
+    for (auto &&connections : op_connections_)
+      oss << L" " << connections.to_ullong();
+    oss << L" |";
+    for (auto &&partition : op_topological_partition_) oss << L" " << partition;
+    return std::make_pair(oss.str(), std::move(indices));
+  }
+
+  /// receives the {prefactor, normal operator} terms produced by the
+  /// recursive kernels
+  using nontensor_wick_sink_type = std::function<void(
+      Product &&, std::shared_ptr<NormalOperator<S>> &&)>;
+
   /// carries state down the stack of recursive calls
   struct NontensorWickState {
     NontensorWickState(
@@ -332,9 +790,14 @@ class WickTheorem {
           op_connections(opseq.size()),
           adjacency_matrix(opseq.size() * (opseq.size() - 1) / 2, 0),
           op_nconnections(opseq.size(), 0),
-          op_topological_partition(op_toppart) {
+          op_topological_partition(op_toppart),
+          detailed_stats(Logger::get_instance().wick_stats),
+          toplevel_contraction(all_contractions) {
       init_topological_partitions();
       init_input_index_columns();
+      remaining_ops = opseq_size < detail::opmask_nbits
+                          ? detail::opmask_bit(opseq_size) - 1
+                          : ~detail::opmask_type(0);
     }
 
     NontensorWickState(const NontensorWickState&) = delete;
@@ -349,6 +812,40 @@ class WickTheorem {
     size_t left_op_offset;            //!< where to start looking for contractions
     bool count_only;                  //!< if true, only track the total number of summands in the result (i.e. 1 (the normal product) + the number of contractions (if normal wick result is wanted) or the number of complete constractions (if want complete contractions only)
     std::atomic<size_t> count;        //!< if count_only is true, will countain the total number of terms
+    Stats stats;                      //!< statistics accumulated by this state, merged into WickTheorem::stats_ upon completion
+    bool detailed_stats;              //!< if true, collect the detailed statistics (see Stats)
+    nontensor_wick_sink_type sink;    //!< if nonempty, receives the terms instead of the result buffer
+    std::optional<TmpIndexNamespace> tmp_indices;  //!< if nonempty, creates the temporary indices (deterministic mode)
+
+    /// @return pointer to the namespace of temporary indices, or nullptr to
+    ///         create them via Index::make_tmp_index()
+    TmpIndexNamespace *tmp_index_namespace() {
+      return tmp_indices ? &*tmp_indices : nullptr;
+    }
+
+    /// updates the statistics upon a contraction attempt
+    void count_attempted_contraction() {
+      ++stats.num_attempted_contractions;
+      if (detailed_stats)
+        ++stats.num_attempted_contractions_per_level[std::min<std::size_t>(
+            level, Stats::max_nlevels - 1)];
+    }
+
+    /// increments @p counter of the detailed statistics, if these are
+    /// collected
+    void count_pruned(std::atomic<size_t> &counter) {
+      if (detailed_stats) ++counter;
+    }
+
+    static constexpr size_t all_contractions = std::numeric_limits<size_t>::max();
+    /// ordinal of the top-level contraction to follow, or all_contractions to follow every top-level contraction;
+    /// used to split the recursion into independent tasks
+    size_t toplevel_contraction;
+
+    /// compact kernel: mask of uncontracted Op objects (bit @c i refers to the @c i -th Op in the input sequence)
+    detail::opmask_type remaining_ops;
+    /// compact kernel: stack of contractions, {left Op ordinal, right Op ordinal, scalar factor}
+    container::svector<std::tuple<size_t, size_t, int>> contractions;
     /// TODO rename op -> nop to distinguish Op and NormalOperator
     container::svector<std::bitset<max_input_size>>
         op_connections;  //!< bitmask of connections for each op (1 = connected)
@@ -435,6 +932,35 @@ class WickTheorem {
       }
     }
 
+    /// accounts for the topologically-equivalent normal operators
+    /// @param op_idx ordinal of a normal operator
+    /// @return the size of the partition if normal operator @p op_idx is
+    /// the first in its (nonempty) partition, 0 if it is in its partition but is not the first, 1 otherwise
+    size_t op_topological_degeneracy(size_t op_idx) const {
+      auto toppart_idx = op_topological_partition.at(
+          op_idx);  // the partition to which this normal
+                    // operator belongs to (0 = none)
+      if (toppart_idx > 0) {  // if part of a partition ...
+        --toppart_idx;        // to 0-based
+        const auto &toppart = topological_partitions.at(toppart_idx);
+        if (!toppart.empty()) {  // ... and the partition is not empty ...
+          const auto it = toppart.find(op_idx);
+          // .. and not missing from the partition (because then it's topologically unique) ...
+          if (it != toppart.end()) {
+            // ... and first in the partition
+            if (it == toppart.begin()) {
+              // account for the entire partition by scaling the
+              // contribution from the first contraction from this
+              // normal operator
+              return toppart.size();
+            } else
+              return 0;
+          }
+        }
+      }
+      return 1;
+    }
+
     template <typename T>
     static auto lowtri_idx(T i, T j) {
       assert(i != j);
@@ -451,6 +977,24 @@ class WickTheorem {
     inline bool connect(const container::svector<std::bitset<max_input_size>>
                             &target_op_connections,
                         const Cursor &op1_cursor, const Cursor &op2_cursor) {
+      return connect(target_op_connections, op1_cursor.range_ordinal(),
+                     op1_cursor.range_iter()->size(),
+                     op2_cursor.range_ordinal(),
+                     op2_cursor.range_iter()->size());
+    }
+
+    /// @brief Updates connectivity if contraction satisfies target connectivity
+
+    /// If the target connectivity will be violated by this contraction, keep
+    /// the state unchanged and return false
+    /// @param op1_idx ordinal of the first normal operator
+    /// @param op1_size current number of Op objects in the first normal operator
+    /// @param op2_idx ordinal of the second normal operator
+    /// @param op2_size current number of Op objects in the second normal operator
+    inline bool connect(const container::svector<std::bitset<max_input_size>>
+                            &target_op_connections,
+                        const size_t op1_idx, const size_t op1_size,
+                        const size_t op2_idx, const size_t op2_size) {
       auto update_topology = [this](size_t op_idx) {
         const auto nconnections = op_nconnections[op_idx];
         // if using topological partitions for normal ops, and this operator is in one of them, remove it on first connection
@@ -466,9 +1010,6 @@ class WickTheorem {
         ++op_nconnections[op_idx];
       };
 
-      // local vars
-      const auto op1_idx = op1_cursor.range_ordinal();
-      const auto op2_idx = op2_cursor.range_ordinal();
       if (target_op_connections
               .empty()) {  // if no constraints, all is fair game
         update_topology(op1_idx);
@@ -485,8 +1026,7 @@ class WickTheorem {
 
       // test if op1 has enough remaining indices to satisfy
       const auto nidx_op1_remain =
-          op1_cursor.range_iter()->size() -
-          1;  // how many indices op1 has minus this index
+          op1_size - 1;  // how many indices op1 has minus this index
       const auto nidx_op1_needs =
           (op_connections[op1_idx] | target_op_connections[op1_idx])
               .flip()
@@ -501,8 +1041,7 @@ class WickTheorem {
 
       // test if op2 has enough remaining indices to satisfy
       const auto nidx_op2_remain =
-          op2_cursor.range_iter()->size() -
-          1;  // how many indices op2 has minus this index
+          op2_size - 1;  // how many indices op2 has minus this index
       const auto nidx_op2_needs =
           (op_connections[op2_idx] | target_op_connections[op2_idx])
               .flip()
@@ -526,6 +1065,16 @@ class WickTheorem {
     inline void disconnect(const container::svector<std::bitset<max_input_size>>
                                &target_op_connections,
                            const Cursor &op1_cursor, const Cursor &op2_cursor) {
+      disconnect(target_op_connections, op1_cursor.range_ordinal(),
+                 op2_cursor.range_ordinal());
+    }
+
+    /// @brief Updates connectivity when contraction is reversed
+    /// @param op1_idx ordinal of the first normal operator
+    /// @param op2_idx ordinal of the second normal operator
+    inline void disconnect(const container::svector<std::bitset<max_input_size>>
+                               &target_op_connections,
+                           const size_t op1_idx, const size_t op2_idx) {
       auto update_topology = [this](size_t op_idx) {
         assert(op_nconnections.at(op_idx) > 0);
         const auto nconnections = --op_nconnections[op_idx];
@@ -539,9 +1088,6 @@ class WickTheorem {
         }
       };
 
-      // local vars
-      const auto op1_idx = op1_cursor.range_ordinal();
-      const auto op2_idx = op2_cursor.range_ordinal();
       update_topology(op1_idx);
       update_topology(op2_idx);
       if (target_op_connections.empty())  // if no constraints, we don't keep
@@ -559,16 +1105,60 @@ class WickTheorem {
     }
   };  // NontensorWickState
 
+  /// the (partial) result of recursive_nontensor_wick: list of {prefactor, normal operator} pairs
+  using nontensor_wick_result_type =
+      std::vector<std::pair<Product, std::shared_ptr<NormalOperator<S>>>>;
+
+  /// passes a term to the sink of @p state , if any, else appends it to
+  /// @p result
+  static void emit(nontensor_wick_result_type &result,
+                   NontensorWickState &state, Product &&sp,
+                   std::shared_ptr<NormalOperator<S>> nop) {
+    if (state.sink)
+      state.sink(std::move(sp), std::move(nop));
+    else
+      result.emplace_back(std::move(sp), std::move(nop));
+  }
+
+  /// @return the term @p sp times @p nop (if nonnull) as an Expr
+  static ExprPtr make_term(Product &&sp,
+                           std::shared_ptr<NormalOperator<S>> &&nop) {
+    auto term = make_expr<Product>(std::move(sp));
+    if (nop) term->append(1, std::move(nop));
+    return term;
+  }
+
   /// Applies most naive version of Wick's theorem, where the sign rule involves
   /// counting Ops
-  /// @return the result
-  ExprPtr compute_nontensor_wick(const bool count_only) const {
-    std::vector<std::pair<Product, std::shared_ptr<NormalOperator<S>>>>
-        result;      //!< current value of the result
-    std::mutex mtx;  // used in critical sections updating the result
-    auto result_plus_mutex = std::make_pair(&result, &mtx);
+  /// @param count_only if true, will only count the terms
+  /// @param sink if nonempty, will receive the terms (must be reentrant if
+  ///        contractions are parallelized)
+  /// @return the result, or nullptr if @p sink is nonempty
+  ExprPtr compute_nontensor_wick(
+      const bool count_only,
+      const nontensor_wick_sink_type &sink = {}) const {
+    // count combinatorially, if possible
+    if (count_only && !sink) {
+      if (auto count = count_contractions()) return ex<Constant>(*count);
+    }
+
+    nontensor_wick_result_type result;  //!< current value of the result
     NontensorWickState state(input_, op_topological_partition_);
     state.count_only = count_only;
+    state.sink = sink;
+    if (tmp_index_base_) state.tmp_indices.emplace(*tmp_index_base_);
+
+    // full contractions of not too long sequences are computed by the compact kernel
+    std::optional<CompactWickInput> compact_input;
+    if (full_contractions_ && input_.opsize() <= detail::opmask_nbits)
+      compact_input = make_compact_input();
+    auto recurse = [this, &compact_input](nontensor_wick_result_type &result,
+                                          NontensorWickState &state) {
+      if (compact_input)
+        recursive_compact_wick(result, state, *compact_input);
+      else
+        recursive_nontensor_wick(result, state);
+    };
     // TODO extract index->particle maps
 
     if (Logger::get_instance().wick_contract) {
@@ -583,7 +1173,45 @@ class WickTheorem {
       std::wcout << "}" << std::endl;
     }
 
-    recursive_nontensor_wick(result_plus_mutex, state);
+    // excitation-level screening
+    if (compact_input &&
+        !can_contract_fully(compact_input->channels, state.remaining_ops)) {
+      state.count_pruned(state.stats.num_pruned_screening);
+      if (Logger::get_instance().wick_contract)
+        std::wcout << "screened out: " << to_latex(input_) << std::endl;
+    } else if (compact_input && use_topology_ && enumerate_diagrams_ &&
+               !spinfree_) {
+      enumerate_wick_diagrams(result, state, *compact_input);
+    } else if (parallelize_contractions_ &&
+               (num_threads() > 1 || deterministic())) {
+      // each top-level contraction seeds a task with its own state and its
+      // own result buffer, hence no synchronization is needed until the
+      // buffers are merged; in the deterministic mode the tasks are created
+      // even if there is 1 thread, so that the temporary indices do not
+      // depend on the number of threads
+      const auto ntasks = count_toplevel_contractions(state);
+      std::vector<nontensor_wick_result_type> task_results(ntasks);
+      auto task = [this, &task_results, &state, &recurse, &sink,
+                   count_only](size_t task_id) {
+        NontensorWickState task_state(input_, op_topological_partition_);
+        task_state.count_only = count_only;
+        task_state.sink = sink;
+        task_state.toplevel_contraction = task_id;
+        if (tmp_index_base_) task_state.tmp_indices.emplace(*tmp_index_base_);
+        recurse(task_results[task_id], task_state);
+        state.count += task_state.count.load();
+        state.stats += task_state.stats;
+      };
+      parallel_for_each(task, ntasks);
+      // merge in the order of tasks
+      for (auto &&task_result : task_results) {
+        result.insert(result.end(),
+                      std::make_move_iterator(task_result.begin()),
+                      std::make_move_iterator(task_result.end()));
+        nontensor_wick_result_type{}.swap(task_result);
+      }
+    } else
+      recurse(result, state);
 
     // if computing everything, include the contraction-free term
     if (!full_contractions_) {
@@ -591,10 +1219,17 @@ class WickTheorem {
         ++state.count;
       }
       else {
-        auto [phase, normop] = normalize(input_, state.input_partner_indices);
-        result_plus_mutex.first->push_back(std::make_pair(Product(phase, {}), std::move(normop)));
+        std::tuple<int, std::shared_ptr<NormalOperator<S>>> phase_normop;
+        Stats::time(state.stats.time_normalize_ns, [&]() {
+          phase_normop = normalize(input_, state.input_partner_indices);
+        });
+        auto &[phase, normop] = phase_normop;
+        emit(result, state, Product(phase, {}), std::move(normop));
       }
     }
+    state.stats.update_peak_result_size(result.size());
+    stats_ += state.stats;
+    if (sink) return nullptr;
 
     // convert result to an Expr
     // if result.size() == 0, return null ptr
@@ -604,7 +1239,7 @@ class WickTheorem {
       result_expr = ex<Constant>(state.count);
     }
     else if (result.size() == 1) {  // if result.size() == 1, return Product
-      auto product = std::make_shared<Product>(std::move(result.at(0).first));
+      auto product = make_expr<Product>(std::move(result.at(0).first));
       if (full_contractions_)
         assert(result.at(0).second == nullptr);
       else {
@@ -613,14 +1248,14 @@ class WickTheorem {
       }
       result_expr = product;
     } else if (result.size() > 1) {
-      auto sum = std::make_shared<Sum>();
+      auto sum = make_expr<Sum>();
       for (auto &&term : result) {
         if (full_contractions_) {
           assert(term.second == nullptr);
           sum->append(ex<Product>(std::move(term.first)));
         }
         else {
-          auto term_product = std::make_shared<Product>(std::move(term.first));
+          auto term_product = make_expr<Product>(std::move(term.first));
           if (term.second) {
             term_product->append(1, term.second);
           }
@@ -637,10 +1272,36 @@ class WickTheorem {
  public:
   virtual ~WickTheorem();
  private:
-  void recursive_nontensor_wick(
-      std::pair<std::vector<std::pair<Product, std::shared_ptr<NormalOperator<S>>>> *,
-                std::mutex *> &result,
-      NontensorWickState &state) const {
+  /// @return the number of top-level contractions examined by
+  /// recursive_nontensor_wick(), i.e. the number of pairs of Op objects
+  /// from different NormalOperator objects that are candidates for the first
+  /// contraction
+  size_t count_toplevel_contractions(NontensorWickState &state) const {
+    if (state.opseq_size == 0) return 0;
+    using opseq_view_type = flattened_rangenest<NormalOperatorSequence<S>>;
+    auto opseq_view = opseq_view_type(&state.opseq);
+    using std::begin;
+    using std::end;
+
+    size_t result = 0;
+    auto op_left_iter = begin(opseq_view);
+    const auto op_left_iter_fence = full_contractions_ ? ranges::next(op_left_iter) : end(opseq_view);
+    for (; op_left_iter != op_left_iter_fence; ++op_left_iter) {
+      for (auto op_right_iter = ranges::next(op_left_iter);
+           op_right_iter != end(opseq_view); ++op_right_iter) {
+        if (ranges::get_cursor(op_right_iter).range_iter() !=
+            ranges::get_cursor(op_left_iter).range_iter())
+          ++result;
+      }
+    }
+    return result;
+  }
+
+  /// @param[in,out] result the result buffer, contractions will be appended to it; each concurrent invocation
+  ///                must use its own buffer
+  /// @param[in,out] state the recursion state
+  void recursive_nontensor_wick(nontensor_wick_result_type &result,
+                                NontensorWickState &state) const {
     using opseq_view_type = flattened_rangenest<NormalOperatorSequence<S>>;
     auto opseq_view = opseq_view_type(&state.opseq);
     using std::begin;
@@ -656,6 +1317,7 @@ class WickTheorem {
       return;
 
     const auto op_left_iter_fence = full_contractions_ ? ranges::next(op_left_iter) : end(opseq_view);
+    size_t toplevel_contraction_ordinal = 0;  // only used at level 0
     for(; op_left_iter != op_left_iter_fence; ++op_left_iter, ++left_op_offset) {
       auto op_right_iter = ranges::next(op_left_iter);
       for (; op_right_iter != end(opseq_view);) {
@@ -664,6 +1326,15 @@ class WickTheorem {
                 ranges::get_cursor(op_left_iter)
                     .range_iter()  // can't contract within same normop
         ) {
+          // if the recursion is split into tasks, follow only the top-level
+          // contraction assigned to this task
+          if (state.level == 0 &&
+              toplevel_contraction_ordinal++ != state.toplevel_contraction &&
+              state.toplevel_contraction != NontensorWickState::all_contractions) {
+            ++op_right_iter;
+            continue;
+          }
+
           // computes topological degeneracy:
           // 0 = nonunique index
           // n>0 = unique index in a group of n indices
@@ -687,40 +1358,26 @@ class WickTheorem {
               auto opseq_right_idx =
                   ranges::get_cursor(op_right_iter)
                       .range_ordinal();  // the index of normal operator
-              auto opseq_right_toppart_idx = state.op_topological_partition.at(
-                  opseq_right_idx);  // the partition to which this normal
-                                     // operator belongs to (0 = none)
-              if (opseq_right_toppart_idx > 0) {  // if part of a partition ...
-                --opseq_right_toppart_idx;        // to 0-based
-                const auto &opseq_right_toppart =
-                    state.topological_partitions.at(opseq_right_toppart_idx);
-                if (!opseq_right_toppart
-                         .empty()) {  // ... and the partition is not empty ...
-                  const auto it = opseq_right_toppart.find(opseq_right_idx);
-                  // .. and not missing from the partition (because then it's topologically unique) ...
-                  if (it != opseq_right_toppart.end()) {
-                    // ... and first in the partition
-                    if (it == opseq_right_toppart.begin()) {
-                      // account for the entire partition by scaling the
-                      // contribution from the first contraction from this
-                      // normal operator
-                      result *= opseq_right_toppart.size();
-                    } else
-                      result = 0;
-                  }
-                }
-              }
+              result *= state.op_topological_degeneracy(opseq_right_idx);
             }
             return result;
           };
 
           // check if can contract these indices and
           // check connectivity constraints (if needed)
-          size_t top_degen;
-          if (can_contract(*op_left_iter, *op_right_iter, input_.vacuum()) &&
-              (top_degen = topological_degeneracy()) > 0 &&
-              state.connect(op_connections_, ranges::get_cursor(op_right_iter),
-                            ranges::get_cursor(op_left_iter))) {
+          size_t top_degen = 0;
+          bool contract_ops = false;
+          if (!can_contract(*op_left_iter, *op_right_iter, input_.vacuum()))
+            state.count_pruned(state.stats.num_pruned_can_contract);
+          else if ((top_degen = topological_degeneracy()) == 0)
+            state.count_pruned(state.stats.num_pruned_topology);
+          else if (!state.connect(op_connections_,
+                                  ranges::get_cursor(op_right_iter),
+                                  ranges::get_cursor(op_left_iter)))
+            state.count_pruned(state.stats.num_pruned_connectivity);
+          else
+            contract_ops = true;
+          if (contract_ops) {
             if (Logger::get_instance().wick_contract) {
               std::wcout << "level " << state.level << ":contracting "
                          << to_latex(*op_left_iter) << " with "
@@ -744,10 +1401,11 @@ class WickTheorem {
             // update the prefactor and opseq
             Product sp_copy = state.sp;
             state.sp.append(top_degen * phase,
-                            contract(*op_left_iter, *op_right_iter, input_.vacuum()));
+                            contract(*op_left_iter, *op_right_iter, input_.vacuum(),
+                                     state.tmp_index_namespace()));
 
             // update the stats
-            ++stats_.num_attempted_contractions;
+            state.count_attempted_contraction();
 
             // remove from back to front
             Op<S> right = *op_right_iter;
@@ -766,43 +1424,44 @@ class WickTheorem {
               if (!full_contractions_ ||
                   (full_contractions_ && state.opseq_size == 0)) {
                 if (!state.count_only) {
+                  // N.B. the terms share the contractions with state.sp,
+                  // they are copied on write (see detach())
                   if (full_contractions_) {
-                    result.second->lock();
                     //              std::wcout << "got " << to_latex(state.sp) << std::endl;
-                    result.first->push_back(
-                        std::make_pair(std::move(state.sp.deep_copy()),
-                                       std::shared_ptr<NormalOperator<S>>{}));
+                    emit(result, state, Product(state.sp), nullptr);
                     //              std::wcout << "now up to " <<
-                    //              result.first->size()
+                    //              result.size()
                     //              << " terms" << std::endl;
-                    result.second->unlock();
                   } else {
-                    auto [phase, op] = normalize(state.opseq, state.make_target_partner_indices());
-                    result.second->lock();
-                    result.first->push_back(std::make_pair(
-                        std::move(state.sp.deep_copy().scale(phase)),
-                        op->empty() ? nullptr : std::move(op)));
-                    result.second->unlock();
+                    std::tuple<int, std::shared_ptr<NormalOperator<S>>> phase_op;
+                    Stats::time(state.stats.time_normalize_ns, [&]() {
+                      phase_op = normalize(
+                          state.opseq, state.make_target_partner_indices());
+                    });
+                    auto &[phase, op] = phase_op;
+                    emit(result, state,
+                         std::move(Product(state.sp).scale(phase)),
+                         op->empty() ? nullptr : std::move(op));
                   }
                 } else
                   ++state.count;
 
                 // update the stats: count this contraction as useful
-                ++stats_.num_useful_contractions;
+                ++state.stats.num_useful_contractions;
               }
             }
 
             if (state.opseq_size != 0) {
               const auto current_num_useful_contractions =
-                  stats_.num_useful_contractions.load();
+                  state.stats.num_useful_contractions.load();
               ++state.level;
               state.left_op_offset = left_op_offset;
               recursive_nontensor_wick(result, state);
               --state.level;
               // this contraction is useful if it leads to useful contractions as a result
               if (current_num_useful_contractions !=
-                  stats_.num_useful_contractions.load())
-                ++stats_.num_useful_contractions;
+                  state.stats.num_useful_contractions.load())
+                ++state.stats.num_useful_contractions;
             }
 
             // restore the prefactor and opseq
@@ -825,6 +1484,742 @@ class WickTheorem {
     }  // left op iter
   }
 
+  /// @name excitation-level screening
+  ///
+  /// Op objects can only be contracted within an excitation channel (holes
+  /// and particles for the single-product vacuum, particles for the physical
+  /// vacuum), by pairing a quasiparticle annihilator with a subsequent
+  /// quasiparticle creator. Hence a sequence of Op objects can only be fully
+  /// contracted if in every channel the quasiparticle (de)excitations can be
+  /// balanced. This (necessary) condition is used to screen out the
+  /// sequences with zero vacuum average before the recursion, and the
+  /// partially contracted sequences that can no longer be closed during it.
+  /// Sequences with Op objects in spaces not covered by the channels (e.g.
+  /// user-defined spaces outside of IndexSpace::complete) are not screened.
+  ///@{
+
+  /// for each excitation channel, the Op objects that can act in it as
+  /// quasiparticle annihilators and creators
+  struct ExcitationChannels {
+    static constexpr std::size_t nchannels = 2;
+    std::array<detail::opmask_type, nchannels> qpannihilators = {};
+    std::array<detail::opmask_type, nchannels> qpcreators = {};
+    /// false if some Op objects can act outside of the channels, then
+    /// nothing can be screened
+    bool complete = true;
+  };
+
+  /// @param ops a sequence of at most 64 Op objects
+  /// @param vacuum the vacuum
+  /// @return excitation channels of @p ops
+  template <typename OpRange>
+  static ExcitationChannels make_excitation_channels(const OpRange &ops,
+                                                     Vacuum vacuum) {
+    ExcitationChannels result;
+    if (vacuum != Vacuum::Physical && vacuum != Vacuum::SingleProduct) {
+      result.complete = false;
+      return result;
+    }
+    using channel_spaces_type =
+        std::array<IndexSpace, ExcitationChannels::nchannels>;
+    const auto channel_spaces =
+        vacuum == Vacuum::Physical
+            ? channel_spaces_type{IndexSpace::instance(IndexSpace::complete),
+                                  IndexSpace::null_instance()}
+            : channel_spaces_type{
+                  IndexSpace::instance(IndexSpace::occupied),
+                  IndexSpace::instance(IndexSpace::complete_unoccupied)};
+    size_t op_ord = 0;
+    for (auto &&op : ops) {
+      // for either vacuum the channels span IndexSpace::complete
+      if (!includes(IndexSpace::complete, op.index().space().type()))
+        result.complete = false;
+      const auto op_bit = detail::opmask_bit(op_ord);
+      const auto qpann_space = qpannihilator_space<S>(op, vacuum);
+      const auto qpcre_space = qpcreator_space<S>(op, vacuum);
+      for (size_t c = 0; c != ExcitationChannels::nchannels; ++c) {
+        if (channel_spaces[c] == IndexSpace::null_instance()) continue;
+        if (intersection(qpann_space, channel_spaces[c]) !=
+            IndexSpace::null_instance())
+          result.qpannihilators[c] |= op_bit;
+        else if (intersection(qpcre_space, channel_spaces[c]) !=
+                 IndexSpace::null_instance())
+          result.qpcreators[c] |= op_bit;
+      }
+      ++op_ord;
+    }
+    return result;
+  }
+
+  /// @param channels excitation channels of a sequence of Op objects
+  /// @param ops (sub)sequence of Op objects
+  /// @return false if @p ops certainly cannot be fully contracted
+  static bool can_contract_fully(const ExcitationChannels &channels,
+                                 detail::opmask_type ops) {
+    if (detail::popcount(ops) % 2) return false;
+    if (!channels.complete) return true;
+    std::array<detail::opmask_type, ExcitationChannels::nchannels> in_channel;
+    detail::opmask_type in_any_channel = 0;
+    for (size_t c = 0; c != ExcitationChannels::nchannels; ++c) {
+      in_channel[c] =
+          (channels.qpannihilators[c] | channels.qpcreators[c]) & ops;
+      in_any_channel |= in_channel[c];
+    }
+    if (in_any_channel != ops) return false;
+
+    // in each channel track the range of the number of uncontracted
+    // quasiparticle annihilators; Op objects that can also act in another
+    // channel may be skipped
+    for (size_t c = 0; c != ExcitationChannels::nchannels; ++c) {
+      detail::opmask_type in_other_channels = 0;
+      for (size_t c2 = 0; c2 != ExcitationChannels::nchannels; ++c2)
+        if (c2 != c) in_other_channels |= in_channel[c2];
+      int nmin = 0;
+      int nmax = 0;
+      for (auto mask = in_channel[c]; mask != 0; mask &= mask - 1) {
+        const auto op_bit = mask & (~mask + 1);
+        const bool optional = (in_other_channels & op_bit) != 0;
+        if (channels.qpannihilators[c] & op_bit) {
+          if (!optional) ++nmin;
+          ++nmax;
+        } else {
+          if (!optional && --nmax < 0) return false;
+          nmin = std::max(nmin - 1, 0);
+        }
+      }
+      if (nmin != 0) return false;
+    }
+    return true;
+  }
+  ///@}
+
+  /// @name combinatorial counting
+  ///
+  /// Computes the number of terms produced by compute(count_only=true)
+  /// without enumerating the contractions. Op objects of a NormalOperator that
+  /// are equivalent (i.e. belong to the same Hugenholtz group) can be
+  /// contracted with the same Op objects, hence the number of contractions
+  /// only depends on how many Op objects of each such class remain
+  /// uncontracted, and is computed by dynamic programming over these
+  /// multiplicities. The connectivity constraints are accounted for by
+  /// inclusion-exclusion over the required connections.
+  ///@{
+
+  /// counts the contractions of a sequence of classes of equivalent Op objects
+  struct ContractionCounter {
+    container::svector<size_t> class_nop;  //!< ordinal of NormalOperator to which each class belongs
+    container::svector<container::svector<size_t>> class_ops;  //!< for each class, ordinals of its Op objects in the (flattened) input, in ascending order
+    container::svector<container::svector<size_t>> class_partners;  //!< for each class, the classes of subsequent NormalOperator objects its Op objects can be contracted with
+    bool full_contractions = true;  //!< if false, count partial contractions also
+    bool use_topology = false;  //!< if true, count only the topologically unique contractions
+    container::svector<std::bitset<max_input_size>> forbidden_connections;  //!< for each NormalOperator, the NormalOperator objects it may not be connected to
+    std::map<container::svector<size_t>, size_t> memo;
+
+    /// @param nremaining the number of uncontracted Op objects of each class;
+    ///        the uncontracted Op objects of class @c c are the last
+    ///        @c nremaining[c] Op objects in @c class_ops[c]
+    /// @return the number of contractions of the uncontracted Op objects
+    size_t count(container::svector<size_t> &nremaining) {
+      // the first uncontracted Op is contracted (or skipped) first
+      const auto nclasses = nremaining.size();
+      auto left = nclasses;
+      auto left_op = std::numeric_limits<size_t>::max();
+      for (size_t c = 0; c != nclasses; ++c) {
+        if (nremaining[c] == 0) continue;
+        const auto op = class_ops[c][class_ops[c].size() - nremaining[c]];
+        if (op < left_op) {
+          left = c;
+          left_op = op;
+        }
+      }
+      if (left == nclasses) return 1;
+      if (auto it = memo.find(nremaining); it != memo.end()) return it->second;
+
+      const auto key = nremaining;
+      size_t result = 0;
+      --nremaining[left];
+      if (!full_contractions) result += count(nremaining);
+      const auto &forbidden = forbidden_connections[class_nop[left]];
+      for (auto &&right : class_partners[left]) {
+        if (nremaining[right] == 0 || forbidden.test(class_nop[right]))
+          continue;
+        // with topology only the first uncontracted Op of the class is used
+        const auto weight = use_topology ? 1 : nremaining[right];
+        --nremaining[right];
+        result += weight * count(nremaining);
+        ++nremaining[right];
+      }
+      ++nremaining[left];
+      memo.emplace(key, result);
+      return result;
+    }
+  };
+
+  /// the maximum number of required connections between NormalOperator
+  /// objects handled by count_contractions() (the cost of inclusion-exclusion
+  /// is exponential in it)
+  static constexpr size_t max_counted_connections = 12;
+
+  /// computes the result of compute_nontensor_wick(count_only=true) without
+  /// enumerating the contractions
+  /// @return the number of terms, or nullopt if it cannot be computed
+  /// combinatorially (for partial contractions with connectivity
+  /// constraints or topology, for topological partitions of NormalOperator
+  /// objects, or for direct enumeration of diagrams)
+  std::optional<size_t> count_contractions() const {
+    const bool use_topology = use_topology_ && !spinfree_;
+    if (ranges::any_of(op_topological_partition_,
+                       [](size_t p) { return p != 0; }))
+      return std::nullopt;
+    if (full_contractions_ && use_topology && enumerate_diagrams_ &&
+        input_.opsize() <= detail::opmask_nbits)
+      return std::nullopt;
+    if (!full_contractions_ && (use_topology || !op_connections_.empty()))
+      return std::nullopt;
+    if (full_contractions_ && input_.opsize() == 0) return 0;
+
+    // classify Op objects
+    ContractionCounter counter;
+    counter.full_contractions = full_contractions_;
+    counter.use_topology = use_topology;
+    container::svector<Op<S>> class_op;  // representative of each class
+    size_t op_ord = 0;
+    size_t nop_ord = 0;
+    for (auto &&nop : input_) {
+      const auto nop_class_offset = class_op.size();
+      for (auto &&op : nop) {
+        auto c = nop_class_offset;
+        for (; c != class_op.size(); ++c)
+          if (typename Op<S>::TypeEquality{}(class_op[c], op)) break;
+        if (c == class_op.size()) {
+          class_op.push_back(op);
+          counter.class_nop.push_back(nop_ord);
+          counter.class_ops.emplace_back();
+        }
+        counter.class_ops[c].push_back(op_ord++);
+      }
+      ++nop_ord;
+    }
+    const auto nclasses = class_op.size();
+    counter.class_partners.resize(nclasses);
+    for (size_t c = 0; c != nclasses; ++c)
+      for (size_t d = c + 1; d != nclasses; ++d)
+        if (counter.class_nop[d] != counter.class_nop[c] &&
+            can_contract(class_op[c], class_op[d], input_.vacuum()))
+          counter.class_partners[c].push_back(d);
+
+    // required connections; N.B. the constraints of NormalOperator objects
+    // without Op objects are never checked
+    container::svector<std::pair<size_t, size_t>> required_connections;
+    for (size_t n1 = 0; n1 != op_connections_.size(); ++n1) {
+      for (size_t n2 = n1 + 1; n2 != op_connections_.size(); ++n2) {
+        if (!op_connections_[n1].test(n2) && !input_.at(n1).empty() &&
+            !input_.at(n2).empty())
+          required_connections.emplace_back(n1, n2);
+      }
+    }
+    if (required_connections.size() > max_counted_connections)
+      return std::nullopt;
+
+    // inclusion-exclusion: sum over subsets of the required connections
+    // of the (signed) number of contractions that avoid them
+    container::svector<size_t> nremaining(nclasses);
+    for (size_t c = 0; c != nclasses; ++c)
+      nremaining[c] = counter.class_ops[c].size();
+    std::int64_t result = 0;
+    const auto nsubsets = size_t{1} << required_connections.size();
+    for (size_t subset = 0; subset != nsubsets; ++subset) {
+      counter.forbidden_connections.assign(input_.size(), {});
+      for (size_t r = 0; r != required_connections.size(); ++r) {
+        if (subset & (size_t{1} << r)) {
+          const auto [n1, n2] = required_connections[r];
+          counter.forbidden_connections[n1].set(n2);
+          counter.forbidden_connections[n2].set(n1);
+        }
+      }
+      counter.memo.clear();
+      const auto count = static_cast<std::int64_t>(counter.count(nremaining));
+      result += std::bitset<max_counted_connections>(subset).count() % 2
+                    ? -count
+                    : count;
+    }
+    assert(result >= 0);
+    return static_cast<size_t>(result);
+  }
+  ///@}
+
+  /// @name compact Wick kernel
+  ///
+  /// Computes full contractions by referring to Op objects by their ordinals
+  /// in the (flattened) input sequence. Instead of erasing and reinserting Op
+  /// objects contractions are tracked by a bitmask of the remaining Op
+  /// objects and a stack of contracted pairs; the contractibility of Op
+  /// pairs, the Hugenholtz groups of Op objects, etc. are precomputed.
+  /// Index and Tensor objects are only created for the complete contractions.
+  /// The contractions are enumerated in the same order as by
+  /// recursive_nontensor_wick().
+  ///@{
+
+  /// precomputed data describing the input sequence
+  struct CompactWickInput {
+    container::svector<Op<S>> ops;  //!< flattened input
+    container::svector<size_t> op_nop;  //!< ordinal of NormalOperator to which each Op belongs
+    container::svector<detail::opmask_type> nop_ops;  //!< Op objects of each NormalOperator
+    container::svector<detail::opmask_type> contractible;  //!< for each Op, subsequent Op objects it can be contracted with
+    container::svector<detail::opmask_type> hug_group;  //!< for each Op, Op objects in its Hugenholtz group (only used if use_topology_ is true)
+    container::svector<size_t> partner;  //!< for each Op, the Op acting on the same particle (or itself, if none); only used in spin-free mode
+    detail::opmask_type qpannihilators = 0;  //!< quasiparticle annihilators
+    ExcitationChannels channels;  //!< excitation channels of Op objects, used for screening
+  };
+
+  CompactWickInput make_compact_input() const {
+    CompactWickInput result;
+    size_t nop_ord = 0;
+    for (auto &&nop : input_) {
+      detail::opmask_type nop_ops = 0;
+      const auto nop_offset = result.ops.size();
+      for (auto &&op : nop) {
+        nop_ops |= detail::opmask_bit(result.ops.size());
+        result.partner.push_back(result.ops.size());
+        result.ops.push_back(op);
+        result.op_nop.push_back(nop_ord);
+      }
+      // k-th creator and k-th annihilator act on the same particle
+      // N.B. annihilators are stored in reverse order
+      const auto nop_size = nop.size();
+      const auto npairs = std::min(nop.ncreators(), nop.nannihilators());
+      for (size_t k = 0; k != npairs; ++k) {
+        result.partner[nop_offset + k] = nop_offset + nop_size - 1 - k;
+        result.partner[nop_offset + nop_size - 1 - k] = nop_offset + k;
+      }
+      result.nop_ops.push_back(nop_ops);
+      ++nop_ord;
+    }
+
+    const auto nops = result.ops.size();
+    const auto vacuum = input_.vacuum();
+    result.channels = make_excitation_channels(result.ops, vacuum);
+    result.contractible.resize(nops, 0);
+    result.hug_group.resize(nops, 0);
+    for (size_t i = 0; i != nops; ++i) {
+      const auto &op_i = result.ops[i];
+      if (is_qpannihilator(op_i, vacuum))
+        result.qpannihilators |= detail::opmask_bit(i);
+      for (size_t j = i + 1; j < nops; ++j) {
+        if (can_contract(op_i, result.ops[j], vacuum))
+          result.contractible[i] |= detail::opmask_bit(j);
+      }
+      for (size_t j = 0; j != nops; ++j) {
+        if (result.op_nop[j] == result.op_nop[i] &&
+            typename Op<S>::TypeEquality{}(op_i, result.ops[j]))
+          result.hug_group[i] |= detail::opmask_bit(j);
+      }
+    }
+    return result;
+  }
+
+  void recursive_compact_wick(nontensor_wick_result_type &result,
+                              NontensorWickState &state,
+                              const CompactWickInput &input) const {
+    assert(full_contractions_);
+    if (state.remaining_ops == 0) return;
+
+    // full contractions: contract the first remaining op with another op
+    const auto left = detail::lowest_bit(state.remaining_ops);
+    const auto left_bit = detail::opmask_bit(left);
+    const auto left_nop = input.op_nop[left];
+
+    // optimization: can't contract fully if first op is not a qp annihilator
+    if ((input.qpannihilators & left_bit) == 0) return;
+
+    size_t toplevel_contraction_ordinal = 0;  // only used at level 0
+    // can't contract within same normop
+    for (auto candidates = state.remaining_ops & ~input.nop_ops[left_nop];
+         candidates != 0; candidates &= candidates - 1) {
+      const auto right = detail::lowest_bit(candidates);
+      const auto right_bit = detail::opmask_bit(right);
+      const auto right_nop = input.op_nop[right];
+
+      // if the recursion is split into tasks, follow only the top-level
+      // contraction assigned to this task
+      if (state.level == 0 &&
+          toplevel_contraction_ordinal++ != state.toplevel_contraction &&
+          state.toplevel_contraction != NontensorWickState::all_contractions)
+        continue;
+
+      if ((input.contractible[left] & right_bit) == 0) {
+        state.count_pruned(state.stats.num_pruned_can_contract);
+        continue;
+      }
+
+      // computes topological degeneracy:
+      // 0 = nonunique index
+      // n>0 = unique index in a group of n indices
+      size_t top_degen = 1;
+      if (use_topology_ && !spinfree_) {
+        const auto group = input.hug_group[right] & state.remaining_ops;
+        top_degen =
+            detail::lowest_bit(group) == right ? detail::popcount(group) : 0;
+      }
+      if (top_degen > 0 && !state.topological_partitions.empty())
+        top_degen *= state.op_topological_degeneracy(right_nop);
+      if (top_degen == 0) {
+        state.count_pruned(state.stats.num_pruned_topology);
+        continue;
+      }
+
+      // check connectivity constraints (if needed)
+      if (!state.connect(
+              op_connections_, right_nop,
+              detail::popcount(input.nop_ops[right_nop] & state.remaining_ops),
+              left_nop,
+              detail::popcount(input.nop_ops[left_nop] & state.remaining_ops))) {
+        state.count_pruned(state.stats.num_pruned_connectivity);
+        continue;
+      }
+
+      if (Logger::get_instance().wick_contract) {
+        std::wcout << "level " << state.level << ":contracting "
+                   << to_latex(input.ops[left]) << " with "
+                   << to_latex(input.ops[right]) << " (top_degen=" << top_degen
+                   << ")" << std::endl;
+      }
+
+      // the phase is determined by the number of ops between left and right
+      int phase = 1;
+      if (statistics == Statistics::FermiDirac) {
+        const auto between = state.remaining_ops & (right_bit - 1) &
+                             ~(left_bit | (left_bit - 1));
+        if (detail::popcount(between) % 2) phase = -1;
+      }
+
+      // update the contraction stack and the remaining ops
+      state.contractions.emplace_back(left, right,
+                                      static_cast<int>(top_degen) * phase);
+      state.remaining_ops &= ~(left_bit | right_bit);
+      state.opseq_size -= 2;
+
+      // update the stats
+      state.count_attempted_contraction();
+
+      if (state.opseq_size == 0) {
+        if (!state.count_only) {
+          Product sp;
+          for (auto &&[l, r, scalar] : state.contractions)
+            sp.append(scalar,
+                      contract(input.ops[l], input.ops[r], input_.vacuum(),
+                               state.tmp_index_namespace()));
+          if (spinfree_)
+            sp.scale(spin_summation_factor(input, state.contractions));
+          emit(result, state, std::move(sp), nullptr);
+        } else
+          ++state.count;
+
+        // update the stats: count this contraction as useful
+        ++state.stats.num_useful_contractions;
+      } else if (can_contract_fully(input.channels, state.remaining_ops)) {
+        const auto current_num_useful_contractions =
+            state.stats.num_useful_contractions.load();
+        ++state.level;
+        recursive_compact_wick(result, state, input);
+        --state.level;
+        // this contraction is useful if it leads to useful contractions as a
+        // result
+        if (current_num_useful_contractions !=
+            state.stats.num_useful_contractions.load())
+          ++state.stats.num_useful_contractions;
+      } else
+        state.count_pruned(state.stats.num_pruned_screening);
+
+      // restore the state
+      state.opseq_size += 2;
+      state.remaining_ops |= left_bit | right_bit;
+      state.contractions.pop_back();
+      state.disconnect(op_connections_, right_nop, left_nop);
+    }
+  }
+
+  /// @return the factor due to the summation over spin of a full contraction
+  /// in spin-free mode, i.e. 2 to the power of the number of loops formed by
+  /// the contractions and the particle lines
+  /// @note open chains (that end at an Op without a partner, e.g. in
+  ///       particle-number-nonconserving operators) are not loops
+  static double spin_summation_factor(
+      const CompactWickInput &input,
+      const container::svector<std::tuple<size_t, size_t, int>>
+          &contractions) {
+    // loops are the connected components of the graph of Op objects in which
+    // every Op has a partner
+    container::svector<size_t> parent(input.ops.size());
+    std::iota(parent.begin(), parent.end(), size_t{0});
+    auto find = [&parent](size_t i) {
+      while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+      }
+      return i;
+    };
+    auto unite = [&find, &parent](size_t i, size_t j) {
+      parent[find(i)] = find(j);
+    };
+    for (size_t i = 0; i != input.ops.size(); ++i) unite(i, input.partner[i]);
+    for (auto &&[l, r, scalar] : contractions) unite(l, r);
+    container::svector<bool> open(input.ops.size(), false);
+    for (size_t i = 0; i != input.ops.size(); ++i)
+      if (input.partner[i] == i) open[find(i)] = true;
+    int nloops = 0;
+    for (size_t i = 0; i != input.ops.size(); ++i)
+      if (find(i) == i && !open[i]) ++nloops;
+    return std::ldexp(1., nloops);
+  }
+  ///@}
+
+  /// @name direct enumeration of Wick diagrams
+  ///
+  /// Full contractions are grouped into (Hugenholtz) diagrams, each specified
+  /// by the number of contractions between every pair of Hugenholtz groups
+  /// (topologically equivalent Op objects of the same NormalOperator).
+  /// With the topology assumptions of use_topology() all contractions of a
+  /// diagram are equivalent, hence only a representative contraction is
+  /// produced, scaled by the number of contractions in the diagram.
+  /// Diagrams that only differ by a permutation of topologically equivalent
+  /// NormalOperator objects (see set_op_partitions()) are detected by
+  /// comparing the canonical forms (computed by bliss) of their colored graphs
+  /// and combined.
+  ///@{
+
+  /// Hugenholtz group of Op objects
+  struct WickHugGroup {
+    size_t nop;                 //!< ordinal of the NormalOperator
+    size_t ordinal;             //!< ordinal of the group in its NormalOperator
+    detail::opmask_type ops;    //!< Op objects in the group
+  };
+
+  /// topologically distinct diagram
+  struct WickDiagram {
+    /// canonical graph, only used if there are topologically equivalent
+    /// NormalOperator objects
+    std::unique_ptr<bliss::Graph> canonical_graph;
+    /// the number of contractions between groups {g,h}, g<h, stored at g*ngroups+h
+    container::svector<size_t> ncontractions;
+    /// the number of contractions represented by this diagram
+    double weight;
+  };
+
+  /// @return the graph of the diagram with vertices for NormalOperator
+  /// objects, Hugenholtz groups, and contracted pairs of groups
+  std::unique_ptr<bliss::Graph> make_diagram_graph(
+      const container::svector<WickHugGroup> &groups,
+      const container::svector<size_t> &ncontractions) const {
+    const auto nnops = op_topological_partition_.size();
+    const auto npartitions = *ranges::max_element(op_topological_partition_);
+    // topologically equivalent normal operators have same color
+    auto nop_color = [&](size_t nop) -> unsigned int {
+      const auto partition = op_topological_partition_[nop];
+      return partition > 0 ? partition : npartitions + 1 + nop;
+    };
+    const auto nnop_colors = npartitions + 1 + nnops;
+    size_t max_ngroups = 0;
+    for (auto &&group : groups)
+      max_ngroups = std::max(max_ngroups, group.ordinal + 1);
+
+    auto graph = std::make_unique<bliss::Graph>();
+    for (size_t nop = 0; nop != nnops; ++nop)
+      graph->add_vertex(nop_color(nop));
+    const auto ngroups = groups.size();
+    for (size_t g = 0; g != ngroups; ++g) {
+      const auto v = graph->add_vertex(
+          nnop_colors + nop_color(groups[g].nop) * max_ngroups +
+          groups[g].ordinal);
+      graph->add_edge(v, groups[g].nop);
+    }
+    for (size_t g = 0; g != ngroups; ++g) {
+      for (size_t h = g + 1; h < ngroups; ++h) {
+        if (const auto n = ncontractions[g * ngroups + h]; n > 0) {
+          const auto v =
+              graph->add_vertex(nnop_colors * (max_ngroups + 1) + n);
+          graph->add_edge(v, nnops + g);
+          graph->add_edge(v, nnops + h);
+        }
+      }
+    }
+    return graph;
+  }
+
+  /// @param[in,out] result the result buffer, a term for each diagram will be
+  ///                appended to it
+  /// @param[in,out] state the state, only the stats and the count are used
+  /// @param[in] input the precomputed input data
+  void enumerate_wick_diagrams(nontensor_wick_result_type &result,
+                               NontensorWickState &state,
+                               const CompactWickInput &input) const {
+    assert(full_contractions_ && use_topology_);
+    const auto nops = input.ops.size();
+    const auto nnops = input.nop_ops.size();
+    if (nops == 0) return;
+
+    // Hugenholtz groups, in the order of their first Op
+    container::svector<WickHugGroup> groups;
+    {
+      container::svector<size_t> nop_ngroups(nnops, 0);
+      for (size_t i = 0; i != nops; ++i) {
+        if (detail::lowest_bit(input.hug_group[i]) == i) {
+          const auto nop = input.op_nop[i];
+          groups.push_back(
+              WickHugGroup{nop, nop_ngroups[nop]++, input.hug_group[i]});
+        }
+      }
+    }
+    const auto ngroups = groups.size();
+
+    // N.B. all Op objects of group g precede those of group h>g
+    container::svector<bool> contractible(ngroups * ngroups, false);
+    for (size_t g = 0; g != ngroups; ++g) {
+      const auto g_first = detail::lowest_bit(groups[g].ops);
+      for (size_t h = g + 1; h < ngroups; ++h) {
+        contractible[g * ngroups + h] =
+            groups[g].nop != groups[h].nop &&
+            (input.contractible[g_first] &
+             detail::opmask_bit(detail::lowest_bit(groups[h].ops))) != 0;
+      }
+    }
+
+    auto factorial = [](size_t n) {
+      double result = 1;
+      for (size_t i = 2; i <= n; ++i) result *= i;
+      return result;
+    };
+
+    std::vector<WickDiagram> diagrams;
+    std::unordered_multimap<unsigned int, size_t>
+        diagram_idx;  // canonical graph hash -> diagram
+    container::svector<size_t> ncontractions(ngroups * ngroups, 0);
+    container::svector<size_t> nremaining(ngroups);
+    for (size_t g = 0; g != ngroups; ++g)
+      nremaining[g] = detail::popcount(groups[g].ops);
+
+    // completes a diagram
+    auto visit = [&]() {
+      ++state.stats.num_attempted_contractions;
+
+      // check connectivity constraints (if needed)
+      if (!op_connections_.empty()) {
+        container::svector<std::bitset<max_input_size>> connections(nnops);
+        for (size_t g = 0; g != ngroups; ++g) {
+          for (size_t h = g + 1; h < ngroups; ++h) {
+            if (ncontractions[g * ngroups + h] > 0) {
+              connections[groups[g].nop].set(groups[h].nop);
+              connections[groups[h].nop].set(groups[g].nop);
+            }
+          }
+        }
+        for (size_t nop = 0; nop != nnops; ++nop) {
+          if ((connections[nop] | op_connections_[nop]).flip().any()) return;
+        }
+      }
+
+      // the number of contractions represented by this diagram
+      double weight = 1;
+      for (auto &&group : groups) weight *= factorial(detail::popcount(group.ops));
+      for (auto &&n : ncontractions) weight /= factorial(n);
+
+      // combine with the isomorphic diagram, if any
+      std::unique_ptr<bliss::Graph> canonical_graph;
+      if (!state.topological_partitions.empty()) {
+        auto graph = make_diagram_graph(groups, ncontractions);
+        bliss::Stats stats;
+        graph->set_splitting_heuristic(bliss::Graph::shs_fsm);
+        const unsigned int *cl = graph->canonical_form(stats, nullptr, nullptr);
+        canonical_graph.reset(graph->permute(cl));
+        const auto hash = canonical_graph->get_hash();
+        auto [it, it_end] = diagram_idx.equal_range(hash);
+        for (; it != it_end; ++it) {
+          auto &diagram = diagrams[it->second];
+          if (diagram.canonical_graph->cmp(*canonical_graph) == 0) {
+            diagram.weight += weight;
+            return;
+          }
+        }
+        diagram_idx.emplace(hash, diagrams.size());
+      }
+      diagrams.push_back(
+          WickDiagram{std::move(canonical_graph), ncontractions, weight});
+      ++state.stats.num_useful_contractions;
+    };
+
+    // distributes the uncontracted Op objects of group g among groups h, h+1,
+    // ...
+    std::function<void(size_t, size_t)> distribute = [&](size_t g, size_t h) {
+      if (g == ngroups) {
+        visit();
+        return;
+      }
+      if (nremaining[g] == 0) {
+        distribute(g + 1, g + 2);
+        return;
+      }
+      for (; h < ngroups; ++h) {
+        if (!contractible[g * ngroups + h] || nremaining[h] == 0) continue;
+        const auto nmax = std::min(nremaining[g], nremaining[h]);
+        for (size_t n = 1; n <= nmax; ++n) {
+          ncontractions[g * ngroups + h] = n;
+          nremaining[g] -= n;
+          nremaining[h] -= n;
+          distribute(g, h + 1);
+          nremaining[g] += n;
+          nremaining[h] += n;
+        }
+        ncontractions[g * ngroups + h] = 0;
+      }
+    };
+    distribute(0, 1);
+
+    if (state.count_only) {
+      state.count += diagrams.size();
+      return;
+    }
+
+    // for each diagram produce the representative contraction
+    for (auto &&diagram : diagrams) {
+      container::svector<detail::opmask_type> uncontracted(ngroups);
+      for (size_t g = 0; g != ngroups; ++g) uncontracted[g] = groups[g].ops;
+      container::svector<std::pair<size_t, size_t>> contractions;
+      for (size_t g = 0; g != ngroups; ++g) {
+        for (size_t h = g + 1; h < ngroups; ++h) {
+          for (size_t n = 0; n != diagram.ncontractions[g * ngroups + h]; ++n) {
+            const auto left = detail::lowest_bit(uncontracted[g]);
+            const auto right = detail::lowest_bit(uncontracted[h]);
+            uncontracted[g] &= ~detail::opmask_bit(left);
+            uncontracted[h] &= ~detail::opmask_bit(right);
+            contractions.emplace_back(left, right);
+          }
+        }
+      }
+      ranges::sort(contractions);
+
+      // the phase is determined by the number of crossing contractions
+      int phase = 1;
+      if (statistics == Statistics::FermiDirac) {
+        for (size_t c1 = 0; c1 != contractions.size(); ++c1) {
+          for (size_t c2 = c1 + 1; c2 < contractions.size(); ++c2) {
+            // N.B. contractions[c1].first < contractions[c2].first
+            if (contractions[c2].first < contractions[c1].second &&
+                contractions[c1].second < contractions[c2].second)
+              phase = -phase;
+          }
+        }
+      }
+
+      Product sp;
+      for (auto &&[left, right] : contractions)
+        sp.append(1, contract(input.ops[left], input.ops[right],
+                              input_.vacuum(), state.tmp_index_namespace()));
+      sp.scale(phase * diagram.weight);
+      emit(result, state, std::move(sp), nullptr);
+    }
+  }
+  ///@}
+
  public:
   static bool can_contract(const Op<S> &left, const Op<S> &right,
                            Vacuum vacuum = get_default_context().vacuum()) {
@@ -837,9 +2232,12 @@ class WickTheorem {
     return false;
   }
 
+  /// @param tmp_indices if nonnull, creates the temporary indices, else they
+  ///        are created via Index::make_tmp_index()
   static ExprPtr contract(
       const Op<S> &left, const Op<S> &right,
-      Vacuum vacuum = get_default_context().vacuum()) {
+      Vacuum vacuum = get_default_context().vacuum(),
+      TmpIndexNamespace *tmp_indices = nullptr) {
     assert(can_contract(left, right, vacuum));
     //    assert(
     //        !left.index().has_proto_indices() &&
@@ -853,7 +2251,9 @@ class WickTheorem {
       const auto qpspace_left = qpannihilator_space<S>(left, vacuum);
       const auto qpspace_right = qpcreator_space<S>(right, vacuum);
       const auto qpspace_common = intersection(qpspace_left, qpspace_right);
-      const auto index_common = Index::make_tmp_index(qpspace_common);
+      const auto index_common = tmp_indices
+                                    ? tmp_indices->make(qpspace_common)
+                                    : Index::make_tmp_index(qpspace_common);
 
       // preserve bra/ket positions of left & right
       const auto left_is_ann = left.action() == Action::annihilate;
@@ -863,7 +2263,7 @@ class WickTheorem {
           qpspace_common !=
               right.index().space()) {  // may need 2 overlaps if neither space
         // is pure qp creator/annihilator
-        auto result = std::make_shared<Product>();
+        auto result = make_expr<Product>();
         result->append(1, left_is_ann ? make_overlap(left.index(), index_common)
                                       : make_overlap(index_common, left.index()));
         result->append(1, left_is_ann ? make_overlap(index_common, right.index())
@@ -879,6 +2279,12 @@ class WickTheorem {
   /// @param[in,out] on input, Wick theorem result, on output the result of
   /// reducing the overlaps
   void reduce(ExprPtr &expr) const;
+
+  /// expands, reduces, and canonicalizes the result of Wick theorem for a
+  /// Product, accounting the time spent in each step in stats()
+  /// @param[in,out] expr on input, Wick theorem result (times the prefactor),
+  /// on output the simplified result
+  void simplify_result(ExprPtr &expr) const;
 };
 
 using BWickTheorem = WickTheorem<Statistics::BoseEinstein>;
@@ -5,14 +5,12 @@
 #ifndef SEQUANT_WICK_IMPL_HPP
 #define SEQUANT_WICK_IMPL_HPP
 
+#include <mutex>
+
 #include "bliss.hpp"
 #include "tensor_network.hpp"
 #include "utility.hpp"
 
-#ifdef SEQUANT_HAS_EXECUTION_HEADER
-# include <execution>
-#endif
-
 namespace sequant {
 
 namespace detail {
@@ -240,10 +238,11 @@ inline bool apply_index_replacement_rules(
     pass_mutated = false;
 
     for (auto it = ranges::begin(exrng); it != ranges::end(exrng);) {
-      const auto &factor = *it;
+      auto &factor = *it;
       if (factor->is<Tensor>()) {
         bool erase_it = false;
-        auto &tensor = factor->as<Tensor>();
+        // N.B. tensors may be shared with other terms
+        auto &tensor = detach(factor).as<Tensor>();
 
         /// replace indices
         pass_mutated &=
@@ -317,9 +316,9 @@ inline bool apply_index_replacement_rules(
   // assert that tensors_ indices are not tagged since going to tag indices
   {
     for (auto it = ranges::begin(exrng); it != ranges::end(exrng); ++it) {
-      const auto &factor = *it;
+      auto &factor = *it;
       if (factor->is<Tensor>()) {
-        factor->as<Tensor>().reset_tags();
+        detach(factor).as<Tensor>().reset_tags();
       }
     }
   }
@@ -337,62 +336,595 @@ inline bool apply_index_replacement_rules(
   return mutated;
 }
 
+/// Resolves Kronecker deltas by applying index replacement rules until a fixed
+/// point is reached; supports indices with proto indices
+/// @throw zero_result if @c expr is zero
+inline void reduce_wick_fixed_point(
+    std::shared_ptr<Product> &expr,
+    const container::set<Index> &external_indices) {
+  bool pass_mutated = false;
+  do {
+    pass_mutated = false;
+
+    // extract current indices
+    std::set<Index, Index::LabelCompare> all_indices;
+    ranges::for_each(*expr, [&all_indices](const auto &factor) {
+      if (factor->template is<Tensor>()) {
+        ranges::for_each(factor->template as<const Tensor>().braket(),
+                         [&all_indices](const Index &idx) {
+                           [[maybe_unused]] auto result = all_indices.insert(idx);
+                         });
+      }
+    });
+
+    const auto replacement_rules =
+        compute_index_replacement_rules(expr, external_indices, all_indices);
+
+    if (Logger::get_instance().wick_reduce){
+      std::wcout << "reduce_wick_impl(expr, external_indices):\n  expr = "
+                 << expr->to_latex() << "\n  external_indices = ";
+      ranges::for_each(external_indices, [](auto &index) {
+        std::wcout << index.label() << " ";
+      });
+      std::wcout << "\n  replrules = ";
+      ranges::for_each(replacement_rules, [](auto &index) {
+        std::wcout << to_latex(index.first) << "\\to"
+                   << to_latex(index.second) << "\\,";
+      });
+      std::wcout.flush();
+    }
+
+    if (!replacement_rules.empty()) {
+      pass_mutated = apply_index_replacement_rules(
+          expr, replacement_rules, external_indices, all_indices);
+    }
+
+    if (Logger::get_instance().wick_reduce) {
+      std::wcout << "\n  result = " << expr->to_latex() << std::endl;
+    }
+
+  } while (pass_mutated);  // keep reducing until stop changing
+}
+
+/// Resolves Kronecker deltas in a single pass: the indices bound by
+/// Kronecker deltas are partitioned into equivalence classes (via union-find),
+/// and every class is replaced by a single index in the intersection of the
+/// spaces of its indices:
+/// - if the class contains an external index whose space is the intersection,
+///   it is used to represent the class, else an index of the class whose
+///   space is the intersection is used, else a new internal index is made;
+/// - Kronecker deltas between the representative and the other external
+///   indices of the class are kept, all other Kronecker deltas are removed;
+/// - classes that only include external indices are left as is.
+/// @pre indices of @c expr do not have proto indices
+/// @throw zero_result if @c expr is zero
+inline void reduce_wick_union_find(
+    std::shared_ptr<Product> &expr,
+    const container::set<Index> &external_indices) {
+  expr_range exrng(expr);
+  auto is_overlap = [](const Tensor &tensor) {
+    return tensor.label() == overlap_label();
+  };
+  auto is_ext = [&external_indices](const Index &idx) {
+    return external_indices.find(idx) != external_indices.end();
+  };
+
+  // collect all indices and the overlaps
+  std::set<Index, Index::LabelCompare> all_indices;
+  container::svector<std::pair<Index, Index>> overlaps;  // {bra, ket}
+  for (auto it = ranges::begin(exrng); it != ranges::end(exrng); ++it) {
+    const auto &factor = *it;
+    if (factor->is<Tensor>()) {
+      const auto &tensor = factor->as<Tensor>();
+      for (auto &&idx : tensor.braket()) all_indices.insert(idx);
+      if (is_overlap(tensor)) {
+        assert(tensor.bra().size() == 1);
+        assert(tensor.ket().size() == 1);
+        overlaps.emplace_back(tensor.bra().at(0), tensor.ket().at(0));
+      }
+    }
+  }
+  if (overlaps.empty()) return;
+
+  // partition indices bound by the overlaps into equivalence classes
+  container::svector<Index> indices;
+  container::svector<size_t> parent;
+  auto ordinal = [&indices, &parent](const Index &idx) -> size_t {
+    auto it = ranges::find(indices, idx);
+    if (it != ranges::end(indices)) return it - ranges::begin(indices);
+    parent.push_back(indices.size());
+    indices.push_back(idx);
+    return indices.size() - 1;
+  };
+  auto find = [&parent](size_t i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  for (auto &&[bra, ket] : overlaps) {
+    const auto bra_root = find(ordinal(bra));
+    const auto ket_root = find(ordinal(ket));
+    if (bra_root != ket_root)
+      parent[std::max(bra_root, ket_root)] = std::min(bra_root, ket_root);
+  }
+
+  // for each class compute the intersection of spaces and find the
+  // representative
+  const auto nindices = indices.size();
+  container::svector<IndexSpace> class_space(nindices,
+                                             IndexSpace::null_instance());
+  container::svector<bool> class_has_internal(nindices, false);
+  for (size_t i = 0; i != nindices; ++i) {
+    const auto root = find(i);
+    class_space[root] = i == root ? indices[i].space()
+                                  : intersection(class_space[root],
+                                                 indices[i].space());
+    if (!is_ext(indices[i])) class_has_internal[root] = true;
+  }
+  auto index_validator = [&all_indices](const Index &idx) {
+    return all_indices.find(idx) == all_indices.end();
+  };
+  IndexFactory idxfac(index_validator);
+  container::svector<std::optional<Index>> class_repr(nindices);
+  container::map<Index, Index> replrules;  // src->dst
+  for (size_t root = 0; root != nindices; ++root) {
+    if (find(root) != root) continue;
+    const auto &space = class_space[root];
+    if (space == IndexSpace::null_instance()) throw zero_result{};
+    if (!class_has_internal[root]) continue;
+    // prefer external indices, then the existing internal indices
+    for (int ext = 1; ext >= 0 && !class_repr[root]; --ext) {
+      for (size_t i = root; i != nindices; ++i) {
+        if (find(i) == root && is_ext(indices[i]) == bool(ext) &&
+            indices[i].space() == space) {
+          class_repr[root] = indices[i];
+          break;
+        }
+      }
+    }
+    if (!class_repr[root]) class_repr[root] = idxfac.make(space);
+    for (size_t i = root; i != nindices; ++i) {
+      if (find(i) == root && !is_ext(indices[i]) &&
+          indices[i] != *class_repr[root])
+        replrules.emplace(indices[i], *class_repr[root]);
+    }
+  }
+
+  if (Logger::get_instance().wick_reduce) {
+    std::wcout << "reduce_wick_impl(expr, external_indices):\n  expr = "
+               << expr->to_latex() << "\n  external_indices = ";
+    ranges::for_each(external_indices, [](auto &index) {
+      std::wcout << index.label() << " ";
+    });
+    std::wcout << "\n  replrules = ";
+    ranges::for_each(replrules, [](auto &index) {
+      std::wcout << to_latex(index.first) << "\\to"
+                 << to_latex(index.second) << "\\,";
+    });
+    std::wcout.flush();
+  }
+
+  // replace indices and overlaps; each external index other than the
+  // representative keeps one overlap with the representative
+  container::set<Index> ext_with_overlap;
+  for (auto it = ranges::begin(exrng); it != ranges::end(exrng); ++it) {
+    const auto &factor = *it;
+    if (!factor->is<Tensor>()) continue;
+    const auto &tensor = factor->as<Tensor>();
+    if (!is_overlap(tensor)) {
+      // tensors may be shared with other terms, hence only the tensors that
+      // change are detached
+      const bool mutate =
+          ranges::any_of(tensor.const_braket(), [&replrules](const Index &idx) {
+            return replrules.find(idx) != replrules.end() ||
+                   idx.tag().has_value();
+          });
+      if (mutate) {
+        auto &mutable_tensor = detach(*it).as<Tensor>();
+        mutable_tensor.transform_indices(replrules);
+        mutable_tensor.reset_tags();
+      }
+      continue;
+    }
+    const auto bra = tensor.bra().at(0);
+    const auto ket = tensor.ket().at(0);
+    const auto root = find(ordinal(bra));
+    if (!class_has_internal[root]) {  // ext + ext
+      if (bra == ket) *it = ex<Constant>(1);
+      continue;
+    }
+    const auto &repr = *class_repr[root];
+    auto new_overlaps = make_expr<Product>();
+    if (is_ext(bra) && bra != repr && ext_with_overlap.insert(bra).second)
+      new_overlaps->append(1, make_overlap(bra, repr));
+    if (is_ext(ket) && ket != repr && ext_with_overlap.insert(ket).second)
+      new_overlaps->append(1, make_overlap(repr, ket));
+    if (new_overlaps->empty())
+      *it = ex<Constant>(1);
+    else if (new_overlaps->factors().size() == 1)
+      *it = new_overlaps->factor(0);
+    else
+      *it = new_overlaps;
+  }
+
+  if (Logger::get_instance().wick_reduce) {
+    std::wcout << "\n  result = " << expr->to_latex() << std::endl;
+  }
+}
+
 /// If using orthonormal representation, resolves Kronecker deltas (=overlaps
 /// between indices in orthonormal spaces) in summations
 /// @throw zero_result if @c expr is zero
 inline void reduce_wick_impl(std::shared_ptr<Product> &expr,
                              const container::set<Index> &external_indices) {
   if (get_default_context().metric() == IndexSpaceMetric::Unit) {
-    bool pass_mutated = false;
-    do {
-      pass_mutated = false;
-
-      // extract current indices
-      std::set<Index, Index::LabelCompare> all_indices;
-      ranges::for_each(*expr, [&all_indices](const auto &factor) {
-        if (factor->template is<Tensor>()) {
-          ranges::for_each(factor->template as<const Tensor>().braket(),
-                           [&all_indices](const Index &idx) {
-                             [[maybe_unused]] auto result = all_indices.insert(idx);
-                           });
-        }
-      });
+    // proto indices are only supported by the fixed-point algorithm
+    const bool have_proto_indices =
+        ranges::any_of(*expr, [](const auto &factor) {
+          return factor->template is<Tensor>() &&
+                 ranges::any_of(factor->template as<const Tensor>().braket(),
+                                [](const Index &idx) {
+                                  return idx.has_proto_indices();
+                                });
+        });
+    if (have_proto_indices)
+      reduce_wick_fixed_point(expr, external_indices);
+    else
+      reduce_wick_union_find(expr, external_indices);
+  } else
+    abort();  // programming error?
+}
 
-      const auto replacement_rules =
-          compute_index_replacement_rules(expr, external_indices, all_indices);
+}  // namespace detail
 
-      if (Logger::get_instance().wick_reduce){
-        std::wcout << "reduce_wick_impl(expr, external_indices):\n  expr = "
-                   << expr->to_latex() << "\n  external_indices = ";
-        ranges::for_each(external_indices, [](auto &index) {
-          std::wcout << index.label() << " ";
-        });
-        std::wcout << "\n  replrules = ";
-        ranges::for_each(replacement_rules, [](auto &index) {
-          std::wcout << to_latex(index.first) << "\\to"
-                     << to_latex(index.second) << "\\,";
-        });
-        std::wcout.flush();
+template <Statistics S>
+typename WickTheorem<S>::TopologyPartitions
+WickTheorem<S>::compute_topology_partitions() const {
+  assert(expr_input_ && expr_input_->is<Product>());
+  TopologyPartitions result;
+
+  // construct graph representation of the tensor product
+  TensorNetwork tn(expr_input_->as<Product>().factors());
+  auto [graph, vlabels, vcolors, vtypes] = tn.make_bliss_graph();
+  const auto n = vlabels.size();
+  assert(vtypes.size() == n);
+  const auto& tn_edges = tn.edges();
+  const auto& tn_tensors = tn.tensors();
+
+  // identify vertex indices of NormalOperators and Indices
+  container::set<size_t> nop_vertex_idx;
+  container::set<size_t> index_vertex_idx;
+  {
+    const auto &nop_labels = NormalOperator<S>::labels();
+    const auto nop_labels_begin = begin(nop_labels);
+    const auto nop_labels_end = end(nop_labels);
+    for (size_t v = 0; v != n; ++v) {
+      if (vtypes[v] == TensorNetwork::VertexType::TensorCore &&
+          (std::find(nop_labels_begin, nop_labels_end, vlabels[v]) !=
+           nop_labels_end)) {
+        auto insertion_result = nop_vertex_idx.insert(v);
+        assert(insertion_result.second);
+      }
+      if (vtypes[v] == TensorNetwork::VertexType::Index) {
+        auto insertion_result = index_vertex_idx.insert(v);
+        assert(insertion_result.second);
       }
+    }
+  }
+
+  // compute and save graph automorphism generators
+  std::vector<std::vector<unsigned int>> aut_generators;
+  {
+    bliss::Stats stats;
+    graph->set_splitting_heuristic(bliss::Graph::shs_fsm);
+
+    auto save_aut = [&aut_generators](const unsigned int n,
+                                      const unsigned int* aut) {
+      aut_generators.emplace_back(aut, aut + n);
+    };
+
+    graph->find_automorphisms(stats, &bliss::aut_hook<decltype(save_aut)>, &save_aut);
+  }
 
-      if (!replacement_rules.empty()) {
-        pass_mutated = apply_index_replacement_rules(
-            expr, replacement_rules, external_indices, all_indices);
+  // use automorphisms to determine groups of topologically equivalent NormalOperators and Indices
+  // this partitions vertices into partitions (only nontrivial partitions are reported)
+  // vertex_pair_exclude is a callable that accepts 2 vertex indices and returns true if this pair of indices is to be excluded
+  // the default is to not exclude any pairs
+  auto compute_partitions = [&aut_generators](const container::set<size_t>& vertices,
+      auto&& vertex_pair_exclude) {
+    container::map<size_t, size_t> vertex_to_partition_idx;
+    int next_partition_idx = -1;
+
+    // using each automorphism generator
+    for (auto &&aut : aut_generators) {
+      // update partitions
+      for (const auto v1 : vertices) {
+        const auto v2 = aut[v1];
+        if (v2 != v1 && !vertex_pair_exclude(v1, v2)) {  // if the automorphism maps this vertex to another ... they both must be in the same partition
+          assert(vertices.find(v2) != vertices.end());
+          auto v1_partition_it = vertex_to_partition_idx.find(v1);
+          auto v2_partition_it = vertex_to_partition_idx.find(v2);
+          const bool v1_has_partition =
+              v1_partition_it != vertex_to_partition_idx.end();
+          const bool v2_has_partition =
+              v2_partition_it != vertex_to_partition_idx.end();
+          if (v1_has_partition &&
+              v2_has_partition) {  // both are in partitions? make sure they are in the same partition. N.B. this may leave gaps in partition indices ... no biggie
+            const auto v1_part_idx = v1_partition_it->second;
+            const auto v2_part_idx = v2_partition_it->second;
+            if (v1_part_idx !=
+                v2_part_idx) {  // if they have different partition indices, change the larger of the two indices to match the lower
+              const auto target_part_idx =
+                  std::min(v1_part_idx, v2_part_idx);
+              for (auto &v : vertex_to_partition_idx) {
+                if (v.second == v1_part_idx || v.second == v2_part_idx)
+                  v.second = target_part_idx;
+              }
+            }
+          } else if (v1_has_partition) {  // only v1 is in a partition? place v2 in it
+            const auto v1_part_idx = v1_partition_it->second;
+            vertex_to_partition_idx.emplace(v2, v1_part_idx);
+          } else if (v2_has_partition) {  // only v2 is in a partition? place v1 in it
+            const auto v2_part_idx = v2_partition_it->second;
+            vertex_to_partition_idx.emplace(v1, v2_part_idx);
+          } else {  // neither is in a partition? place both in the next available partition
+            const size_t target_part_idx = ++next_partition_idx;
+            vertex_to_partition_idx.emplace(v1, target_part_idx);
+            vertex_to_partition_idx.emplace(v2, target_part_idx);
+          }
+        }
       }
+    }
+    return std::make_tuple(vertex_to_partition_idx, next_partition_idx);
+  };
 
-      if (Logger::get_instance().wick_reduce) {
-        std::wcout << "\n  result = " << expr->to_latex() << std::endl;
+  // compute NormalOperator->partition map, convert to partition lists (if any),
+  // to be registered via set_op_partitions
+  auto [nop_to_partition_idx, max_nop_partition_idx] = compute_partitions(nop_vertex_idx, [](size_t v1, size_t v2) { return false; });
+  if (!nop_to_partition_idx.empty()) {
+    container::vector<container::vector<size_t>> nop_partitions;
+
+    assert(max_nop_partition_idx > -1);
+    const size_t max_partition_index = max_nop_partition_idx;
+    nop_partitions.reserve(max_partition_index);
+    // iterate over all partition indices ... note that there may be gaps so count the actual partitions
+    size_t partition_cnt = 0;
+    for(size_t p=0; p<=max_partition_index; ++p) {
+      bool p_found = false;
+      for(const auto& nop_part: nop_to_partition_idx) {
+        if (nop_part.second == p) {
+          // !!remember to map the vertex index into the operator index!!
+          const auto nop_idx = nop_vertex_idx.find(nop_part.first) - nop_vertex_idx.begin();
+          if (p_found == false) {  // first time this is found
+            nop_partitions.emplace_back(container::vector<size_t>{static_cast<size_t>(nop_idx)});
+          }
+          else
+            nop_partitions[partition_cnt].emplace_back(nop_idx);
+          p_found = true;
+        }
       }
+      if (p_found) ++partition_cnt;
+    }
 
-    } while (pass_mutated);  // keep reducing until stop changing
-  } else
-    abort();  // programming error?
+//            std::wcout << "topological nop partitions:{\n";
+//            ranges::for_each(nop_partitions, [](auto&& part) {
+//              std::wcout << "{";
+//              ranges::for_each(part, [](auto&& p) {
+//                std::wcout << p << " ";
+//              });
+//              std::wcout << "}";
+//            });
+//            std::wcout << "}" << std::endl;
+
+    result.nop_partitions = std::move(nop_partitions);
+  }
+
+  // compute Index->partition map, and convert to partition lists (if any), and check that use_topology_ is compatible with index partitions
+  // Index partitions are constructed to *only* include Index objects attached to the bra/ket of the same NormalOperator!
+  // hence need to use filter in computing partitions
+  auto exclude_index_vertex_pair = [&tn_tensors,&tn_edges](size_t v1, size_t v2) {
+    // v1 and v2 are vertex indices and also index the edges in the TensorNetwork
+    assert(v1 < tn_edges.size());
+    assert(v2 < tn_edges.size());
+    const auto &edge1 = *(tn_edges.begin() + v1);
+    const auto &edge2 = *(tn_edges.begin() + v2);
+    auto connected_to_same_nop = [&tn_tensors](int term1, int term2) {
+      if (term1 == term2 && term1 != 0) {
+        auto tensor_idx = std::abs(term1) - 1;
+        const std::shared_ptr<AbstractTensor> &tensor_ptr =
+            tn_tensors.at(tensor_idx);
+        if (std::dynamic_pointer_cast<NormalOperator<S>>(tensor_ptr))
+          return true;
+      }
+      return false;
+    };
+    const bool exclude =
+        !(connected_to_same_nop(edge1.first(), edge2.first()) ||
+          connected_to_same_nop(edge1.first(), edge2.second()) ||
+          connected_to_same_nop(edge1.second(), edge2.first()) ||
+          connected_to_same_nop(edge1.second(), edge2.second()));
+    return exclude;
+  };
+  container::map<size_t, size_t> index_to_partition_idx;
+  int max_index_partition_idx;
+  std::tie(index_to_partition_idx, max_index_partition_idx) = compute_partitions(index_vertex_idx, exclude_index_vertex_pair);
+  {
+    // use_topology_=true in full contractions will assume that all
+    // equivalent indices in NormalOperator's bra or ket are topologically
+    // equivalent (see Hugenholtz vertex and associated code)
+    // here we make sure that this is indeed the case
+    assert(use_topology_);  // since we are here, use_topology_ is true
+    // this reports whether bra/ket of tensor @c t is in the same partition
+    auto is_nop_braket_singlepartition = [&tn,&tn_edges,&index_to_partition_idx](auto&& tensor_ptr, BraKetPos bkpos) {
+      auto expr_ptr = std::dynamic_pointer_cast<Expr>(tensor_ptr);
+      assert(expr_ptr);
+      auto bkrange = bkpos == BraKetPos::bra ? bra(*tensor_ptr) : ket(*tensor_ptr);
+      assert(ranges::size(bkrange) > 1);
+      int partition = -1;  // will be set to the actual partition index
+      for(auto&& idx: bkrange) {
+        auto idx_full_label = idx.full_label();
+        auto edge_it = tn.find_edge(idx_full_label);
+        assert(edge_it != tn_edges.end());
+        auto vertex = edge_it - tn_edges.begin();  // vertex idx for this Index
+        auto idx_part_it = index_to_partition_idx.find(vertex);
+        if (idx_part_it != index_to_partition_idx.end()) {  // is part of a partition
+          if (partition == -1)               // first index
+            partition = idx_part_it->second;
+          else if (partition != idx_part_it->second)  // compare to the first index's partition #
+            return false;
+        }
+        else  // not part of a partition? fail
+          return false;
+      }
+      return true;
+    };
+    size_t nop_ord = 0;
+    for(auto&& tensor: tn_tensors) {
+      auto nop_ptr = std::dynamic_pointer_cast<NormalOperator<S>>(tensor);
+      if (nop_ptr) {  // if NormalOperator<S>
+        if (bra_rank(*tensor) > 1 &&
+            !is_nop_braket_singlepartition(tensor, BraKetPos::bra)) {
+          result.nonequivalent_braket = std::make_pair(nop_ord, BraKetPos::bra);
+          break;
+        }
+        if (ket_rank(*tensor) > 1 &&
+            !is_nop_braket_singlepartition(tensor, BraKetPos::ket)) {
+          result.nonequivalent_braket = std::make_pair(nop_ord, BraKetPos::ket);
+          break;
+        }
+        ++nop_ord;
+      }
+    }
+  }
+
+  return result;
 }
 
-}  // namespace detail
+template <Statistics S>
+std::optional<std::wstring> WickTheorem<S>::make_topology_cache_key(
+    const Product &product) {
+  std::wostringstream oss;
+  oss << L"bks" << static_cast<int>(get_default_context().braket_symmetry());
+  container::svector<Index> indices;
+  auto encode_index = [&oss, &indices](const Index &idx) {
+    if (idx.has_proto_indices()) return false;
+    auto it = ranges::find(indices, idx);
+    const auto attr = idx.space().attr();
+    oss << L" " << (it - ranges::begin(indices)) << L"@"
+        << attr.type().to_int32() << L"," << attr.qns().to_int32();
+    if (it == ranges::end(indices)) indices.push_back(idx);
+    return true;
+  };
+  for (auto &&factor : product) {
+    auto tensor = std::dynamic_pointer_cast<AbstractTensor>(factor);
+    if (!tensor) return std::nullopt;
+    oss << L" |" << label(*tensor) << L":"
+        << static_cast<int>(symmetry(*tensor)) << L","
+        << static_cast<int>(braket_symmetry(*tensor)) << L","
+        << static_cast<int>(particle_symmetry(*tensor));
+    if (factor->is<NormalOperator<S>>())
+      oss << L"," << static_cast<int>(factor->as<NormalOperator<S>>().vacuum());
+    oss << L" " << bra_rank(*tensor) << L"," << ket_rank(*tensor);
+    for (auto &&idx : bra(*tensor))
+      if (!encode_index(idx)) return std::nullopt;
+    for (auto &&idx : ket(*tensor))
+      if (!encode_index(idx)) return std::nullopt;
+  }
+  return oss.str();
+}
+
+template <Statistics S>
+ExprPtr WickTheorem<S>::init_input_from_product() {
+  assert(expr_input_ && expr_input_->is<Product>());
+  // excitation-level screening: skip the rest if the ops cannot be fully
+  // contracted
+  if (full_contractions_) {
+    const auto first_nop_it = ranges::find_if(
+        *expr_input_,
+        [](const ExprPtr &expr) { return expr->is<NormalOperator<S>>(); });
+    assert(first_nop_it != ranges::end(*expr_input_));
+    const auto vacuum =
+        (*first_nop_it)->template as<NormalOperator<S>>().vacuum();
+    container::svector<Op<S>> ops;
+    for (auto &&factor : *expr_input_) {
+      if (factor->template is<NormalOperator<S>>()) {
+        for (auto &&op : factor->template as<NormalOperator<S>>())
+          ops.push_back(op);
+      }
+    }
+    if (ops.size() <= detail::opmask_nbits) {
+      const auto all_ops = ops.size() < detail::opmask_nbits
+                               ? detail::opmask_bit(ops.size()) - 1
+                               : ~detail::opmask_type(0);
+      if (!can_contract_fully(make_excitation_channels(ops, vacuum),
+                              all_ops))
+        return nullptr;
+    }
+  }
+
+  // compute and record/analyze topological NormalOperator and Index partitions
+  if (use_topology_) {
+    // the partitions only depend on the structure of the Product, hence
+    // are memoized for every Product shape
+    auto &cache = topology_cache();
+    const auto key = make_topology_cache_key(expr_input_->as<Product>());
+    std::optional<TopologyPartitions> partitions;
+    if (key) partitions = cache.find(*key);
+    if (!partitions) {
+      partitions = compute_topology_partitions();
+      if (key) cache.insert(*key, *partitions);
+    }
+
+    // register NormalOperator partitions via set_op_partitions to be used in
+    // full contractions
+    if (!partitions->nop_partitions.empty())
+      this->set_op_partitions(partitions->nop_partitions);
+
+    // use_topology_=true in full contractions will assume that all
+    // equivalent indices in NormalOperator's bra or ket are topologically
+    // equivalent (see Hugenholtz vertex and associated code)
+    if (partitions->nonequivalent_braket) {
+      const auto [nop_ord, pos] = *partitions->nonequivalent_braket;
+      ExprPtr nop;
+      size_t nop_cnt = 0;
+      for (auto &&factor : *expr_input_) {
+        if (factor->is<NormalOperator<S>>() && nop_cnt++ == nop_ord) {
+          nop = factor;
+          break;
+        }
+      }
+      assert(nop);
+      std::basic_stringstream<wchar_t> oss;
+      oss << "WickTheorem<S>::use_topology is true but NormalOperator "
+          << nop->to_latex() << " has "
+          << (pos == BraKetPos::bra ? "bra" : "ket")
+          << " whose indices are not topologically equivalent";
+      throw std::invalid_argument(to_string(oss.str()));
+    }
+  }
+
+  ExprPtr prefactor =
+      ex<CProduct>(expr_input_->as<Product>().scalar(), ExprPtrList{});
+  bool found_op = false;
+  ranges::for_each(
+      *expr_input_, [this, &found_op, &prefactor](const ExprPtr &factor) {
+        if (factor->is<NormalOperator<S>>()) {
+          input_.push_back(factor->as<NormalOperator<S>>());
+          found_op = true;
+        } else {
+          assert(factor->is_cnumber());
+          assert(!found_op);  // make sure that ops are at the end
+          *prefactor *= *factor;
+        }
+      });
+  return prefactor;
+}
 
 template <Statistics S>
 ExprPtr WickTheorem<S>::compute(const bool count_only) {
+  TmpIndexBaseScope tmp_index_base_scope(*this);
   // have an Expr as input? Apply recursively ...
   if (expr_input_) {
     /// expand, then apply recursively to products
@@ -404,40 +936,58 @@ ExprPtr WickTheorem<S>::compute(const bool count_only) {
       canonicalize(expr_input_);
       assert(!expr_input_->as<Sum>().empty());
 
-      // parallelize over summands
-      auto result = std::make_shared<Sum>();
-      std::mutex result_mtx;  // serializes updates of result
+      // parallelize over summands; the tasks mutate (e.g. canonicalize) the
+      // summands and compute their hash values, hence the summands that
+      // share nodes are cloned first
       auto summands = expr_input_->as<Sum>().summands();
-
-      if (Logger::get_instance().wick_harness) std::wcout << "WickTheorem<S>::compute: input (after canonicalize) has " << summands.size() << " terms = " << to_latex_align(result) << std::endl;
-
-#ifdef SEQUANT_HAS_EXECUTION_HEADER
-      auto wick_task = [&result, &result_mtx, this,
-                        &count_only](const ExprPtr &input) {
-        WickTheorem wt(input->clone(), *this);
-        auto task_result = wt.compute(count_only);
-        stats() += wt.stats();
-        if (task_result) {
-          std::scoped_lock<std::mutex> lock(result_mtx);
-          result->append(task_result);
-        }
-      };
-      std::for_each(std::execution::par_unseq, begin(summands), end(summands),
-                    wick_task);
-#else
-      auto wick_task = [&summands, &result, &result_mtx, this,
+      detail::unshare(summands);
+
+      if (Logger::get_instance().wick_harness) std::wcout << "WickTheorem<S>::compute: input (after canonicalize) has " << summands.size() << " terms = " << to_latex_align(expr_input_) << std::endl;
+
+      // each task writes its result to its own slot (or to the accumulator
+      // that combines like terms), hence no serialization is needed;
+      // in the deterministic mode the results are accumulated in the order of
+      // summands, after all tasks complete
+      std::vector<ExprPtr> task_results;
+      std::unique_ptr<SumAccumulator> accumulator;
+      if (accumulate_like_terms_ && !deterministic())
+        accumulator = std::make_unique<SumAccumulator>();
+      else
+        task_results.resize(summands.size());
+      auto wick_task = [&summands, &task_results, &accumulator, this,
                         &count_only](size_t task_id) {
         auto &summand = summands[task_id];
-        WickTheorem wt(summand->clone(), *this);
+        // N.B. only the top node is copied, the subexpressions (not shared
+        // with other summands) are copied on write
+        WickTheorem wt(summand->shallow_clone(), *this);
         auto task_result = wt.compute(count_only);
         stats() += wt.stats();
         if (task_result) {
-          std::scoped_lock<std::mutex> lock(result_mtx);
-          result->append(task_result);
+          if (accumulator)
+            accumulator->insert(std::move(task_result));
+          else
+            task_results[task_id] = std::move(task_result);
         }
       };
+
+      // N.B. contractions of each summand may be distributed among threads
+      // also (see parallelize_contractions()), nested tasks share the pool
       parallel_for_each(wick_task, summands.size());
-#endif
+
+      if (accumulator) return accumulator->sum();
+      if (accumulate_like_terms_) {
+        SumAccumulator ordered_accumulator;
+        for (auto &&task_result : task_results) {
+          if (task_result) ordered_accumulator.insert(std::move(task_result));
+        }
+        return ordered_accumulator.sum();
+      }
+
+      // merge in the order of summands
+      auto result = make_expr<Sum>();
+      for (auto &&task_result : task_results) {
+        if (task_result) result->append(std::move(task_result));
+      }
 
       // if the sum is empty return zero
       // if the sum has 1 summand, return it directly
@@ -461,264 +1011,14 @@ ExprPtr WickTheorem<S>::compute(const bool count_only) {
       // if have ops, split into prefactor and op sequence
       if (first_nop_it != ranges::end(*expr_input_)) {
 
-        // compute and record/analyze topological NormalOperator and Index partitions
-        if (use_topology_) {
-
-          // construct graph representation of the tensor product
-          TensorNetwork tn(expr_input_->as<Product>().factors());
-          auto [graph, vlabels, vcolors, vtypes] = tn.make_bliss_graph();
-          const auto n = vlabels.size();
-          assert(vtypes.size() == n);
-          const auto& tn_edges = tn.edges();
-          const auto& tn_tensors = tn.tensors();
-
-          // identify vertex indices of NormalOperators and Indices
-          container::set<size_t> nop_vertex_idx;
-          container::set<size_t> index_vertex_idx;
-          {
-            const auto &nop_labels = NormalOperator<S>::labels();
-            const auto nop_labels_begin = begin(nop_labels);
-            const auto nop_labels_end = end(nop_labels);
-            for (size_t v = 0; v != n; ++v) {
-              if (vtypes[v] == TensorNetwork::VertexType::TensorCore &&
-                  (std::find(nop_labels_begin, nop_labels_end, vlabels[v]) !=
-                   nop_labels_end)) {
-                auto insertion_result = nop_vertex_idx.insert(v);
-                assert(insertion_result.second);
-              }
-              if (vtypes[v] == TensorNetwork::VertexType::Index) {
-                auto insertion_result = index_vertex_idx.insert(v);
-                assert(insertion_result.second);
-              }
-            }
-          }
-
-          // compute and save graph automorphism generators
-          std::vector<std::vector<unsigned int>> aut_generators;
-          {
-            bliss::Stats stats;
-            graph->set_splitting_heuristic(bliss::Graph::shs_fsm);
-
-            auto save_aut = [&aut_generators](const unsigned int n,
-                                              const unsigned int* aut) {
-              aut_generators.emplace_back(aut, aut + n);
-            };
-
-            graph->find_automorphisms(stats, &bliss::aut_hook<decltype(save_aut)>, &save_aut);
-          }
-
-          // use automorphisms to determine groups of topologically equivalent NormalOperators and Indices
-          // this partitions vertices into partitions (only nontrivial partitions are reported)
-          // vertex_pair_exclude is a callable that accepts 2 vertex indices and returns true if this pair of indices is to be excluded
-          // the default is to not exclude any pairs
-          auto compute_partitions = [&aut_generators](const container::set<size_t>& vertices,
-              auto&& vertex_pair_exclude) {
-            container::map<size_t, size_t> vertex_to_partition_idx;
-            int next_partition_idx = -1;
-
-            // using each automorphism generator
-            for (auto &&aut : aut_generators) {
-              // update partitions
-              for (const auto v1 : vertices) {
-                const auto v2 = aut[v1];
-                if (v2 != v1 && !vertex_pair_exclude(v1, v2)) {  // if the automorphism maps this vertex to another ... they both must be in the same partition
-                  assert(vertices.find(v2) != vertices.end());
-                  auto v1_partition_it = vertex_to_partition_idx.find(v1);
-                  auto v2_partition_it = vertex_to_partition_idx.find(v2);
-                  const bool v1_has_partition =
-                      v1_partition_it != vertex_to_partition_idx.end();
-                  const bool v2_has_partition =
-                      v2_partition_it != vertex_to_partition_idx.end();
-                  if (v1_has_partition &&
-                      v2_has_partition) {  // both are in partitions? make sure they are in the same partition. N.B. this may leave gaps in partition indices ... no biggie
-                    const auto v1_part_idx = v1_partition_it->second;
-                    const auto v2_part_idx = v2_partition_it->second;
-                    if (v1_part_idx !=
-                        v2_part_idx) {  // if they have different partition indices, change the larger of the two indices to match the lower
-                      const auto target_part_idx =
-                          std::min(v1_part_idx, v2_part_idx);
-                      for (auto &v : vertex_to_partition_idx) {
-                        if (v.second == v1_part_idx || v.second == v2_part_idx)
-                          v.second = target_part_idx;
-                      }
-                    }
-                  } else if (v1_has_partition) {  // only v1 is in a partition? place v2 in it
-                    const auto v1_part_idx = v1_partition_it->second;
-                    vertex_to_partition_idx.emplace(v2, v1_part_idx);
-                  } else if (v2_has_partition) {  // only v2 is in a partition? place v1 in it
-                    const auto v2_part_idx = v2_partition_it->second;
-                    vertex_to_partition_idx.emplace(v1, v2_part_idx);
-                  } else {  // neither is in a partition? place both in the next available partition
-                    const size_t target_part_idx = ++next_partition_idx;
-                    vertex_to_partition_idx.emplace(v1, target_part_idx);
-                    vertex_to_partition_idx.emplace(v2, target_part_idx);
-                  }
-                }
-              }
-            }
-            return std::make_tuple(vertex_to_partition_idx, next_partition_idx);
-          };
-
-          // compute NormalOperator->partition map, convert to partition lists (if any),
-          // and register via set_op_partitions to be used in full contractions
-          auto [nop_to_partition_idx, max_nop_partition_idx] = compute_partitions(nop_vertex_idx, [](size_t v1, size_t v2) { return false; });
-          if (!nop_to_partition_idx.empty()) {
-            container::vector<container::vector<size_t>> nop_partitions;
-
-            assert(max_nop_partition_idx > -1);
-            const size_t max_partition_index = max_nop_partition_idx;
-            nop_partitions.reserve(max_partition_index);
-            // iterate over all partition indices ... note that there may be gaps so count the actual partitions
-            size_t partition_cnt = 0;
-            for(size_t p=0; p<=max_partition_index; ++p) {
-              bool p_found = false;
-              for(const auto& nop_part: nop_to_partition_idx) {
-                if (nop_part.second == p) {
-                  // !!remember to map the vertex index into the operator index!!
-                  const auto nop_idx = nop_vertex_idx.find(nop_part.first) - nop_vertex_idx.begin();
-                  if (p_found == false) {  // first time this is found
-                    nop_partitions.emplace_back(container::vector<size_t>{static_cast<size_t>(nop_idx)});
-                  }
-                  else
-                    nop_partitions[partition_cnt].emplace_back(nop_idx);
-                  p_found = true;
-                }
-              }
-              if (p_found) ++partition_cnt;
-            }
-
-//            std::wcout << "topological nop partitions:{\n";
-//            ranges::for_each(nop_partitions, [](auto&& part) {
-//              std::wcout << "{";
-//              ranges::for_each(part, [](auto&& p) {
-//                std::wcout << p << " ";
-//              });
-//              std::wcout << "}";
-//            });
-//            std::wcout << "}" << std::endl;
-
-            this->set_op_partitions(nop_partitions);
-          }
-
-          // compute Index->partition map, and convert to partition lists (if any), and check that use_topology_ is compatible with index partitions
-          // Index partitions are constructed to *only* include Index objects attached to the bra/ket of the same NormalOperator!
-          // hence need to use filter in computing partitions
-          auto exclude_index_vertex_pair = [&tn_tensors,&tn_edges](size_t v1, size_t v2) {
-            // v1 and v2 are vertex indices and also index the edges in the TensorNetwork
-            assert(v1 < tn_edges.size());
-            assert(v2 < tn_edges.size());
-            const auto &edge1 = *(tn_edges.begin() + v1);
-            const auto &edge2 = *(tn_edges.begin() + v2);
-            auto connected_to_same_nop = [&tn_tensors](int term1, int term2) {
-              if (term1 == term2 && term1 != 0) {
-                auto tensor_idx = std::abs(term1) - 1;
-                const std::shared_ptr<AbstractTensor> &tensor_ptr =
-                    tn_tensors.at(tensor_idx);
-                if (std::dynamic_pointer_cast<NormalOperator<S>>(tensor_ptr))
-                  return true;
-              }
-              return false;
-            };
-            const bool exclude =
-                !(connected_to_same_nop(edge1.first(), edge2.first()) ||
-                  connected_to_same_nop(edge1.first(), edge2.second()) ||
-                  connected_to_same_nop(edge1.second(), edge2.first()) ||
-                  connected_to_same_nop(edge1.second(), edge2.second()));
-            return exclude;
-          };
-          container::map<size_t, size_t> index_to_partition_idx;
-          int max_index_partition_idx;
-          std::tie(index_to_partition_idx, max_index_partition_idx) = compute_partitions(index_vertex_idx, exclude_index_vertex_pair);
-          {
-            // use_topology_=true in full contractions will assume that all
-            // equivalent indices in NormalOperator's bra or ket are topologically
-            // equivalent (see Hugenholtz vertex and associated code)
-            // here we make sure that this is indeed the case
-            assert(use_topology_);  // since we are here, use_topology_ is true
-            // this reports whether bra/ket of tensor @c t is in the same partition
-            auto is_nop_braket_singlepartition = [&tn_edges,&index_to_partition_idx](auto&& tensor_ptr, BraKetPos bkpos) {
-              auto expr_ptr = std::dynamic_pointer_cast<Expr>(tensor_ptr);
-              assert(expr_ptr);
-              auto bkrange = bkpos == BraKetPos::bra ? bra(*tensor_ptr) : ket(*tensor_ptr);
-              assert(ranges::size(bkrange) > 1);
-              int partition = -1;  // will be set to the actual partition index
-              for(auto&& idx: bkrange) {
-                auto idx_full_label = idx.full_label();
-                auto edge_it = tn_edges.find(idx_full_label);
-                assert(edge_it != tn_edges.end());
-                auto vertex = edge_it - tn_edges.begin();  // vertex idx for this Index
-                auto idx_part_it = index_to_partition_idx.find(vertex);
-                if (idx_part_it != index_to_partition_idx.end()) {  // is part of a partition
-                  if (partition == -1)               // first index
-                    partition = idx_part_it->second;
-                  else if (partition != idx_part_it->second)  // compare to the first index's partition #
-                    return false;
-                }
-                else  // not part of a partition? fail
-                  return false;
-              }
-              return true;
-            };
-            bool multipartition_nop_braket = false;
-            for(auto&& tensor: tn_tensors) {
-              auto nop_ptr = std::dynamic_pointer_cast<NormalOperator<S>>(tensor);
-              if (nop_ptr) {  // if NormalOperator<S>
-
-                auto make_logic_error =[&nop_ptr](BraKetPos pos) {
-                  std::basic_stringstream<wchar_t> oss;
-                  oss << "WickTheorem<S>::use_topology is true but NormalOperator "
-                      << nop_ptr->to_latex() << " has "
-                      << (pos == BraKetPos::bra ? "bra" : "ket")
-                      << " whose indices are not topologically equivalent";
-                  return std::invalid_argument(to_string(oss.str()));
-                };
-
-                auto brank = bra_rank(*tensor);
-                if (brank > 1) {
-                  if (!is_nop_braket_singlepartition(tensor, BraKetPos::bra))
-                    multipartition_nop_braket = true;
-                }
-                if (multipartition_nop_braket)
-                  throw make_logic_error(BraKetPos::bra);
-
-                auto krank = ket_rank(*tensor);
-                if (krank > 1) {
-                  if (!is_nop_braket_singlepartition(tensor, BraKetPos::ket))
-                    multipartition_nop_braket = true;
-                }
-                if (multipartition_nop_braket)
-                  throw make_logic_error(BraKetPos::ket);
-              }
-            }
-
-          }
-        }
-
-        ExprPtr prefactor =
-            ex<CProduct>(expr_input_->as<Product>().scalar(), ExprPtrList{});
-        bool found_op = false;
-        ranges::for_each(
-            *expr_input_, [this, &found_op, &prefactor](const ExprPtr &factor) {
-              if (factor->is<NormalOperator<S>>()) {
-                input_.push_back(factor->as<NormalOperator<S>>());
-                found_op = true;
-              } else {
-                assert(factor->is_cnumber());
-                assert(!found_op);  // make sure that ops are at the end
-                *prefactor *= *factor;
-              }
-            });
+        auto prefactor = init_input_from_product();
+        if (!prefactor)  // screened out
+          return ex<Constant>(0);
         if (!input_.empty()) {
           auto result = compute_nopseq(count_only);
           if (result) {  // simplify if obtained nonzero ...
             result = prefactor * result;
-            expand(result);
-            this->reduce(result);
-            rapid_simplify(result);
-            canonicalize(result);
-            rapid_simplify(
-                result);  // rapid_simplify again since canonization may produce
-                          // new opportunities (e.g. terms cancel, etc.)
+            simplify_result(result);
           } else
             result = ex<Constant>(0);
           return result;
@@ -740,6 +1040,91 @@ ExprPtr WickTheorem<S>::compute(const bool count_only) {
   abort();
 }
 
+template <Statistics S>
+void WickTheorem<S>::compute_streaming(const term_sink_type &sink) {
+  TmpIndexBaseScope tmp_index_base_scope(*this);
+  std::mutex sink_mtx;
+  compute_streaming_impl([&sink, &sink_mtx](ExprPtr term) {
+    std::scoped_lock<std::mutex> lock(sink_mtx);
+    sink(std::move(term));
+  });
+}
+
+template <Statistics S>
+void WickTheorem<S>::compute_streaming_impl(const term_sink_type &sink) {
+  auto is_zero = [](const ExprPtr &term) {
+    return term->is<Constant>() && term->as<Constant>().is_zero();
+  };
+
+  // have an Expr as input? Apply recursively ...
+  if (expr_input_) {
+    expand(expr_input_);
+    // if sum, canonicalize and apply to each summand ...
+    if (expr_input_->is<Sum>()) {
+      canonicalize(expr_input_);
+      auto summands = expr_input_->as<Sum>().summands();
+      detail::unshare(summands);  // tasks must not mutate shared nodes
+      auto wick_task = [&summands, &sink, this](size_t task_id) {
+        WickTheorem wt(summands[task_id]->shallow_clone(), *this);
+        wt.compute_streaming_impl(sink);
+        stats() += wt.stats();
+      };
+      parallel_for_each(wick_task, summands.size());
+      return;
+    }
+    // ... else if a product, find NormalOperatorSequence, if any, and stream
+    // its simplified terms
+    else if (expr_input_->is<Product>()) {
+      expr_input_->rapid_canonicalize();
+      const bool have_ops = ranges::any_of(*expr_input_, [](const ExprPtr &expr) {
+        return expr->is<NormalOperator<S>>();
+      });
+      if (!have_ops) {  // product does not include ops
+        if (!is_zero(expr_input_)) sink(expr_input_);
+        return;
+      }
+      auto prefactor = init_input_from_product();
+      if (!prefactor)  // screened out
+        return;
+      init_nopseq();
+      compute_nontensor_wick(
+          false, [this, &prefactor, &sink, &is_zero](
+                     Product &&sp, std::shared_ptr<NormalOperator<S>> &&nop) {
+            auto term =
+                prefactor->clone() * make_term(std::move(sp), std::move(nop));
+            simplify_result(term);
+            if (!is_zero(term)) sink(std::move(term));
+          });
+      return;
+    }
+    // ... else if NormalOperatorSequence already, stream its terms ...
+    else if (expr_input_->is<NormalOperatorSequence<S>>()) {
+      input_ = expr_input_->as<NormalOperatorSequence<S>>();
+    } else {  // ... else do nothing
+      if (!is_zero(expr_input_)) sink(expr_input_);
+      return;
+    }
+  }
+
+  init_nopseq();
+  compute_nontensor_wick(
+      false,
+      [&sink](Product &&sp, std::shared_ptr<NormalOperator<S>> &&nop) {
+        sink(make_term(std::move(sp), std::move(nop)));
+      });
+}
+
+template <Statistics S>
+void WickTheorem<S>::simplify_result(ExprPtr &expr) const {
+  expand(expr);
+  Stats::time(stats_.time_reduce_ns, [&]() { this->reduce(expr); });
+  Stats::time(stats_.time_rapid_simplify_ns, [&]() { rapid_simplify(expr); });
+  Stats::time(stats_.time_canonicalize_ns, [&]() { canonicalize(expr); });
+  // rapid_simplify again since canonization may produce new opportunities
+  // (e.g. terms cancel, etc.)
+  Stats::time(stats_.time_rapid_simplify_ns, [&]() { rapid_simplify(expr); });
+}
+
 template <Statistics S>
 void WickTheorem<S>::reduce(ExprPtr &expr) const {
   // there are 2 possibilities: expr is a single Product, or it's a Sum of
@@ -750,7 +1135,7 @@ void WickTheorem<S>::reduce(ExprPtr &expr) const {
       detail::reduce_wick_impl(expr_cast, external_indices_);
       expr = expr_cast;
     } catch (detail::zero_result &) {
-      expr = std::make_shared<Constant>(0);
+      expr = make_expr<Constant>(0);
     }
   } else {
     assert(expr->type_id() == Expr::get_type_id<Sum>());
@@ -762,7 +1147,7 @@ void WickTheorem<S>::reduce(ExprPtr &expr) const {
         subexpr = subexpr_cast;
       }
       catch (detail::zero_result &) {
-        subexpr = std::make_shared<Constant>(0);
+        subexpr = make_expr<Constant>(0);
       }
     }
   }
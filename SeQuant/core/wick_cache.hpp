@@ -0,0 +1,390 @@
+#ifndef SEQUANT_WICK_CACHE_HPP
+#define SEQUANT_WICK_CACHE_HPP
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <boost/locale/encoding_utf.hpp>
+
+#include "container.hpp"
+#include "index.hpp"
+#include "op.hpp"
+#include "tensor.hpp"
+#include "utility.hpp"
+
+namespace sequant {
+
+/// @brief Process-wide memo cache of WickTheorem results.
+///
+/// Maps the label-independent description of a WickTheorem problem (the
+/// NormalOperatorSequence with indices replaced by their ordinals in the
+/// sequence, and the connectivity/partition constraints) to the result
+/// encoded with respect to the same index ordinals. Hence a result
+/// computed for one NormalOperatorSequence is reused for any other sequence
+/// that differs only by the index labels. Both keys and values are compact
+/// strings, hence the cache can be backed by a file that persists it across
+/// runs (see WickCache::set_backing_store()).
+///
+/// The keys and values refer to IndexSpace objects by their attributes, hence
+/// the entries are only valid for the same registry of IndexSpace objects.
+/// The backing store therefore consists of sections, each starting with a
+/// header line that records the format version and
+/// IndexSpace::registry_fingerprint() of its entries; only the entries of the
+/// sections that match the current registry are loaded.
+/// @note all member functions are reentrant
+class WickCache {
+ public:
+  /// @return reference to the cache instance
+  static WickCache &instance() {
+    static WickCache cache;
+    return cache;
+  }
+
+  WickCache(const WickCache &) = delete;
+  WickCache &operator=(const WickCache &) = delete;
+
+  /// writes the pending entries to the backing store, if any
+  ~WickCache() { flush(); }
+
+  /// @param key a key
+  /// @return the value associated with @p key, if any
+  std::optional<std::wstring> find(const std::wstring &key) const {
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    auto it = map_.find(key);
+    if (it != map_.end()) {
+      ++nhits_;
+      return it->second;
+    }
+    ++nmisses_;
+    return std::nullopt;
+  }
+
+  /// associates @p value with @p key (replacing the current value, if any);
+  /// if the cache has a backing store, the new entry is appended to it
+  /// @param key a key
+  /// @param value a value
+  /// @note the new entries are written to the backing store in batches (see
+  ///       flush()), outside of the lock of the map
+  void insert(const std::wstring &key, const std::wstring &value) {
+    {
+      std::unique_lock<std::shared_mutex> lock(mtx_);
+      auto [it, inserted] = map_.try_emplace(key, value);
+      if (!inserted) {
+        if (it->second == value) return;
+        it->second = value;
+      }
+    }
+    std::scoped_lock lock(store_mtx_);
+    if (!store_.is_open()) return;
+    pending_ += to_string(key);
+    pending_ += '\t';
+    pending_ += to_string(value);
+    pending_ += '\n';
+    if (pending_.size() >= store_batch_size) write_pending();
+  }
+
+  /// writes the pending entries to the backing store, if any
+  void flush() {
+    std::scoped_lock lock(store_mtx_);
+    write_pending();
+    if (store_.is_open()) store_.flush();
+  }
+
+  /// Loads the entries from file @p filename (if it exists), and makes
+  /// it the backing store, i.e. all subsequent insertions will be appended to
+  /// it; the pending entries are written to the previous backing store
+  /// @param filename the name of the file; if empty, the backing store is
+  ///        detached
+  /// @note the entries written with a different format version or for a
+  ///       different registry of IndexSpace objects are ignored
+  void set_backing_store(const std::string &filename) {
+    std::unique_lock<std::shared_mutex> lock(mtx_);
+    std::scoped_lock store_lock(store_mtx_);
+    write_pending();
+    if (store_.is_open()) store_.close();
+    store_header_.clear();
+    if (filename.empty()) return;
+    std::ifstream ifs(filename);
+    const auto header = make_store_header();
+    bool valid_section = false;
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (!line.empty() && line[0] == '#') {
+        valid_section = line == header;
+        continue;
+      }
+      if (!valid_section) continue;
+      const auto tab_pos = line.find('\t');
+      if (tab_pos == std::string::npos) continue;  // skip malformed entries
+      using boost::locale::conv::utf_to_utf;
+      map_.emplace(utf_to_utf<wchar_t>(line.substr(0, tab_pos)),
+                   utf_to_utf<wchar_t>(line.substr(tab_pos + 1)));
+    }
+    ifs.close();
+    store_.open(filename, std::ios::app);
+  }
+
+  /// @return the number of entries
+  std::size_t size() const {
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    return map_.size();
+  }
+
+  /// @return the number of successful lookups
+  std::size_t nhits() const { return nhits_; }
+  /// @return the number of unsuccessful lookups
+  std::size_t nmisses() const { return nmisses_; }
+
+  /// removes all entries (but does not touch the backing store)
+  void clear() {
+    std::unique_lock<std::shared_mutex> lock(mtx_);
+    map_.clear();
+    nhits_ = 0;
+    nmisses_ = 0;
+  }
+
+ private:
+  WickCache() = default;
+
+  mutable std::shared_mutex mtx_;
+  std::unordered_map<std::wstring, std::wstring> map_;
+
+  /// the pending entries are written when they exceed this many bytes
+  static constexpr std::size_t store_batch_size = 1 << 16;
+  /// the version of the format of the entries
+  static constexpr int store_format_version = 1;
+  std::mutex store_mtx_;      //!< guards store_, store_header_, and pending_
+  std::ofstream store_;       //!< the backing store, kept open
+  std::string store_header_;  //!< the header of the last section of store_
+  std::string pending_;       //!< the entries not yet written to store_
+
+  /// @return the header line of the sections of the backing store whose
+  /// entries are valid in the current state
+  static std::string make_store_header() {
+    return "# sequant::WickCache v" + std::to_string(store_format_version) +
+           " " + to_string(IndexSpace::registry_fingerprint());
+  }
+
+  /// writes pending_ to store_ , starting a new section if the registry of
+  /// IndexSpace objects changed since the last write; store_mtx_ must be held
+  void write_pending() {
+    if (!pending_.empty() && store_.is_open()) {
+      auto header = make_store_header();
+      if (header != store_header_) {
+        store_ << header << '\n';
+        store_header_ = std::move(header);
+      }
+      store_ << pending_;
+    }
+    pending_.clear();
+  }
+  mutable std::atomic<std::size_t> nhits_ = 0;
+  mutable std::atomic<std::size_t> nmisses_ = 0;
+};
+
+namespace detail {
+
+/// encodes/decodes WickTheorem results for WickCache
+
+/// Indices that belong to the input are encoded by their ordinals in the input,
+/// other (i.e. temporary) indices are encoded by the order of appearance and
+/// their space
+/// @tparam S particle statistics
+template <Statistics S>
+class WickCacheCodec {
+ public:
+  /// @param input_indices the list of input indices; ordinals of this list are
+  ///        used to encode them
+  /// @param tmp_index_namespace if nonempty, creates the temporary indices of
+  ///        the decoded expressions, else they are created via
+  ///        Index::make_tmp_index()
+  explicit WickCacheCodec(
+      container::svector<Index> input_indices,
+      std::optional<TmpIndexNamespace> tmp_index_namespace = std::nullopt)
+      : input_indices_(std::move(input_indices)),
+        tmp_index_namespace_(std::move(tmp_index_namespace)) {}
+
+  /// @param expr the expression to encode
+  /// @return encoded @p expr , or nullopt if it contains objects that cannot be
+  ///         encoded
+  std::optional<std::wstring> encode(const ExprPtr &expr) {
+    std::wostringstream oss;
+    oss << std::setprecision(17);
+    tmp_indices_.clear();
+    if (encode(oss, expr)) return oss.str();
+    return std::nullopt;
+  }
+
+  /// @param str encoded expression, as produced by encode()
+  /// @return the decoded expression, or nullptr if @p str is not a valid
+  ///         encoded expression (e.g. a corrupt entry of the backing store);
+  ///         temporary indices are replaced by new temporary indices
+  ExprPtr decode(const std::wstring &str) {
+    std::wistringstream iss(str);
+    tmp_indices_.clear();
+    auto result = decode(iss);
+    // reject trailing garbage
+    if (result && !(iss >> std::ws).eof()) return nullptr;
+    return result;
+  }
+
+ private:
+  container::svector<Index> input_indices_;
+  container::svector<Index> tmp_indices_;
+  std::optional<TmpIndexNamespace> tmp_index_namespace_;
+
+  bool encode(std::wostream &os, const Index &idx) {
+    if (idx.has_proto_indices()) return false;
+    auto it = ranges::find(input_indices_, idx);
+    if (it != ranges::end(input_indices_)) {
+      os << L" k" << (it - ranges::begin(input_indices_));
+      return true;
+    }
+    auto tmp_it = ranges::find(tmp_indices_, idx);
+    const auto attr = idx.space().attr();
+    os << L" t" << (tmp_it - ranges::begin(tmp_indices_)) << L" "
+       << attr.type().to_int32() << L" " << attr.qns().to_int32();
+    if (tmp_it == ranges::end(tmp_indices_)) tmp_indices_.push_back(idx);
+    return true;
+  }
+
+  bool encode(std::wostream &os, const ExprPtr &expr) {
+    if (expr->is<Constant>()) {
+      const auto v = expr->as<Constant>().value();
+      os << L" C " << v.real() << L" " << v.imag();
+    } else if (expr->is<Product>()) {
+      const auto &product = expr->as<Product>();
+      os << L" P " << product.scalar().real() << L" " << product.scalar().imag()
+         << L" " << product.factors().size();
+      for (auto &&factor : product.factors())
+        if (!encode(os, factor)) return false;
+    } else if (expr->is<Sum>()) {
+      os << L" S " << expr->as<Sum>().size();
+      for (auto &&summand : expr->as<Sum>().summands())
+        if (!encode(os, summand)) return false;
+    } else if (expr->is<Tensor>()) {
+      const auto &tensor = expr->as<Tensor>();
+      if (tensor.label() != overlap_label()) return false;
+      os << L" s";
+      if (!encode(os, tensor.bra().at(0))) return false;
+      if (!encode(os, tensor.ket().at(0))) return false;
+    } else if (expr->is<NormalOperator<S>>()) {
+      const auto &nop = expr->as<NormalOperator<S>>();
+      os << L" N " << static_cast<int>(nop.vacuum()) << L" "
+         << nop.ncreators() << L" " << nop.size();
+      for (auto &&op : nop)
+        if (!encode(os, op.index())) return false;
+    } else
+      return false;
+    return true;
+  }
+
+  /// @return the decoded Index, or nullopt if @p is does not start with a
+  ///         valid encoded Index
+  std::optional<Index> decode_index(std::wistream &is) {
+    wchar_t type;
+    std::size_t ord;
+    if (!(is >> type >> ord)) return std::nullopt;
+    if (type == L'k') {
+      if (ord >= input_indices_.size()) return std::nullopt;
+      return input_indices_[ord];
+    }
+    if (type != L't') return std::nullopt;
+    int32_t space_type, space_qns;
+    if (!(is >> space_type >> space_qns)) return std::nullopt;
+    if (ord > tmp_indices_.size()) return std::nullopt;
+    if (ord == tmp_indices_.size()) {
+      const IndexSpace *space;
+      try {
+        space = &IndexSpace::instance(IndexSpace::Attr(space_type, space_qns));
+      } catch (const std::invalid_argument &) {  // bad_attr or bad_key
+        return std::nullopt;
+      }
+      tmp_indices_.push_back(tmp_index_namespace_
+                                 ? tmp_index_namespace_->make(*space)
+                                 : Index::make_tmp_index(*space));
+    }
+    return tmp_indices_[ord];
+  }
+
+  /// @return the decoded expression, or nullptr if @p is does not start with
+  ///         a valid encoded expression
+  ExprPtr decode(std::wistream &is) {
+    wchar_t type;
+    if (!(is >> type)) return nullptr;
+    switch (type) {
+      case L'C': {
+        double re, im;
+        if (!(is >> re >> im)) return nullptr;
+        return ex<Constant>(std::complex<double>{re, im});
+      }
+      case L'P': {
+        double re, im;
+        std::size_t nfactors;
+        if (!(is >> re >> im >> nfactors)) return nullptr;
+        auto result = make_expr<Product>();
+        result->scale(std::complex<double>{re, im});
+        for (std::size_t f = 0; f != nfactors; ++f) {
+          auto factor = decode(is);
+          if (!factor) return nullptr;
+          result->append(1, factor);
+        }
+        return result;
+      }
+      case L'S': {
+        std::size_t nsummands;
+        if (!(is >> nsummands)) return nullptr;
+        auto result = make_expr<Sum>();
+        for (std::size_t s = 0; s != nsummands; ++s) {
+          auto summand = decode(is);
+          if (!summand) return nullptr;
+          result->append(summand);
+        }
+        return result;
+      }
+      case L's': {
+        auto bra = decode_index(is);
+        if (!bra) return nullptr;
+        auto ket = decode_index(is);
+        if (!ket) return nullptr;
+        return make_overlap(*bra, *ket);
+      }
+      case L'N': {
+        int vacuum;
+        std::size_t ncreators, nops;
+        if (!(is >> vacuum >> ncreators >> nops)) return nullptr;
+        if (vacuum < static_cast<int>(Vacuum::Physical) ||
+            vacuum >= static_cast<int>(Vacuum::Invalid) || ncreators > nops)
+          return nullptr;
+        container::svector<Op<S>> creators, annihilators;
+        for (std::size_t o = 0; o != nops; ++o) {
+          auto idx = decode_index(is);
+          if (!idx) return nullptr;
+          if (o < ncreators)
+            creators.emplace_back(std::move(*idx), Action::create);
+          else
+            annihilators.emplace_back(std::move(*idx), Action::annihilate);
+        }
+        // NormalOperator stores annihilators in reverse order
+        ranges::reverse(annihilators);
+        return ex<NormalOperator<S>>(creators, annihilators,
+                                     static_cast<Vacuum>(vacuum));
+      }
+      default:
+        return nullptr;
+    }
+  }
+};
+
+}  // namespace detail
+
+}  // namespace sequant
+
+#endif  // SEQUANT_WICK_CACHE_HPP
@@ -136,10 +136,8 @@ ExprPtr vac_av(ExprPtr expr, std::initializer_list<std::pair<int,int>> op_connec
   auto result = wick.compute();
   simplify(result);
   if (Logger::get_instance().wick_stats) {
-    std::wcout << "WickTheorem stats: # of contractions attempted = "
-               << wick.stats().num_attempted_contractions
-               << " # of useful contractions = "
-               << wick.stats().num_useful_contractions << std::endl;
+    std::wcout << "WickTheorem stats: "
+               << wick.stats().to_json().c_str() << std::endl;
   }
   return result;
 }
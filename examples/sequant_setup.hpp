@@ -32,8 +32,10 @@ using ispace_map =
 
 namespace {
 
-/// computes VEV for A(P)*H*T(N)^K using excitation level screening (unless @c
-/// screen is set) + computes only canonical (with T ranks increasing) terms
+/// computes VEV for A(P)*H*T(N)^K, computing only canonical (with T ranks
+/// increasing) terms (unless @c screen is not set)
+/// @note the terms that vanish because their excitation levels cannot be
+/// balanced are screened out by WickTheorem itself
 
 class screened_vac_av {
  private:
@@ -59,34 +61,19 @@ class screened_vac_av {
     assert(input->is<Sum>());
     auto input_sum = input->as<Sum>();
 
-    // this will collect all canonical nonzero terms
+    // this will collect all canonical terms
     SumPtr screened_input = std::make_shared<Sum>();
     for (auto&& term : input_sum.summands()) {
       assert(term->is<Product>());
       auto& term_prod = term->as<Product>();
       assert(term_prod.factors().size() == 4 + 2 * K);
 
-      // locate projector
-      assert(term_prod.factor(0)->is<Tensor>());
-      assert(term_prod.factor(0)->as<Tensor>().label() == L"A");
-      const int P = term_prod.factor(0)->as<Tensor>().rank();
-
-      // locate Hamiltonian
-      assert(term_prod.factor(2)->is<Tensor>());
-      auto hlabel = term_prod.factor(2)->as<Tensor>().label();
-      assert(hlabel == L"f" || hlabel == L"g");
-      const int R = term_prod.factor(2)->as<Tensor>().rank();
-      const int max_exlev_R = R - K;  // at least K lines must point down
-
-      auto exlev = -P;
-
       bool canonical = true;
       // number of possible permutations within same-rank partitions of T
       // number of possible permutations other than these
       // degeneracy = M1! M2! .. where M1, M2 ... are sizes of each partition
       double degeneracy =
           canonical_only ? boost::math::factorial<double>(K) : 1;
-      int total_T_rank = 0;
       int prev_rank = 0;
       int current_partition_size =
           1;  // size of current same-rank partition of T
@@ -94,9 +81,7 @@ class screened_vac_av {
         auto p = 4 + k * 2;
         assert(term_prod.factor(p)->is<Tensor>());
         assert(term_prod.factor(p)->as<Tensor>().label() == L"t");
-        const auto current_rank = term_prod.factor(p)->as<Tensor>().rank();
-        exlev += current_rank;
-        total_T_rank += current_rank;
+        const int current_rank = term_prod.factor(p)->as<Tensor>().rank();
         // screen out the noncanonical terms, if needed
         if (canonical_only) {
           if (current_rank < prev_rank)  // if T ranks are not increasing, omit
@@ -118,16 +103,10 @@ class screened_vac_av {
       if (canonical_only)
         degeneracy /= boost::math::factorial<double>(
             current_partition_size);  // account for the last partition
-      const int min_exlev_R = std::max(
-          -R,
-          R - 2 * total_T_rank);  // at most 2*total_T_rank lines can point down
 
       if (canonical || !canonical_only) {
-        if (exlev + min_exlev_R <= 0 && 0 <= exlev + max_exlev_R) {  // VEV != 0
-          assert(min_exlev_R <= max_exlev_R);
-          screened_input->append(
-              degeneracy == 1 ? term : ex<Constant>(degeneracy) * term);
-        }
+        screened_input->append(
+            degeneracy == 1 ? term : ex<Constant>(degeneracy) * term);
       }
     }  // term loop
 
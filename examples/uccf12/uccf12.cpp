@@ -22,8 +22,6 @@ int main(int argc, char* argv[]) {
 
   TensorCanonicalizer::register_instance(
       std::make_shared<DefaultTensorCanonicalizer>());
-  // WARNING some code is not thread safe ...
-  //set_num_threads(1);
 
   try {
     try_main();
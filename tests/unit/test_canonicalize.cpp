@@ -2,6 +2,7 @@
 
 #include "SeQuant/core/expr.hpp"
 #include "SeQuant/core/expr_algorithm.hpp"
+#include "SeQuant/core/runtime.hpp"
 #include "SeQuant/core/tensor.hpp"
 #include "catch.hpp"
 
@@ -265,4 +266,76 @@ TEST_CASE("Canonicalizer", "[algorithms]") {
       }
     }
   }
-}
\ No newline at end of file
+
+  SECTION("Sums (parallel)") {
+    RuntimeSettingsScope runtime_settings;
+    Logger::get_instance().canonicalize = false;
+
+    // sum of products with permuted dummy indices
+    auto make_input = [] {
+      container::svector<ExprPtr> summands;
+      for (int i = 0; i != 32; ++i) {
+        const auto j = L"i_" + std::to_wstring(3 + i % 4);
+        const auto k = L"i_" + std::to_wstring(7 + i % 3);
+        summands.push_back(
+            ex<Constant>(i % 5 + 1) *
+            ex<Tensor>(L"g", WstrList{j, k}, WstrList{L"a_1", L"a_2"},
+                       Symmetry::antisymm) *
+            ex<Tensor>(L"t", WstrList{L"a_1", L"a_2"},
+                       (i % 2 == 0) ? WstrList{j, k} : WstrList{k, j},
+                       Symmetry::antisymm));
+      }
+      return ex<Sum>(summands.begin(), summands.end());
+    };
+    set_num_threads(1);
+    auto input_serial = make_input();
+    canonicalize(input_serial);
+    set_num_threads(4);
+    auto input_parallel = make_input();
+    canonicalize(input_parallel);
+    REQUIRE(to_latex(input_parallel) == to_latex(input_serial));
+
+    // summands that share a node are canonicalized independently
+    {
+      auto term = ex<Constant>(2) *
+                  ex<Tensor>(L"g", WstrList{L"i_3", L"i_4"},
+                             WstrList{L"a_3", L"a_4"}, Symmetry::antisymm) *
+                  ex<Tensor>(L"t", WstrList{L"a_3", L"a_4"},
+                             WstrList{L"i_3", L"i_4"}, Symmetry::antisymm);
+      auto input = ex<Sum>(ExprPtrList{term, term});
+      canonicalize(input);
+      REQUIRE(input->size() == 1);
+      const auto &summand = input->as<Sum>().summands()[0];
+      REQUIRE(summand->is<Product>());
+      REQUIRE(summand->as<Product>().scalar() == 4.0);
+    }
+  }
+
+  SECTION("Sums (screened)") {
+    RuntimeSettingsScope runtime_settings;
+    auto make_input = [] {
+      auto term = [](std::wstring g, std::wstring a1, std::wstring a2) {
+        return ex<Tensor>(g, WstrList{L"i_3", L"i_4"}, WstrList{a1, a2},
+                          Symmetry::antisymm) *
+               ex<Tensor>(L"t", WstrList{a1, a2}, WstrList{L"i_3", L"i_4"},
+                          Symmetry::antisymm);
+      };
+      // the first two summands are like terms, the last one is unique
+      return ex<Sum>(ExprPtrList{term(L"g", L"a_1", L"a_2"),
+                                 term(L"g", L"a_3", L"a_4"),
+                                 term(L"f", L"a_1", L"a_2")});
+    };
+    for (const bool screen : {false, true}) {
+      Sum::set_screen_unique_summands(screen);
+      auto input = make_input();
+      canonicalize(input);
+      REQUIRE(input->size() == 2);
+      const auto nlike = ranges::count_if(
+          input->as<Sum>().summands(), [](const ExprPtr &summand) {
+            return summand->is<Product>() &&
+                   summand->as<Product>().scalar() == 2.0;
+          });
+      REQUIRE(nlike == 1);
+    }
+  }
+}
@@ -6,6 +6,7 @@
 
 #include <iostream>
 #include "SeQuant/core/hash.hpp"
+#include "SeQuant/core/sum_accumulator.hpp"
 #include "SeQuant/core/wick.hpp"
 
 struct Dummy : public sequant::Expr {
@@ -506,6 +507,145 @@ TEST_CASE("Expr", "[elements]") {
               L"{\\text{Dummy}}{\\text{Dummy}}} - {{{2}}"
               L"{\\text{Dummy}}{\\text{Dummy}}}\\bigr) }");
     }
+    {  // lazy expansion produces the terms of expand() one at a time
+      auto x = ex<Constant>(2.0) * (ex<Constant>(1.0) + ex<Dummy>()) *
+               ex<Dummy>() * (ex<Constant>(3.0) + ex<Dummy>());
+      expand_range terms(x);
+      REQUIRE(terms.has_sums());
+      REQUIRE(terms.size() == 4);
+      container::svector<ExprPtr> lazy_terms;
+      for (auto &&term : terms) {
+        REQUIRE(term->is<Product>());
+        lazy_terms.push_back(term);
+      }
+      REQUIRE(lazy_terms.size() == 4);
+      expand(x);
+      REQUIRE(to_latex(ex<Sum>(lazy_terms.begin(), lazy_terms.end())) ==
+              to_latex(x));
+      for (std::size_t t = 0; t != terms.size(); ++t)
+        REQUIRE(to_latex(terms[t]) == to_latex(lazy_terms[t]));
+    }
+    {  // parallel expansion produces the same result as serial expansion
+      RuntimeSettingsScope runtime_settings;
+      // a Product of 10 Sums = 1024 terms
+      auto make_product = [](std::wstring label) {
+        auto x = ex<Constant>(2.0);
+        for (int i = 1; i <= 10; ++i) {
+          const auto idx = L"i_" + std::to_wstring(i);
+          x = x * (ex<Tensor>(label, WstrList{idx}, WstrList{}) +
+                   ex<Tensor>(L"f", WstrList{idx}, WstrList{}));
+        }
+        return x;
+      };
+      auto make_input = [&make_product]() {
+        auto p = make_product(L"t");
+        return ex<Sum>(ExprPtrList{p, make_product(L"g"), p});
+      };
+      set_num_threads(1);
+      auto x_serial = make_input();
+      expand(x_serial);
+      rapid_simplify(x_serial);
+      set_num_threads(4);
+      auto x_parallel = make_input();
+      expand(x_parallel, /* parallel = */ true);
+      rapid_simplify(x_parallel, /* parallel = */ true);
+      REQUIRE(x_parallel->size() == 3 * 1024);
+      REQUIRE(to_latex(x_parallel) == to_latex(x_serial));
+    }
+  }
+
+  SECTION("copy-on-write") {
+    auto f = ex<Tensor>(L"F", WstrList{L"a_5"}, WstrList{L"i_1"});
+    auto t = ex<Tensor>(L"t", WstrList{L"i_1"}, WstrList{L"a_5"});
+    auto s = ex<Tensor>(L"s", WstrList{L"i_1"}, WstrList{L"a_5"});
+
+    // shallow copies share the subexpressions
+    {
+      auto p = ex<Product>(ExprPtrList{f, t});
+      auto p_copy = p->shallow_clone();
+      REQUIRE(p_copy != p);
+      REQUIRE(*p_copy == *p);
+      REQUIRE(p_copy->as<Product>().factor(0) == f);
+    }
+
+    // detach() copies shared expressions only
+    {
+      ExprPtr x = f;
+      detach(x);
+      REQUIRE(x != f);
+      REQUIRE(*x == *f);
+      const auto *x_ptr = x.get();
+      detach(x);
+      REQUIRE(x.get() == x_ptr);
+    }
+
+    // expanded terms share the unexpanded factors, which are copied on write
+    {
+      const auto f_latex = to_latex(f);
+      auto x = f * (t + s);
+      expand(x);
+      REQUIRE(x->is<Sum>());
+      REQUIRE(x->size() == 2);
+      REQUIRE((*x)[0]->as<Product>().factor(0) == f);
+      REQUIRE((*x)[1]->as<Product>().factor(0) == f);
+      TensorCanonicalizer::register_instance(
+          std::make_shared<DefaultTensorCanonicalizer>());
+      canonicalize(x);
+      REQUIRE(to_latex(f) == f_latex);
+    }
+
+    // unshare() clones the expressions that share nodes with the preceding
+    // ones, including shared atoms
+    {
+      container::svector<ExprPtr> exprs{f * t, f * s, t * s};
+      const auto latex = to_latex(ex<Sum>(exprs.begin(), exprs.end()));
+      detail::unshare(exprs);
+      REQUIRE(exprs[0]->as<Product>().factor(0) == f);
+      REQUIRE(exprs[0]->as<Product>().factor(1) == t);
+      REQUIRE(exprs[1]->as<Product>().factor(0) != f);
+      REQUIRE(exprs[2]->as<Product>().factor(0) != t);
+      REQUIRE(exprs[2]->as<Product>().factor(1) != s);
+      REQUIRE(to_latex(ex<Sum>(exprs.begin(), exprs.end())) == latex);
+    }
+
+    // mutating an expanded term (and its shared factor) leaves its siblings
+    // unchanged
+    {
+      auto x = f * (t + s);
+      expand(x);
+      REQUIRE(x->size() == 2);
+      const auto f_latex = to_latex(f);
+      const auto sibling_latex = to_latex((*x)[1]);
+      auto &term = detach((*x)[0]).as<Product>();
+      term.scale(2);
+      for (auto &factor : term) {
+        if (factor == f)
+          detach(factor).as<Tensor>().transform_indices(
+              container::map<Index, Index>{{Index{L"a_5"}, Index{L"a_6"}}});
+      }
+      REQUIRE(term.scalar() == 2.0);
+      REQUIRE(term.factor(0)->as<Tensor>().bra().at(0) == Index{L"a_6"});
+      REQUIRE(to_latex((*x)[1]) == sibling_latex);
+      REQUIRE(to_latex(f) == f_latex);
+    }
+  }
+
+  SECTION("arena") {
+    ExprPtr x;
+    {
+      ExprArena arena(1024);
+      ExprArena::Scope scope(arena);
+      REQUIRE(ExprArena::current() == &arena);
+      x = (ex<Constant>(1.0) + ex<Dummy>()) * (ex<Constant>(3.0) + ex<Dummy>());
+      expand(x);
+      REQUIRE(arena.nbytes() > 0);
+    }
+    REQUIRE(ExprArena::current() == nullptr);
+    // the nodes outlive the scope and the arena
+    REQUIRE(to_latex(x) ==
+            L"{ \\bigl({{{3}}} + {{\\text{Dummy}}} + {{{3}}"
+            L"{\\text{Dummy}}} + {{\\text{Dummy}}{\\text{Dummy}}}\\bigr) }");
+    x.reset();
   }
 
   SECTION("hashing") {
@@ -521,6 +661,85 @@ TEST_CASE("Expr", "[elements]") {
     REQUIRE_NOTHROW(ex<Constant>(1)->hash_value(hasher) == 0);
   }
 
+  SECTION("accumulation") {
+    auto t1 = [](const wchar_t *bra, const wchar_t *ket) {
+      return ex<Tensor>(L"t", WstrList{bra}, WstrList{ket});
+    };
+    SumAccumulator acc;
+    acc.insert(ex<Constant>(1));
+    acc.insert(ex<Product>(2, ExprPtrList{t1(L"i_1", L"a_1")}));
+    acc.insert(ex<Product>(3, ExprPtrList{t1(L"i_2", L"a_2")}));
+    acc.insert(ex<Product>(-2, ExprPtrList{t1(L"i_1", L"a_1")}) +
+               ex<Constant>(2));
+    acc.insert(ex<Product>(1, ExprPtrList{t1(L"i_2", L"a_2")}));
+    REQUIRE(acc.size() == 3);
+    auto result = acc.sum();
+    REQUIRE(result->is<Sum>());
+    REQUIRE(result->as<Sum>().size() == 2);  // zero term is dropped
+    REQUIRE(*result == *(ex<Constant>(3) +
+                         ex<Product>(4, ExprPtrList{t1(L"i_2", L"a_2")})));
+    // like terms are combined without mutating the inserted terms
+    {
+      SumAccumulator acc2;
+      auto term = ex<Product>(2, ExprPtrList{t1(L"i_1", L"a_1")});
+      acc2.insert(term);
+      acc2.insert(ex<Product>(3, ExprPtrList{t1(L"i_1", L"a_1")}));
+      REQUIRE(acc2.size() == 1);
+      REQUIRE(acc2.sum()->as<Product>().scalar() == 5.0);
+      REQUIRE(term->as<Product>().scalar() == 2.0);
+    }
+
+    // accumulating Sum
+    Sum sum;
+    sum.accumulate_like_terms();
+    REQUIRE(sum.accumulates_like_terms());
+    sum.append(ex<Product>(2, ExprPtrList{t1(L"i_1", L"a_1")}));
+    sum.append(t1(L"i_2", L"a_2"));
+    sum.append(ex<Constant>(1));
+    sum.append(ex<Product>(3, ExprPtrList{t1(L"i_1", L"a_1")}) +
+               t1(L"i_2", L"a_2"));
+    for (int i = 0; i != 1000; ++i)
+      sum.append(ex<Product>(1, ExprPtrList{t1(L"i_3", L"a_3")}));
+    REQUIRE(sum.size() == 4);
+    REQUIRE(sum.summand(0)->as<Product>().scalar() == 5.0);
+    REQUIRE(sum.summand(1)->as<Product>().scalar() == 2.0);
+    REQUIRE(sum.summand(3)->as<Product>().scalar() == 1000.0);
+    // prepending a constant shifts the indexed summands
+    {
+      Sum sum3;
+      sum3.accumulate_like_terms();
+      sum3.append(ex<Product>(2, ExprPtrList{t1(L"i_1", L"a_1")}));
+      sum3.append(ex<Product>(1, ExprPtrList{t1(L"i_2", L"a_2")}));
+      sum3.prepend(ex<Constant>(1));
+      sum3.append(ex<Product>(3, ExprPtrList{t1(L"i_1", L"a_1")}));
+      REQUIRE(sum3.size() == 3);
+      REQUIRE(sum3.summand(0)->is<Constant>());
+      REQUIRE(sum3.summand(1)->as<Product>().scalar() == 5.0);
+      REQUIRE(sum3.summand(2)->as<Product>().scalar() == 1.0);
+    }
+    // combining like terms does not mutate the appended expressions
+    {
+      Sum sum4;
+      sum4.accumulate_like_terms();
+      auto term = ex<Product>(2, ExprPtrList{t1(L"i_1", L"a_1")});
+      sum4.append(term);
+      sum4.append(ex<Product>(3, ExprPtrList{t1(L"i_1", L"a_1")}));
+      REQUIRE(sum4.size() == 1);
+      REQUIRE(sum4.summand(0)->as<Product>().scalar() == 5.0);
+      REQUIRE(term->as<Product>().scalar() == 2.0);
+    }
+    // like terms are also combined by canonicalize()
+    Sum sum2;
+    sum2.append(t1(L"i_2", L"a_2"));
+    sum2.append(ex<Product>(-1, ExprPtrList{t1(L"i_1", L"a_1")}));
+    sum2.append(ex<Product>(3, ExprPtrList{t1(L"i_2", L"a_2")}));
+    REQUIRE(sum2.size() == 3);
+    TensorCanonicalizer::register_instance(
+        std::make_shared<DefaultTensorCanonicalizer>());
+    sum2.canonicalize();
+    REQUIRE(sum2.size() == 2);
+  }
+
   SECTION("commutativity") {
     const auto ex1 = std::make_shared<VecExpr<std::shared_ptr<Constant>>>(
         std::initializer_list<std::shared_ptr<Constant>>{
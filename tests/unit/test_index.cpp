@@ -136,6 +136,53 @@ TEST_CASE("Index", "[elements]") {
     REQUIRE(hash_value(i1) != hash_value(i3));
   }
 
+  SECTION("interning") {
+    Index i1(L"i_1");
+    Index i2(std::wstring(L"i_1"));
+    // equal labels are stored once
+    REQUIRE(i1.label().data() == i2.label().data());
+    REQUIRE(i1 == i2);
+    REQUIRE(hash_value(i1) == hash_value(i2));
+    Index i3(L"i_2");
+    REQUIRE(i1.label().data() != i3.label().data());
+    REQUIRE(i1 < i3);
+    REQUIRE(InternedString(L"i_1") == InternedString(i1.label()));
+
+    // labels of temporary indices are not interned, but compare equal to the
+    // interned strings with the same characters
+    {
+      Index::TmpIndexResetScope tmp_index_reset;
+      const auto table_size = InternedString::table_size();
+      const auto tmp1 = Index::make_tmp_index(IndexSpace::instance(L"i"));
+      const auto tmp2 = Index::make_tmp_index(IndexSpace::instance(L"i"));
+      REQUIRE(InternedString::table_size() == table_size);
+      const auto tmp1_copy = tmp1;
+      REQUIRE(tmp1_copy == tmp1);
+      REQUIRE(tmp1 != tmp2);
+      const InternedString transient(tmp1.label(), InternedString::transient);
+      const InternedString interned(tmp1.label());
+      REQUIRE(!transient.interned());
+      REQUIRE(interned.interned());
+      REQUIRE(transient == interned);
+      REQUIRE(transient.hash() == interned.hash());
+      REQUIRE(transient != InternedString(tmp2.label()));
+    }
+  }
+
+  SECTION("tmp index namespace") {
+    Index::TmpIndexResetScope tmp_index_reset;
+    TmpIndexNamespace ns1;
+    TmpIndexNamespace ns2;
+    REQUIRE(ns1.base() == ns2.base());
+    const auto i1 = ns1.make(IndexSpace::instance(L"i"));
+    const auto i2 = ns2.make(IndexSpace::instance(L"i"));
+    REQUIRE(i1 == i2);
+    REQUIRE(i1.label() == L"i_" + std::to_wstring(Index::min_tmp_index()));
+    // the global counter is advanced past the labels used by namespaces
+    REQUIRE(Index::make_tmp_index(IndexSpace::instance(L"i")).label() ==
+            L"i_" + std::to_wstring(Index::min_tmp_index() + 1));
+  }
+
   SECTION("transform") {
     Index i0(L"i_0");
     Index i1(L"i_1");
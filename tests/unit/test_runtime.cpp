@@ -0,0 +1,89 @@
+#include "catch.hpp"
+
+#include "SeQuant/core/algorithm.hpp"
+#include "SeQuant/core/expr.hpp"
+#include "SeQuant/core/runtime.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+TEST_CASE("Runtime", "[runtime]") {
+  using namespace sequant;
+
+  SECTION("parallel_for_each") {
+    constexpr size_t ntasks = 100;
+    std::vector<int> visited(ntasks, 0);
+    REQUIRE_NOTHROW(parallel_for_each(
+        [&visited](size_t task_id) { ++visited[task_id]; }, ntasks));
+    for (auto &&v : visited) REQUIRE(v == 1);
+
+    // no tasks
+    REQUIRE_NOTHROW(parallel_for_each([](size_t) {}, 0));
+  }
+
+  SECTION("nested parallel_for_each") {
+    constexpr size_t nouter = 16;
+    constexpr size_t ninner = 64;
+    std::atomic<size_t> count = 0;
+    parallel_for_each(
+        [&count](size_t) {
+          parallel_for_each(
+              [&count](size_t) {
+                parallel_for_each([&count](size_t) { ++count; }, 2);
+              },
+              ninner);
+        },
+        nouter);
+    REQUIRE(count == nouter * ninner * 2);
+  }
+
+  SECTION("exceptions") {
+    std::atomic<size_t> count = 0;
+    REQUIRE_THROWS_AS(parallel_for_each(
+                          [&count](size_t task_id) {
+                            ++count;
+                            if (task_id == 3) throw std::runtime_error("task");
+                          },
+                          10),
+                      std::runtime_error);
+    // all tasks are executed
+    REQUIRE(count == 10);
+  }
+
+  SECTION("pool size") {
+    const auto nthreads = num_threads();
+    {
+      RuntimeSettingsScope runtime_settings;
+      set_num_threads(3);
+      REQUIRE(thread_pool().size() == 3);
+      std::atomic<int> count = 0;
+      parallel_do([&count](int thread_id) { count += thread_id; });
+      REQUIRE(count == 0 + 1 + 2);
+    }
+    REQUIRE(num_threads() == nthreads);
+    REQUIRE(thread_pool().size() == nthreads);
+  }
+
+  SECTION("parallel_stable_sort") {
+    RuntimeSettingsScope runtime_settings;
+    set_num_threads(4);
+    // {key, original position}; many equal keys to check stability
+    std::vector<std::pair<int, size_t>> v;
+    for (size_t i = 0; i != 10007; ++i)
+      v.emplace_back(static_cast<int>((i * 7919) % 101), i);
+    auto v_ref = v;
+    auto key_less = [](const auto &a, const auto &b) {
+      return a.first < b.first;
+    };
+    std::stable_sort(v_ref.begin(), v_ref.end(), key_less);
+    for (size_t min_chunk_size : {1, 100, 3000, 100000}) {
+      auto v_sorted = v;
+      parallel_stable_sort(v_sorted.begin(), v_sorted.end(), key_less,
+                           min_chunk_size);
+      REQUIRE(v_sorted == v_ref);
+    }
+  }
+}
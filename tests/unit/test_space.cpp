@@ -4,8 +4,12 @@
 
 #include "catch.hpp"
 
+#include "SeQuant/core/runtime.hpp"
 #include "SeQuant/core/space.hpp"
 
+#include <atomic>
+#include <string>
+
 TEST_CASE("IndexSpace", "[elements]") {
   using namespace sequant;
 
@@ -94,4 +98,46 @@ TEST_CASE("IndexSpace", "[elements]") {
     REQUIRE(occupancy_class(IndexSpace::instance(L"a")) == +1);
     REQUIRE(occupancy_class(IndexSpace::instance(L"p")) == 0);
   }
+
+  SECTION("concurrent registration") {
+    // the spaces registered here are removed at the end of the section
+    IndexSpace::RegistryScope registry_scope;
+    const auto& i = IndexSpace::instance(L"i");
+    constexpr size_t ntasks = 16;
+    std::atomic<size_t> nerrors = 0;
+    parallel_for_each(
+        [&](size_t task) {
+          // odd tasks register new spaces, even tasks look up existing ones
+          if (task % 2) {
+            const auto key = L"ξconcurrent" + std::to_wstring(task);
+            const auto type = IndexSpace::Type{1 << (10 + task / 2)};
+            IndexSpace::register_instance(key, type);
+            if (IndexSpace::instance(key).type() != type) ++nerrors;
+          } else {
+            for (int rep = 0; rep != 100; ++rep) {
+              if (IndexSpace::instance(L"i") != i ||
+                  IndexSpace::base_key(IndexSpace::instance(L"a")) != L"a")
+                ++nerrors;
+            }
+          }
+        },
+        ntasks);
+    REQUIRE(nerrors == 0);
+    // references obtained before registration remain valid
+    REQUIRE(i == IndexSpace::active_occupied);
+    REQUIRE(IndexSpace::base_key(IndexSpace::instance(L"ξconcurrent1")) ==
+            L"ξconcurrent1");
+  }
+
+  SECTION("registry scope") {
+    const auto type = IndexSpace::Type{1 << 20};
+    {
+      IndexSpace::RegistryScope registry_scope;
+      IndexSpace::register_instance(L"ξscoped", type);
+      REQUIRE(IndexSpace::instance_exists(L"ξscoped"));
+    }
+    REQUIRE_THROWS_AS(IndexSpace::instance(type, IndexSpace::nullqns),
+                      IndexSpace::bad_attr);
+    REQUIRE(IndexSpace::instance_exists(L"i"));
+  }
 }
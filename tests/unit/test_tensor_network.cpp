@@ -56,6 +56,13 @@ TEST_CASE("TensorNetwork", "[elements]") {
       auto edges = tn.edges();
       REQUIRE(edges.size() == 3);
 
+      // edges are sorted by full label, their ordinals are the index ids
+      REQUIRE(tn.find_edge(L"i_1") == tn.edges().begin());
+      REQUIRE(tn.find_edge(L"i_3") - tn.edges().begin() == 2);
+      REQUIRE(tn.find_edge(L"i_1")->size() == 2);
+      REQUIRE(tn.find_edge(L"i_2")->size() == 1);
+      REQUIRE(tn.find_edge(L"i_4") == tn.edges().end());
+
       // ext indices
       auto ext_indices = tn.ext_indices();
       REQUIRE(ext_indices.size() == 2);
@@ -144,6 +151,44 @@ TEST_CASE("TensorNetwork", "[elements]") {
     }
   }  // SECTION("accessors")
 
+  SECTION("structural hash") {
+    auto g = [](std::wstring a1, std::wstring a2) {
+      return ex<Tensor>(L"g", WstrList{L"i_1", L"i_2"}, WstrList{a1, a2},
+                        Symmetry::antisymm);
+    };
+    auto t = [](std::wstring a1, std::wstring a2, std::wstring i1,
+                std::wstring i2) {
+      return ex<Tensor>(L"t", WstrList{a1, a2}, WstrList{i1, i2},
+                        Symmetry::antisymm);
+    };
+    auto structural_hash = [](const ExprPtr &expr) {
+      return TensorNetwork(*expr).structural_hash();
+    };
+
+    const auto h = structural_hash(g(L"a_1", L"a_2") * t(L"a_1", L"a_2", L"i_1", L"i_2"));
+    // invariant w.r.t. relabeling of dummy indices, order of tensors, and
+    // permutations of slots of antisymmetric tensors
+    REQUIRE(structural_hash(g(L"a_3", L"a_4") * t(L"a_3", L"a_4", L"i_1", L"i_2")) == h);
+    REQUIRE(structural_hash(t(L"a_1", L"a_2", L"i_1", L"i_2") * g(L"a_1", L"a_2")) == h);
+    REQUIRE(structural_hash(g(L"a_2", L"a_1") * t(L"a_1", L"a_2", L"i_1", L"i_2")) == h);
+    // depends on the labels of external indices
+    REQUIRE(structural_hash(g(L"a_1", L"a_2") * t(L"a_1", L"a_2", L"i_1", L"i_3")) != h);
+
+    // invariant w.r.t. canonicalization
+    {
+      auto expr = ex<Tensor>(L"F", WstrList{L"a_3"}, WstrList{L"i_1"}) *
+                  ex<Tensor>(L"t", WstrList{L"i_2"}, WstrList{L"a_3"});
+      TensorNetwork tn(*expr);
+      const auto h = tn.structural_hash();
+      tn.canonicalize(TensorCanonicalizer::cardinal_tensor_labels(), false);
+      REQUIRE(tn.structural_hash() == h);
+      // the slots of external indices are significant
+      auto expr_swapped = ex<Tensor>(L"F", WstrList{L"a_3"}, WstrList{L"i_2"}) *
+                          ex<Tensor>(L"t", WstrList{L"i_1"}, WstrList{L"a_3"});
+      REQUIRE(structural_hash(expr_swapped) != h);
+    }
+  }  // SECTION("structural hash")
+
   SECTION("bliss graph") {
     Index::reset_tmp_index();
     // to generate expressions in specified (i.e., platform-independent) manner can't use operator expression, must use initializer list
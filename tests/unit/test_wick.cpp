@@ -2,6 +2,8 @@
 // Created by Eduard Valeyev on 3/23/18.
 //
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 
 #include "SeQuant/core/timer.hpp"
@@ -20,6 +22,19 @@ struct WickTheorem<Statistics::FermiDirac>::template access_by<WickAccessor> {
   auto compute_nontensor_wick(WickTheorem<Statistics::FermiDirac>& wick) {
     return wick.compute_nontensor_wick(false);
   }
+  auto compute_topology_partitions(WickTheorem<Statistics::FermiDirac>& wick) {
+    return wick.compute_topology_partitions();
+  }
+  auto topology_cache_entry(const ExprPtr& product) {
+    const auto key =
+        WickTheorem<Statistics::FermiDirac>::make_topology_cache_key(
+            product->as<Product>());
+    assert(key);
+    return WickTheorem<Statistics::FermiDirac>::topology_cache().find(*key);
+  }
+  auto topology_cache_size() {
+    return WickTheorem<Statistics::FermiDirac>::topology_cache().size();
+  }
 };
 
 auto compute_nontensor_wick(WickTheorem<Statistics::FermiDirac>& wick) {
@@ -27,6 +42,21 @@ auto compute_nontensor_wick(WickTheorem<Statistics::FermiDirac>& wick) {
       .compute_nontensor_wick(wick);
 }
 
+auto compute_topology_partitions(WickTheorem<Statistics::FermiDirac>& wick) {
+  return WickTheorem<Statistics::FermiDirac>::access_by<WickAccessor>{}
+      .compute_topology_partitions(wick);
+}
+
+auto topology_cache_entry(const ExprPtr& product) {
+  return WickTheorem<Statistics::FermiDirac>::access_by<WickAccessor>{}
+      .topology_cache_entry(product);
+}
+
+auto topology_cache_size() {
+  return WickTheorem<Statistics::FermiDirac>::access_by<WickAccessor>{}
+      .topology_cache_size();
+}
+
 }  // namespace sequant
 
 #if 1
@@ -80,7 +110,15 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
                          FNOperator({L"i_5"}, {L"i_6"})});
       REQUIRE_NOTHROW(FWickTheorem{opseq1});
       auto wick1 = FWickTheorem{opseq1};
-      REQUIRE_THROWS(wick1.spinfree(true).compute());
+      REQUIRE_NOTHROW(wick1.spinfree(true).compute());
+      // spin-free partial contractions are not supported
+      REQUIRE_THROWS(wick1.spinfree(true).full_contractions(false).compute());
+      // diagrams can only be enumerated for full contractions, which may be
+      // requested after enumerate_diagrams()
+      auto wick2 = FWickTheorem{opseq1};
+      REQUIRE_NOTHROW(wick2.enumerate_diagrams(true).full_contractions(false));
+      REQUIRE_THROWS_AS(wick2.spinfree(false).compute(), std::invalid_argument);
+      REQUIRE_NOTHROW(wick2.full_contractions(true).compute());
     }
 
   }  // SECTION("constructors")
@@ -192,6 +230,19 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
           L"{ \\bigl({{s^{{i_5}}_{{i_4}}}{a^{{i_1}{i_2}{i_6}}_{{i_3}{i_7}{i_8}}}} + {{s^{{i_5}}_{{i_4}}}{s^{{i_6}}_{{i_3}}}{a^{{i_1}{i_2}}_{{i_8}{i_7}}}} + {{s^{{i_6}}_{{i_4}}}{a^{{i_1}{i_2}{i_5}}_{{i_3}{i_8}{i_7}}}} + {{s^{{i_6}}_{{i_4}}}{s^{{i_5}}_{{i_3}}}{a^{{i_1}{i_2}}_{{i_7}{i_8}}}} + {{s^{{i_5}}_{{i_3}}}{a^{{i_1}{i_2}{i_6}}_{{i_7}{i_4}{i_8}}}} + {{s^{{i_6}}_{{i_3}}}{a^{{i_1}{i_2}{i_5}}_{{i_8}{i_4}{i_7}}}} + {{a^{{i_1}{i_2}{i_5}{i_6}}_{{i_3}{i_4}{i_7}{i_8}}}}\\bigr) }");
     }
 
+
+    // operators in a user-defined space outside of the complete space are not
+    // screened out
+    {
+      IndexSpace::RegistryScope registry_scope;
+      IndexSpace::register_instance(L"ξwick", IndexSpace::Type{0b1000000});
+      auto opseq = FNOperatorSeq({FNOperator({}, {L"ξwick_1"}, V),
+                                  FNOperator({L"ξwick_2"}, {}, V)});
+      auto result = FWickTheorem{opseq}.spinfree(false).compute();
+      REQUIRE(result->is<Product>());
+      REQUIRE(result->size() == 1);
+    }
+
   }  // SECTION("physical vacuum")
 
   SECTION("fermi vacuum") {
@@ -209,6 +260,71 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
       REQUIRE(result->size() == 2);  // product of 2 terms
     }
 
+    // 1-body de-excitation ^ 1-body excitation ^ 1-body excitation: screened
+    // out before any contractions are attempted
+    {
+      auto opseq = FNOperatorSeq({FNOperator({L"i_1"}, {L"a_1"}, V),
+                                  FNOperator({L"a_2"}, {L"i_2"}, V),
+                                  FNOperator({L"a_3"}, {L"i_3"}, V)});
+      auto wick = FWickTheorem{opseq};
+      auto result = wick.spinfree(false).compute();
+      REQUIRE(result->is<Constant>());
+      REQUIRE(result->as<Constant>().value() == 0.);
+      REQUIRE(wick.stats().num_attempted_contractions == 0);
+    }
+
+    // two (pure qp) spin-free 1-body operators: 1 loop
+    {
+      auto opseq =
+          FNOperatorSeq({FNOperator({L"i_1"}, {L"a_1"}, V), FNOperator({L"a_2"}, {L"i_2"}, V)});
+      auto wick = FWickTheorem{opseq};
+      REQUIRE_NOTHROW(wick.spinfree(true).compute());
+      auto result = wick.spinfree(true).compute();
+      REQUIRE(result->is<Product>());
+      REQUIRE(result->size() == 2);  // product of 2 terms
+      REQUIRE(result->as<Product>().scalar() == 2.);
+    }
+
+    // two (pure qp) spin-free 2-body operators: 2 terms with 2 loops, 2 terms with 1 loop
+    {
+      auto opseq =
+          FNOperatorSeq({FNOperator({L"i_1", L"i_2"}, {L"a_1", L"a_2"}, V),
+                         FNOperator({L"a_3", L"a_4"}, {L"i_3", L"i_4"}, V)});
+      auto wick = FWickTheorem{opseq};
+      auto result = wick.spinfree(true).compute();
+      REQUIRE(result->is<Sum>());
+      REQUIRE(result->size() == 4);
+      std::complex<double> sum_of_abs_scalars = 0;
+      for (auto &&term : *result)
+        sum_of_abs_scalars += std::abs(term->as<Product>().scalar());
+      REQUIRE(sum_of_abs_scalars == 12.);
+    }
+
+    // two (pure qp) spin-free N-nonconserving 1/2-body operators: open chains
+    // are not loops
+    {
+      auto opseq = FNOperatorSeq({FNOperator({L"i_1"}, {}, V),
+                                  FNOperator({}, {L"i_2"}, V)});
+      auto wick = FWickTheorem{opseq};
+      auto result = wick.spinfree(true).compute();
+      REQUIRE(result->is<Product>());
+      REQUIRE(std::abs(result->as<Product>().scalar()) == 1.);  // 0 loops
+    }
+    // 1 term with 1 loop and 1 open chain, 1 term with 1 open chain
+    {
+      auto opseq =
+          FNOperatorSeq({FNOperator({L"i_1", L"i_2"}, {L"a_1"}, V),
+                         FNOperator({L"a_2"}, {L"i_3", L"i_4"}, V)});
+      auto wick = FWickTheorem{opseq};
+      auto result = wick.spinfree(true).compute();
+      REQUIRE(result->is<Sum>());
+      REQUIRE(result->size() == 2);
+      std::complex<double> sum_of_abs_scalars = 0;
+      for (auto &&term : *result)
+        sum_of_abs_scalars += std::abs(term->as<Product>().scalar());
+      REQUIRE(sum_of_abs_scalars == 3.);
+    }
+
     // two (pure qp) N-nonconserving 2-body operators
     {
       auto opseq =
@@ -410,6 +526,12 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
               {1, 2}, {1, 3}}).spinfree(false).compute();
       REQUIRE(result2->is<Sum>());
       REQUIRE(result2->size() == 2);
+      // count_only counts combinatorially, accounting for the constraints
+      auto wick3 = FWickTheorem{opseq};
+      auto result3 = wick3.set_op_connections({{1, 2}, {1, 3}})
+                         .spinfree(false)
+                         .compute(true);
+      REQUIRE(result3->as<Constant>().value<int>() == 2);
     }
 
     // 4-body ^ 2-body ^ 2-body
@@ -436,6 +558,23 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
       auto result = wick.spinfree(false).compute();
       REQUIRE(result->is<Sum>());
       REQUIRE(result->size() == 80);
+
+      // same, with contractions distributed among threads: the canonicalized
+      // results must match the serial result, in every run
+      RuntimeSettingsScope runtime_settings;
+      set_num_threads(4);
+      auto compute_par = [&opseq]() {
+        auto wick_par = FWickTheorem{opseq};
+        auto result_par =
+            wick_par.spinfree(false).parallelize_contractions(true).compute();
+        canonicalize(result_par);
+        return to_latex(result_par);
+      };
+      const auto result_par_1 = compute_par();
+      const auto result_par_2 = compute_par();
+      canonicalize(result);
+      REQUIRE(result_par_1 == to_latex(result));
+      REQUIRE(result_par_2 == result_par_1);
     }
 
     // 2-body ^ 2-body ^ 2-body ^ 2-body
@@ -450,6 +589,13 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
       auto result = wick.spinfree(false).compute(true);
       REQUIRE(result->is<Constant>());
       REQUIRE(result->as<Constant>().value<int>() == 4752);
+
+      // same, with contractions distributed among threads
+      auto wick_par = FWickTheorem{opseq};
+      auto result_par =
+          wick_par.spinfree(false).parallelize_contractions(true).compute(true);
+      REQUIRE(result_par->is<Constant>());
+      REQUIRE(result_par->as<Constant>().value<int>() == 4752);
     }
     )
 
@@ -537,6 +683,276 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
 #endif
   }  // SECTION("fermi vacuum")
 
+  SECTION("statistics") {
+    constexpr Vacuum V = Vacuum::SingleProduct;
+
+    // detailed statistics; the contractions of general indices create
+    // temporary indices, hence this is kept out of the "fermi vacuum" section
+    // whose expected results depend on the tmp index counter
+    auto opseq = FNOperatorSeq({FNOperator({L"p_1", L"p_2"}, {L"p_3", L"p_4"}, V),
+                                FNOperator({L"p_5", L"p_6"}, {L"p_7", L"p_8"}, V)});
+    auto wick = FWickTheorem{opseq};
+    {
+      RuntimeSettingsScope runtime_settings;
+      Logger::get_instance().wick_stats = true;
+      wick.spinfree(false).compute();
+    }
+    const auto &stats = wick.stats();
+    size_t nattempted = 0;
+    for (auto &&n : stats.num_attempted_contractions_per_level) nattempted += n;
+    REQUIRE(nattempted == stats.num_attempted_contractions);
+    REQUIRE(stats.num_pruned_can_contract > 0);
+    REQUIRE(stats.peak_result_size == 4);
+    REQUIRE(stats.to_json().find("\"num_pruned_topology\": 0") !=
+            std::string::npos);
+  }  // SECTION("statistics")
+
+  SECTION("deterministic") {
+    constexpr Vacuum V = Vacuum::SingleProduct;
+    RuntimeSettingsScope runtime_settings;
+    set_deterministic(true);
+
+    // the result, including the temporary indices, does not depend on the
+    // number of threads; every run starts from the same tmp index counter
+    {
+      auto opseq = FNOperatorSeq({FNOperator({L"p_1", L"p_2"}, {L"p_3", L"p_4"}, V),
+                                  FNOperator({L"p_5", L"p_6"}, {L"p_7", L"p_8"}, V)});
+      auto compute = [&opseq](int nthreads) {
+        set_num_threads(nthreads);
+        Index::TmpIndexResetScope tmp_index_reset;
+        auto wick = FWickTheorem{opseq};
+        return to_latex(wick.full_contractions(false)
+                            .spinfree(false)
+                            .parallelize_contractions(true)
+                            .compute());
+      };
+      const auto result_1 = compute(1);
+      const auto result_4 = compute(4);
+      REQUIRE(result_1 == result_4);
+    }
+
+    // Sum input: summands are distributed among threads and their results
+    // are combined by the ordered accumulator
+    {
+      auto P2 = ex<Tensor>(L"A", WstrList{L"i_1", L"i_2"},
+                           WstrList{L"a_1", L"a_2"}, Symmetry::antisymm) *
+                ex<FNOperator>(WstrList{L"i_1", L"i_2"},
+                               WstrList{L"a_1", L"a_2"}, V);
+      auto H = ex<Constant>(1. / 4) *
+                   ex<Tensor>(L"g", WstrList{L"p_1", L"p_2"},
+                              WstrList{L"p_3", L"p_4"}, Symmetry::antisymm) *
+                   ex<FNOperator>(WstrList{L"p_1", L"p_2"},
+                                  WstrList{L"p_3", L"p_4"}, V) +
+               ex<Tensor>(L"f", WstrList{L"p_5"}, WstrList{L"p_6"}) *
+                   ex<FNOperator>(WstrList{L"p_5"}, WstrList{L"p_6"}, V);
+      auto T = ex<Constant>(1. / 4) *
+                   ex<Tensor>(L"t", WstrList{L"a_3", L"a_4"},
+                              WstrList{L"i_3", L"i_4"}, Symmetry::antisymm) *
+                   ex<FNOperator>(WstrList{L"a_3", L"a_4"},
+                                  WstrList{L"i_3", L"i_4"}, V) +
+               ex<Tensor>(L"t", WstrList{L"a_5"}, WstrList{L"i_5"}) *
+                   ex<FNOperator>(WstrList{L"a_5"}, WstrList{L"i_5"}, V);
+      auto compute = [&](int nthreads) {
+        set_num_threads(nthreads);
+        Index::TmpIndexResetScope tmp_index_reset;
+        FWickTheorem wick{P2 * H * T};
+        return to_latex(wick.spinfree(false)
+                            .use_topology(true)
+                            .accumulate_like_terms(true)
+                            .compute());
+      };
+      const auto result_1 = compute(1);
+      for (int nt : {1, 2, 4}) {
+        for (int run = 0; run != 2; ++run) REQUIRE(compute(nt) == result_1);
+      }
+    }
+  }  // SECTION("deterministic")
+
+  SECTION("long sequences") {
+    constexpr Vacuum V = Vacuum::SingleProduct;
+
+    // sequence of (pure qp) 1-op NormalOperator objects:
+    // nblocks * {ann, ann, cre, cre} has 2^nblocks full contractions
+    auto make_opseq = [](size_t nblocks) {
+      FNOperatorSeq opseq;
+      size_t ord = 0;
+      auto label = [&ord]() { return L"a_" + std::to_wstring(++ord); };
+      for (size_t b = 0; b != nblocks; ++b) {
+        for (int k = 0; k != 2; ++k)
+          opseq.push_back(FNOperator({}, {Index{label()}}, V));
+        for (int k = 0; k != 2; ++k)
+          opseq.push_back(FNOperator({Index{label()}}, {}, V));
+      }
+      return opseq;
+    };
+
+    // 40 NormalOperator objects
+    {
+      auto opseq = make_opseq(10);
+      REQUIRE(opseq.size() == 40);
+      auto result = FWickTheorem{opseq}.spinfree(false).compute();
+      REQUIRE(result->is<Sum>());
+      REQUIRE(result->size() == 1024);
+      auto count = FWickTheorem{opseq}.spinfree(false).compute(true);
+      REQUIRE(count->as<Constant>().value<int>() == 1024);
+    }
+
+    // more than 64 NormalOperator objects are rejected
+    {
+      auto opseq = make_opseq(17);
+      REQUIRE(opseq.size() == 68);
+      REQUIRE_THROWS_AS(FWickTheorem{opseq}.spinfree(false).compute(),
+                        std::invalid_argument);
+    }
+  }  // SECTION("long sequences")
+
+  SECTION("tmp index labels") {
+    constexpr Vacuum V = Vacuum::SingleProduct;
+    Index::TmpIndexResetScope tmp_index_reset;
+
+    // the compact kernel creates the temporary indices of the overlaps when a
+    // full contraction is complete, labeled by the global tmp counter
+    auto opseq =
+        FNOperatorSeq({FNOperator({L"p_1"}, {L"p_2"}, V), FNOperator({L"p_3"}, {L"p_4"}, V)});
+    auto result = FWickTheorem{opseq}.spinfree(false).compute();
+    REQUIRE(to_latex(result)
+                == L"{{s^{{p_1}}_{{m_{100}}}}{s^{{m_{100}}}_{{p_4}}}{s^{{e_{101}}}_{{p_2}}}{s^{{p_3}}_{{e_{101}}}}}");
+  }  // SECTION("tmp index labels")
+
+  SECTION("cache") {
+    constexpr Vacuum V = Vacuum::SingleProduct;
+
+    // reuse the result cached for an operator sequence with different labels
+    {
+      WickCache::instance().clear();
+      auto opseq1 =
+          FNOperatorSeq({FNOperator({L"p_5"}, {L"p_6"}, V), FNOperator({L"p_7"}, {L"p_8"}, V)});
+      auto result1 = FWickTheorem{opseq1}.spinfree(false).use_cache(true).compute();
+      REQUIRE(WickCache::instance().size() == 1);
+      REQUIRE(WickCache::instance().nmisses() == 1);
+      auto opseq2 =
+          FNOperatorSeq({FNOperator({L"p_1"}, {L"p_2"}, V), FNOperator({L"p_3"}, {L"p_4"}, V)});
+      auto result2 = FWickTheorem{opseq2}.spinfree(false).use_cache(true).compute();
+      REQUIRE(WickCache::instance().nhits() == 1);
+      REQUIRE(result2->is<Product>());
+      REQUIRE(result2->size() == 4);
+      REQUIRE(result2->as<Product>().factor(0)->as<Tensor>().bra().at(0) == Index(L"p_1"));
+      REQUIRE(result2->as<Product>().factor(1)->as<Tensor>().ket().at(0) == Index(L"p_4"));
+      WickCache::instance().clear();
+    }
+
+    // backing store: the entries written by one cache are loaded by the next
+    {
+      const std::string filename = "test_wick_cache.txt";
+      std::remove(filename.c_str());
+      WickCache::instance().clear();
+      WickCache::instance().set_backing_store(filename);
+      auto opseq =
+          FNOperatorSeq({FNOperator({L"p_1"}, {L"p_2"}, V), FNOperator({L"p_3"}, {L"p_4"}, V)});
+      FWickTheorem{opseq}.spinfree(false).use_cache(true).compute();
+      WickCache::instance().flush();
+      WickCache::instance().set_backing_store("");
+      WickCache::instance().clear();
+      WickCache::instance().set_backing_store(filename);
+      REQUIRE(WickCache::instance().size() == 1);
+      WickCache::instance().set_backing_store("");
+      WickCache::instance().clear();
+      std::remove(filename.c_str());
+
+      // a corrupt entry is a cache miss
+      {
+        WickCache::instance().set_backing_store(filename);
+        auto opseq = FNOperatorSeq(
+            {FNOperator({L"p_1"}, {L"p_2"}, V), FNOperator({L"p_3"}, {L"p_4"}, V)});
+        auto expected = FWickTheorem{opseq}.spinfree(false).compute();
+        FWickTheorem{opseq}.spinfree(false).use_cache(true).compute();
+        WickCache::instance().set_backing_store("");
+        WickCache::instance().clear();
+        std::string contents;
+        {
+          std::ifstream ifs(filename);
+          std::string line;
+          while (std::getline(ifs, line)) {
+            const auto tab_pos = line.find('\t');
+            if (tab_pos != std::string::npos)
+              line = line.substr(0, tab_pos) + "\tP 1 0 2 s k0 k9";
+            contents += line + '\n';
+          }
+        }
+        std::ofstream(filename) << contents;
+        WickCache::instance().set_backing_store(filename);
+        REQUIRE(WickCache::instance().size() == 1);
+        auto result =
+            FWickTheorem{opseq}.spinfree(false).use_cache(true).compute();
+        REQUIRE(to_latex(result) == to_latex(expected));
+        WickCache::instance().set_backing_store("");
+        WickCache::instance().clear();
+        std::remove(filename.c_str());
+      }
+
+      // the entries written for a different registry of IndexSpace objects,
+      // or without a header, are ignored
+      {
+        std::ofstream ofs(filename);
+        ofs << "fc k0\tC 1 0\n"
+            << "# sequant::WickCache v1 a:1,1;\n"
+            << "fc k1\tC 1 0\n";
+      }
+      WickCache::instance().set_backing_store(filename);
+      REQUIRE(WickCache::instance().size() == 0);
+      WickCache::instance().set_backing_store("");
+      std::remove(filename.c_str());
+    }
+
+    // topology cache: a hit returns the partitions computed by a cold run
+    {
+      // H2*T1*T1 with labels offset by @p ord
+      auto make_input = [](int ord) {
+        auto l = [ord](const wchar_t *base, int k) {
+          return std::wstring(base) + L"_" + std::to_wstring(ord + k);
+        };
+        const auto p1 = l(L"p", 1), p2 = l(L"p", 2), p3 = l(L"p", 3),
+                   p4 = l(L"p", 4), a1 = l(L"a", 1), a2 = l(L"a", 2),
+                   i1 = l(L"i", 1), i2 = l(L"i", 2);
+        return ex<Tensor>(L"g", WstrList{p1, p2}, WstrList{p3, p4},
+                          Symmetry::antisymm) *
+               ex<Tensor>(L"t", WstrList{a1}, WstrList{i1}) *
+               ex<Tensor>(L"t", WstrList{a2}, WstrList{i2}) *
+               ex<FNOperator>(WstrList{p1, p2}, WstrList{p3, p4}, V) *
+               ex<FNOperator>(WstrList{a1}, WstrList{i1}, V) *
+               ex<FNOperator>(WstrList{a2}, WstrList{i2}, V);
+      };
+      FWickTheorem::reset_topology_cache();
+      REQUIRE(topology_cache_size() == 0);
+
+      FWickTheorem wick_cold{make_input(0)};
+      wick_cold.spinfree(false).use_topology(true).full_contractions(true);
+      const auto partitions_cold = compute_topology_partitions(wick_cold);
+      auto result_cold = wick_cold.compute();
+      REQUIRE(topology_cache_size() == 1);
+      const auto partitions_cached = topology_cache_entry(make_input(0));
+      REQUIRE(partitions_cached);
+      REQUIRE(partitions_cached->nop_partitions ==
+              partitions_cold.nop_partitions);
+      REQUIRE(partitions_cached->nonequivalent_braket ==
+              partitions_cold.nonequivalent_braket);
+
+      // same structure, different labels: hits the cache
+      auto result_warm = FWickTheorem{make_input(10)}
+                             .spinfree(false)
+                             .use_topology(true)
+                             .full_contractions(true)
+                             .compute();
+      REQUIRE(topology_cache_size() == 1);
+      canonicalize(result_cold);
+      canonicalize(result_warm);
+      REQUIRE(to_latex(result_warm) == to_latex(result_cold));
+
+      FWickTheorem::reset_topology_cache();
+      REQUIRE(topology_cache_size() == 0);
+    }
+  }  // SECTION("cache")
+
   auto print = [](const auto &lead, const auto &expr) {
     std::wcout << lead << to_latex(expr) << std::endl;
   };
@@ -544,6 +960,44 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
   SECTION("Expression Reduction") {
     constexpr Vacuum V = Vacuum::SingleProduct;
 
+    // chain of Kronecker deltas p_1->p_2->p_3->p_4 collapses to one index
+    {
+      auto make_chain = [] {
+        return std::make_shared<Product>(Product{
+            ex<Tensor>(L"g", WstrList{L"p_5"}, WstrList{L"p_1"}),
+            make_overlap(Index{L"p_1"}, Index{L"p_2"}),
+            make_overlap(Index{L"p_2"}, Index{L"p_3"}),
+            make_overlap(Index{L"p_3"}, Index{L"p_4"}),
+            ex<Tensor>(L"t", WstrList{L"p_4"}, WstrList{L"p_6"})});
+      };
+      const container::set<Index> external_indices{Index{L"p_5"},
+                                                   Index{L"p_6"}};
+
+      auto union_find = make_chain();
+      detail::reduce_wick_union_find(union_find, external_indices);
+      container::set<Index> internal_indices;
+      for (auto &&factor : union_find->factors()) {
+        if (!factor->is<Tensor>()) continue;
+        const auto &tensor = factor->as<Tensor>();
+        REQUIRE(tensor.label() != overlap_label());
+        for (auto &&idx : tensor.braket())
+          if (external_indices.find(idx) == external_indices.end())
+            internal_indices.insert(idx);
+      }
+      REQUIRE(internal_indices.size() == 1);
+
+      auto fixed_point = make_chain();
+      detail::reduce_wick_fixed_point(fixed_point, external_indices);
+
+      ExprPtr union_find_expr = union_find;
+      ExprPtr fixed_point_expr = fixed_point;
+      rapid_simplify(union_find_expr);
+      rapid_simplify(fixed_point_expr);
+      canonicalize(union_find_expr);
+      canonicalize(fixed_point_expr);
+      REQUIRE(to_latex(union_find_expr) == to_latex(fixed_point_expr));
+    }
+
     // 2-body ^ 2-body
     SEQUANT_PROFILE_SINGLE("wick(H2*T2)", {
       auto opseq =
@@ -590,6 +1044,33 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
               L"{\\bar{g}^{{a_1}{a_2}}_{{i_1}{i_2}}}{t^{{i_1}{i_2}}_{{a_1}{a_2}}}}");
     });
 
+    // 2-body ^ 2-body, streamed
+    SEQUANT_PROFILE_SINGLE("wick(H2*T2) streamed", {
+      auto input =
+          ex<Tensor>(L"g", WstrList{L"p_1", L"p_2"}, WstrList{L"p_3", L"p_4"},
+                     Symmetry::antisymm) *
+          ex<Tensor>(L"t", WstrList{L"a_4", L"a_5"}, WstrList{L"i_4", L"i_5"},
+                     Symmetry::antisymm) *
+          ex<FNOperator>(WstrList{L"p_1", L"p_2"}, WstrList{L"p_3", L"p_4"},
+                         V) *
+          ex<FNOperator>(WstrList{L"a_4", L"a_5"}, WstrList{L"i_4", L"i_5"},
+                         V);
+      TensorCanonicalizer::register_instance(
+          std::make_shared<DefaultTensorCanonicalizer>());
+      FWickTheorem wick{input};
+      SumAccumulator accumulator;
+      size_t nterms = 0;
+      wick.spinfree(false).compute_streaming([&](ExprPtr term) {
+        ++nterms;
+        accumulator.insert(std::move(term));
+      });
+      REQUIRE(nterms == 4);
+      REQUIRE(accumulator.size() == 1);
+      REQUIRE(to_latex(accumulator.sum()) ==
+              L"{{{4}}"
+              L"{\\bar{g}^{{a_1}{a_2}}_{{i_1}{i_2}}}{t^{{i_1}{i_2}}_{{a_1}{a_2}}}}");
+    });
+
     // 2-body ^ 1-body ^ 1-body
     SEQUANT_PROFILE_SINGLE("wick(H2*T1*T1)", {
       constexpr bool use_op_partitions = true;
@@ -629,6 +1110,42 @@ TEST_CASE("WickTheorem", "[algorithms][wick]") {
               L"2}}}}");
     });
 
+    // 2-body ^ 1-body ^ 1-body, by direct enumeration of diagrams
+    SEQUANT_PROFILE_SINGLE("wick(H2*T1*T1) diagrams", {
+      auto opseq =
+          FNOperatorSeq({FNOperator({L"p_1", L"p_2"}, {L"p_3", L"p_4"}, V),
+                         FNOperator({L"a_4"}, {L"i_4"}, V),
+                         FNOperator({L"a_5"}, {L"i_5"}, V)});
+      auto wick = FWickTheorem{opseq};
+      wick.spinfree(false).use_topology(true).enumerate_diagrams(true);
+      wick.set_op_partitions({{1, 2}});
+      REQUIRE(wick.compute(true)->as<Constant>().value() == 1.);
+      auto wick_result = wick.compute();
+      REQUIRE(wick_result->is<Product>());
+
+      // multiply tensor factors and expand
+      auto wick_result_2 =
+          ex<Tensor>(L"g", WstrList{L"p_1", L"p_2"}, WstrList{L"p_3", L"p_4"},
+                     Symmetry::antisymm) *
+          ex<Tensor>(L"t", WstrList{L"a_4"}, WstrList{L"i_4"},
+                     Symmetry::antisymm) *
+          ex<Tensor>(L"t", WstrList{L"a_5"}, WstrList{L"i_5"},
+                     Symmetry::antisymm) *
+          wick_result;
+      expand(wick_result_2);
+      wick.reduce(wick_result_2);
+      rapid_simplify(wick_result_2);
+      TensorCanonicalizer::register_instance(
+          std::make_shared<DefaultTensorCanonicalizer>(std::vector<Index>{}));
+      canonicalize(wick_result_2);
+      rapid_simplify(wick_result_2);
+
+      REQUIRE(to_latex(wick_result_2) ==
+              L"{{{4}}"
+              L"{\\bar{g}^{{a_1}{a_2}}_{{i_1}{i_2}}}{t^{{i_1}}_{{a_1}}}{t^{{i_2}}_{{a_"
+              L"2}}}}");
+    });
+
     // 2=body ^ 1-body ^ 2-body with dependent (PNO) indices
     SEQUANT_PROFILE_SINGLE("wick(P2*H1*T2)", {
       auto opseq = FNOperatorSeq({FNOperator(IndexList{L"i_1", L"i_2"},